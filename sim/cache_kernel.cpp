@@ -0,0 +1,74 @@
+#include "cache_kernel.h"
+#include "hashed_cache.h"
+
+template <u32 WAYS, u32 BLK>
+static CacheUnit* create_with_policy(const string &tag, const MemoryConfig &config) {
+  switch (config.policy_type) {
+    case LRU_POLICY:
+      return new CacheKernel<WAYS, BLK, LRU_POLICY>(tag, config);
+    case LIP_POLICY:
+      return new CacheKernel<WAYS, BLK, LIP_POLICY>(tag, config);
+    case BIP_POLICY:
+      return new CacheKernel<WAYS, BLK, BIP_POLICY>(tag, config);
+    case DIP_POLICY:
+      return new CacheKernel<WAYS, BLK, DIP_POLICY>(tag, config);
+    case SRRIP_POLICY:
+      return new CacheKernel<WAYS, BLK, SRRIP_POLICY>(tag, config);
+    case BRRIP_POLICY:
+      return new CacheKernel<WAYS, BLK, BRRIP_POLICY>(tag, config);
+    case DRRIP_POLICY:
+      return new CacheKernel<WAYS, BLK, DRRIP_POLICY>(tag, config);
+    default:
+      return NULL;
+  }
+}
+
+template <u32 WAYS>
+static CacheUnit* create_with_block(const string &tag, const MemoryConfig &config) {
+  switch (config.blk_size) {
+    case 64:
+      return create_with_policy<WAYS, 64>(tag, config);
+    case 128:
+      return create_with_policy<WAYS, 128>(tag, config);
+    case 256:
+      return create_with_policy<WAYS, 256>(tag, config);
+    default:
+      return NULL;
+  }
+}
+
+static CacheUnit* create_kernel(const string &tag, const MemoryConfig &config) {
+  switch (config.ways) {
+    case 4:
+      return create_with_block<4>(tag, config);
+    case 8:
+      return create_with_block<8>(tag, config);
+    case 16:
+      return create_with_block<16>(tag, config);
+    case 32:
+      return create_with_block<32>(tag, config);
+    default:
+      return NULL;
+  }
+}
+
+bool has_cache_kernel(const MemoryConfig &config) {
+  bool ways = config.ways == 4 || config.ways == 8 || config.ways == 16 || config.ways == 32;
+  bool block = config.blk_size == 64 || config.blk_size == 128 || config.blk_size == 256;
+  CR_POLICY p = config.policy_type;
+  bool policy = p == LRU_POLICY || p == LIP_POLICY || p == BIP_POLICY || p == DIP_POLICY ||
+                p == SRRIP_POLICY || p == BRRIP_POLICY || p == DRRIP_POLICY;
+  return ways && block && policy && config.organization == SET_ORGANIZATION;
+}
+
+CacheUnit* create_cache_unit(const string &tag, const MemoryConfig &config, bool kernels) {
+  if (config.organization == HASHED_ORGANIZATION) {
+    return new HashedCacheUnit(tag, config);
+  }
+  if (kernels && has_cache_kernel(config)) {
+    CacheUnit *ret = create_kernel(tag, config);
+    assert(ret);
+    return ret;
+  }
+  return new CacheUnit(tag, config);
+}
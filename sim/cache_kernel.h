@@ -0,0 +1,240 @@
+#ifndef CACHE_KERNEL_H
+#define CACHE_KERNEL_H
+
+#include "memory_hierarchy.h"
+#include "cr_policy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define KERNEL_SIMD
+#endif
+
+/*
+ * 编译期特化的cache内核: 相联度、块大小与替换策略是模板参数，查找、
+ * 替换状态更新的循环次数与块内偏移的移位都是常量，循环可以展开，策略
+ * 的更新直接写在内核里，不再经过CacheSet与CRPolicyInterface的虚函数。
+ * 特化LRU栈表示的LRU/LIP/BIP/DIP(见CR_LRU_Policy)与RRPV表示的
+ * SRRIP/BRRIP/DRRIP，BIP/BRRIP的随机数与DIP/DRRIP的set dueling仍由
+ * cache自己的策略对象保存(内联访问)，按与通用实现相同的顺序抽取与更新，
+ * 替换决定与通用实现一致。块元数据与通用CacheUnit完全相同，census、
+ * 检查点、打印等仍通过CacheSet进行。
+ * create_cache_unit 为常用几何参数选择内核，其他配置使用通用的CacheUnit。
+ * 内核的收益在优化编译(make release)下才能体现，见micro_bench
+ */
+template <u32 WAYS, u32 BLK, CR_POLICY POLICY>
+class CacheKernel: public CacheUnit {
+ private:
+  static constexpr bool STACK = POLICY == LRU_POLICY || POLICY == LIP_POLICY ||
+                                POLICY == BIP_POLICY || POLICY == DIP_POLICY;
+  static constexpr bool RRPV = POLICY == SRRIP_POLICY || POLICY == BRRIP_POLICY ||
+                               POLICY == DRRIP_POLICY;
+  static_assert(STACK || RRPV, "only the LRU stack and the RRIP policies have kernels");
+  static_assert(WAYS <= 32, "ways are found by a 32 bit mask");
+
+  static constexpr u32 STRIDE = BlockArray::stride_of(WAYS);
+  static constexpr u32 OFFSET_BITS = AddressDecoder(BLK, 1).get_offset_bits();
+
+  // the columns of the block array, a set starts at set_no * STRIDE
+  u64 *           _tag_base;
+  u8 *            _pid_base;
+  u32 *           _state_base;
+  u64             _index_mask;
+  u32             _tag_shift;
+
+  inline u64 set_of(u64 addr) {
+    return (addr >> OFFSET_BITS) & _index_mask;
+  }
+
+  // the first way holding the tag, -1 if none. all ways are compared
+  // without branches, with SSE2 two at a time (both 32 bit halves match)
+  static inline s32 find(const u64 *tags, u64 tag) {
+    u32 mask = 0;
+#ifdef KERNEL_SIMD
+    __m128i key = _mm_set1_epi64x(tag);
+    for (u32 i = 0; i < WAYS; i += 2) {
+      __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(tags + i)), key);
+      eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+      mask |= (u32)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+    }
+#else
+    for (u32 i = 0; i < WAYS; i++) {
+      mask |= (u32)(tags[i] == tag) << i;
+    }
+#endif
+    return mask ? __builtin_ctz(mask) : -1;
+  }
+
+  // see CR_LRU_Policy::promote
+  static inline void promote(u32 *states, u32 pos) {
+    u32 stack_pos = states[pos];
+    for (u32 i = 0; i < WAYS; i++) {
+      states[i] += (states[i] < stack_pos);
+    }
+    states[pos] = 0;
+  }
+
+  // see CR_SRRIP_Policy::find_victim
+  static inline u32 rrip_victim(const u64 *tags, u32 *states) {
+    s32 empty = find(tags, BlockArray::INVALID_TAG);
+    if (empty != -1) {
+      return empty;
+    }
+    // the ways at each RRPV, the first way at the largest one is the victim
+    u32 at[RRPV_MAX + 1] = {0};
+#ifdef KERNEL_SIMD
+    for (u32 i = 0; i < WAYS; i += 4) {
+      __m128i rrpv = _mm_loadu_si128((const __m128i *)(states + i));
+      for (u32 r = 0; r <= RRPV_MAX; r++) {
+        __m128i eq = _mm_cmpeq_epi32(rrpv, _mm_set1_epi32(r));
+        at[r] |= (u32)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+      }
+    }
+#else
+    for (u32 i = 0; i < WAYS; i++) {
+      at[states[i]] |= 1U << i;
+    }
+#endif
+    u32 largest = RRPV_MAX;
+    while (!at[largest]) {
+      largest--;
+    }
+    u32 victim = __builtin_ctz(at[largest]);
+    u32 age = RRPV_MAX - largest;
+    for (u32 i = 0; i < WAYS; i++) {
+      states[i] += age;
+    }
+    return victim;
+  }
+
+  inline SetDueling& dueling() {
+    return POLICY == DIP_POLICY ? ((CR_DIP_Policy *)_cr_policy)->get_dueling() :
+                                  ((CR_DRRIP_Policy *)_cr_policy)->get_dueling();
+  }
+
+  // the new block of the set enters at the MRU position, see the
+  // insert_at_mru of the stack policies
+  inline bool insert_at_mru(u64 set_no) {
+    switch (POLICY) {
+      case LRU_POLICY:
+        return true;
+      case BIP_POLICY:
+        return ((CR_BIP_Policy *)_cr_policy)->use_LRU();
+      case DIP_POLICY:
+        return !dueling().use_bimodal(set_no) ||
+               ((CR_DIP_Policy *)_cr_policy)->get_bip()->use_LRU();
+      default:
+        return false;
+    }
+  }
+
+  // the RRPV of a new block of the set, see the on_arrive of the RRIP policies
+  inline u32 insertion_rrpv(u64 set_no) {
+    switch (POLICY) {
+      case BRRIP_POLICY:
+        return ((CR_BRRIP_Policy *)_cr_policy)->insertion_rrpv();
+      case DRRIP_POLICY:
+        if (dueling().use_bimodal(set_no)) {
+          return ((CR_DRRIP_Policy *)_cr_policy)->get_brrip()->insertion_rrpv();
+        }
+        return RRPV_MAX - 1;
+      default:
+        return RRPV_MAX - 1;
+    }
+  }
+
+  inline void on_hit(u32 *states, u32 pos) {
+    if (STACK) {
+      promote(states, pos);
+    }
+    else {
+      states[pos] = 0;
+    }
+  }
+
+ protected:
+  bool try_access_memory(const MemoryAccessInfo &info) {
+    u64 set_no = set_of(info.addr);
+    u64 base = set_no * STRIDE;
+    s32 pos = find(_tag_base + base, info.addr >> _tag_shift);
+    if (pos == -1) {
+      if (POLICY == DIP_POLICY || POLICY == DRRIP_POLICY) {
+        dueling().on_miss(set_no);
+      }
+      _stats->increment_miss(info.Pid);
+      return false;
+    }
+    on_hit(_state_base + base, pos);
+    _stats->increment_hit(info.Pid);
+    return true;
+  }
+
+  void on_memory_arrive(const MemoryAccessInfo &info) {
+    u64 set_no = set_of(info.addr);
+    u64 base = set_no * STRIDE;
+    u64 tag = info.addr >> _tag_shift;
+    u64 *tags = _tag_base + base;
+    u32 *states = _state_base + base;
+    // the mshr merges the misses to a block, it arrives once
+    assert(find(tags, tag) == -1);
+    u32 victim = 0;
+    if (STACK) {
+      for (u32 i = 0; i < WAYS; i++) {
+        victim = states[i] == WAYS - 1 ? i : victim;
+      }
+    }
+    else {
+      victim = rrip_victim(tags, states);
+    }
+    tags[victim] = tag;
+    _pid_base[base + victim] = info.Pid;
+    if (STACK) {
+      // else the new block stays at the LRU position
+      if (insert_at_mru(set_no)) {
+        promote(states, victim);
+      }
+    }
+    else {
+      states[victim] = insertion_rrpv(set_no);
+    }
+  }
+
+  // the kernel does not touch the set views
+  void prefetch_set(u64 set_no, u64 addr) {
+    _blocks->prefetch(set_no);
+  }
+
+ public:
+  CacheKernel(const string &tag, const MemoryConfig &config) : CacheUnit(tag, config) {
+    assert(config.ways == WAYS && config.blk_size == BLK && config.policy_type == POLICY);
+    assert(_blocks->get_stride() == STRIDE);
+    _tag_base = _blocks->get_tags(0);
+    _pid_base = _blocks->get_pids(0);
+    _state_base = _blocks->get_states(0);
+    _index_mask = _sets - 1;
+    _tag_shift = _decoder.get_tag_shift();
+  }
+
+  bool try_fast_hit(const MemoryAccessInfo &info) {
+    if (has_pending()) {
+      return false;
+    }
+    u64 base = set_of(info.addr) * STRIDE;
+    s32 pos = find(_tag_base + base, info.addr >> _tag_shift);
+    if (pos == -1) {
+      return false;
+    }
+    on_hit(_state_base + base, pos);
+    _stats->increment_hit(info.Pid);
+    return true;
+  }
+};
+
+// a kernel for 4/8/16/32 ways, 64/128/256 byte blocks and
+// LRU/LIP/BIP/DIP/SRRIP/BRRIP/DRRIP when kernels are allowed, the generic
+// CacheUnit otherwise. caches of the hashed
+// organization are HashedCacheUnits
+CacheUnit* create_cache_unit(const string &tag, const MemoryConfig &config, bool kernels);
+// whether create_cache_unit builds a kernel for the configuration
+bool has_cache_kernel(const MemoryConfig &config);
+
+#endif
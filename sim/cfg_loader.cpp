@@ -36,11 +36,30 @@ static BaseNodeCfg* parse_node(Value &node) {
     check_key(node, "assoc", name.c_str());
     int assoc = node["assoc"].GetInt();
     check_key(node, "sets", name.c_str());
-    int sets = node["sets"].GetInt();
+    if (!node["sets"].IsUint64() || node["sets"].GetUint64() == 0) {
+      fprintf(stderr, "<%s> sets should be a positive integer\n", name.c_str());
+      exit(1);
+    }
+    u64 sets = node["sets"].GetUint64();
     check_key(node, "policy", name.c_str());
     string policy = node["policy"].GetString();
+    // optional
+    int mshrs = node.HasMember("mshrs") ? node["mshrs"].GetInt() : 0;
+    string organization = node.HasMember("organization") ?
+                          node["organization"].GetString() : "set";
+    int predictor_entries = node.HasMember("predictor_entries") ?
+                            node["predictor_entries"].GetInt() : 0;
+    int shct_entries = node.HasMember("shct_entries") ? node["shct_entries"].GetInt() : 0;
+    if (predictor_entries && shct_entries && predictor_entries != shct_entries) {
+      fprintf(stderr, "<%s> predictor_entries and shct_entries differ\n", name.c_str());
+      exit(1);
+    }
+    predictor_entries = predictor_entries ? predictor_entries : shct_entries;
+    string signature = node.HasMember("signature") ? node["signature"].GetString() : "fold";
+    int sampled_sets = node.HasMember("sampled_sets") ? node["sampled_sets"].GetInt() : 0;
     node_cfg = new CacheNodeCfg(CacheNode, name, latency, blocksize, assoc,
-                                sets, policy);
+                                sets, policy, mshrs, organization, predictor_entries,
+                                signature, sampled_sets);
   }
 
   else if (type == "memory") {
@@ -42,13 +42,29 @@ struct CacheNodeCfg: public BaseNodeCfg {
   int               latency;
   int               blocksize;
   int               assoc;
-  int               sets;
+  u64               sets;
   string            cr_policy;
+  // mshr entries, 0 for the default
+  int               mshrs;
+  // "set" (default) or "hashed"
+  string            organization;
+  // SHiP and Hawkeye only: predictor counters (predictor_entries, also read
+  // from the SHiP name shct_entries), 0 for the default, how a PC is hashed
+  // into a signature, "fold" (default), "multiply" or "low", and the sets
+  // training the predictor, 0 for the default
+  int               predictor_entries;
+  string            signature;
+  int               sampled_sets;
 
   CacheNodeCfg(CfgNodeType type_, string name_, int latency_, int blocksize_,
-               int assoc_, int sets_, string policy) : BaseNodeCfg(type_, name_),
+               int assoc_, u64 sets_, string policy, int mshrs_ = 0,
+               string organization_ = "set", int predictor_entries_ = 0,
+               string signature_ = "fold", int sampled_sets_ = 0) :
+               BaseNodeCfg(type_, name_),
                latency(latency_), blocksize(blocksize_), assoc(assoc_), 
-               sets(sets_), cr_policy(policy) {};
+               sets(sets_), cr_policy(policy), mshrs(mshrs_),
+               organization(organization_), predictor_entries(predictor_entries_),
+               signature(signature_), sampled_sets(sampled_sets_) {};
 };
 
 struct MemoryNodeCfg: public BaseNodeCfg {
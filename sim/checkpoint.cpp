@@ -0,0 +1,103 @@
+#include "checkpoint.h"
+
+CheckpointWriter::CheckpointWriter(const string &path) : _path(path) {
+  _file = fopen(path.c_str(), "wb");
+  if (_file == NULL) {
+    SIMLOG(SIM_ERROR, "can not create the checkpoint %s\n", path.c_str());
+    exit(1);
+  }
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  assert(_blocks.empty());
+  fclose(_file);
+}
+
+void CheckpointWriter::write_bytes(const void *p, size_t size) {
+  if (size > 0 && fwrite(p, size, 1, _file) != 1) {
+    SIMLOG(SIM_ERROR, "failed to write the checkpoint %s\n", _path.c_str());
+    exit(1);
+  }
+}
+
+void CheckpointWriter::write_string(const string &s) {
+  write<u64>(s.size());
+  write_bytes(s.data(), s.size());
+}
+
+void CheckpointWriter::begin_section(const string &name) {
+  write_string(name);
+}
+
+// the length is filled in by end_block
+void CheckpointWriter::begin_block() {
+  _blocks.push_back(ftell(_file));
+  write<u64>(0);
+}
+
+void CheckpointWriter::end_block() {
+  assert(!_blocks.empty());
+  long start = _blocks.back();
+  long end = ftell(_file);
+  _blocks.pop_back();
+  u64 length = end - start - sizeof(u64);
+  fseek(_file, start, SEEK_SET);
+  write(length);
+  fseek(_file, end, SEEK_SET);
+}
+
+CheckpointReader::CheckpointReader(const string &path) : _path(path) {
+  _file = fopen(path.c_str(), "rb");
+  if (_file == NULL) {
+    SIMLOG(SIM_ERROR, "can not open the checkpoint %s\n", path.c_str());
+    exit(1);
+  }
+}
+
+CheckpointReader::~CheckpointReader() {
+  fclose(_file);
+}
+
+void CheckpointReader::read_bytes(void *p, size_t size) {
+  if (size > 0 && fread(p, size, 1, _file) != 1) {
+    SIMLOG(SIM_ERROR, "the checkpoint %s is truncated\n", _path.c_str());
+    exit(1);
+  }
+}
+
+string CheckpointReader::read_string() {
+  u64 size = read<u64>();
+  check(size < (1ULL << 20), "string length");
+  string s(size, '\0');
+  read_bytes(&s[0], size);
+  return s;
+}
+
+void CheckpointReader::check_section(const string &name) {
+  string found = read_string();
+  if (found != name) {
+    SIMLOG(SIM_ERROR, "checkpoint %s: expect section %s, found %s\n",
+           _path.c_str(), name.c_str(), found.c_str());
+    exit(1);
+  }
+}
+
+void CheckpointReader::begin_block() {
+  read<u64>();
+}
+
+void CheckpointReader::skip_block() {
+  u64 length = read<u64>();
+  if (fseek(_file, length, SEEK_CUR) != 0) {
+    SIMLOG(SIM_ERROR, "the checkpoint %s is truncated\n", _path.c_str());
+    exit(1);
+  }
+}
+
+void CheckpointReader::check(bool cond, const char *what) {
+  if (!cond) {
+    SIMLOG(SIM_ERROR, "checkpoint %s does not match the simulation: %s\n",
+           _path.c_str(), what);
+    exit(1);
+  }
+}
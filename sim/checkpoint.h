@@ -0,0 +1,73 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "inc_all.h"
+
+#include <type_traits>
+
+using namespace std;
+
+/*
+ * 检查点文件: 仿真状态的二进制快照，由各组件的 save/restore 依次写入/读出，
+ * 文件格式与编译出的程序绑定(直接写入整数与POD结构)，不保证跨平台。
+ * 每个组件的数据以section开始，section名在读取时校验，读到不一致的内容
+ * (配置不同、文件损坏)时报错退出。
+ * block是带长度的一段数据，读取方可以整段跳过(如替换策略改变时的策略状态)
+ */
+class CheckpointWriter {
+ private:
+  FILE*             _file;
+  string            _path;
+  vector<long>      _blocks;
+
+ public:
+  CheckpointWriter(const string &path);
+  ~CheckpointWriter();
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter & operator= (const CheckpointWriter &) = delete;
+
+  void write_bytes(const void *p, size_t size);
+
+  template <typename T>
+  void write(const T &v) {
+    static_assert(is_trivially_copyable<T>::value, "only plain data can be written");
+    write_bytes(&v, sizeof(T));
+  }
+
+  void write_string(const string &s);
+  void begin_section(const string &name);
+  void begin_block();
+  void end_block();
+};
+
+class CheckpointReader {
+ private:
+  FILE*             _file;
+  string            _path;
+
+ public:
+  CheckpointReader(const string &path);
+  ~CheckpointReader();
+  CheckpointReader(const CheckpointReader &) = delete;
+  CheckpointReader & operator= (const CheckpointReader &) = delete;
+
+  void read_bytes(void *p, size_t size);
+
+  template <typename T>
+  T read() {
+    static_assert(is_trivially_copyable<T>::value, "only plain data can be read");
+    T v;
+    read_bytes(&v, sizeof(T));
+    return v;
+  }
+
+  string read_string();
+  void check_section(const string &name);
+  // the block written by begin_block/end_block
+  void skip_block();
+  void begin_block();
+  // exit if the content does not match what the simulation expects
+  void check(bool cond, const char *what);
+};
+
+#endif
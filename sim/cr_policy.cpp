@@ -1,11 +1,20 @@
 #include "memory_hierarchy.h"
 #include "cr_policy.h"
+#include "trace_loader.h"
 #include <algorithm>
+#include <emmintrin.h>
 
 #define BIP_BIMODAL_THROTTLE  1.0/16
-#define PSEL_WIDTH 10
-#define PSEL_MAX ((1<<PSEL_WIDTH)-1)
-#define PSEL_THRS PSEL_MAX/2
+#define BRRIP_BIMODAL_THROTTLE  1.0/32
+#define POLICY_RANDOM_SEED 0x5EED5EED5EED5EEDULL
+#define SHCT_MAX 7
+#define HAWKEYE_HISTORY 8
+#define HAWKEYE_RRPV_BITS 3
+#define HAWKEYE_RRPV_MAX ((1U<<HAWKEYE_RRPV_BITS)-1)
+#define HAWKEYE_RRPV_SHIFT (32-HAWKEYE_RRPV_BITS)
+#define HAWKEYE_COUNTER_MAX 7
+// the high bit of the counter predicts friendly
+#define HAWKEYE_FRIENDLY 4
 
 PolicyFactory::~PolicyFactory() {
   for (auto p: _policies) {
@@ -30,31 +39,57 @@ CRPolicyInterface* PolicyFactory::get_policy(const MemoryConfig &config) {
 CRPolicyInterface* PolicyFactory::create_policy(const MemoryConfig &config) {
   CR_POLICY policy_type = config.policy_type;
   CRPolicyInterface* ret = NULL;
-  CacheBlockFactoryInterace *factory = NULL;
   switch (policy_type) {
     case LRU_POLICY:
-      factory = new BaseBlockFactory();
-      ret = new CR_LRU_Policy(factory);
+      ret = new CR_LRU_Policy();
       break;
 
     case RANDOM_POLICY:
-      factory = new BaseBlockFactory();
-      ret = new CRRandomPolicy(factory);
+      ret = new CRRandomPolicy();
       break;
 
     case LIP_POLICY:
-      factory = new BaseBlockFactory();
-      ret = new CR_LIP_Policy(factory);
+      ret = new CR_LIP_Policy();
       break;
 
     case BIP_POLICY:
-      factory = new BaseBlockFactory();
-      ret = new CR_BIP_Policy(factory);
+      ret = new CR_BIP_Policy();
       break;
 
     case DIP_POLICY:
-      factory = new BaseBlockFactory();
-      ret = new CR_DIP_Policy(factory, config.sets);
+      ret = new CR_DIP_Policy(config.sets);
+      break;
+
+    case SRRIP_POLICY:
+      ret = new CR_SRRIP_Policy();
+      break;
+
+    case BRRIP_POLICY:
+      ret = new CR_BRRIP_Policy();
+      break;
+
+    case DRRIP_POLICY:
+      ret = new CR_DRRIP_Policy(config.sets);
+      break;
+
+    case SHIP_POLICY:
+      ret = new CR_SHiP_Policy(config);
+      break;
+
+    case OPT_POLICY:
+      ret = new CR_OPT_Policy(config);
+      break;
+
+    case HAWKEYE_POLICY:
+      ret = new CR_Hawkeye_Policy(config);
+      break;
+
+    // a thread per trace, the traces are loaded before the pipeline is built
+    case TADIP_I_POLICY:
+    case TADIP_F_POLICY:
+      ret = new CR_TADIP_Policy(config.sets,
+                                max<size_t>(1, MultiTraceLoaderObj::get_instance()->get_trace_num()),
+                                config.policy_type == TADIP_F_POLICY);
       break;
 
     default:
@@ -65,13 +100,23 @@ CRPolicyInterface* PolicyFactory::create_policy(const MemoryConfig &config) {
   return ret;
 }
 
-CacheBlockBase* BaseBlockFactory::create(u64 tag, u64 blk_size, const MemoryAccessInfo &info) {
-  CacheBlockBase *blk = new CacheBlockBase(info.addr, blk_size, tag, info.Pid);
-  return blk;
+bool PolicyFactory::is_same_block_state(CR_POLICY a, CR_POLICY b) {
+  auto stack = [](CR_POLICY p) {
+    return p == LRU_POLICY || p == LIP_POLICY || p == BIP_POLICY || p == DIP_POLICY ||
+           p == TADIP_I_POLICY || p == TADIP_F_POLICY;
+  };
+  auto rrpv = [](CR_POLICY p) {
+    return p == SRRIP_POLICY || p == BRRIP_POLICY || p == DRRIP_POLICY || p == SHIP_POLICY;
+  };
+  return a == b || (stack(a) && stack(b)) || (rrpv(a) && rrpv(b));
 }
 
-CRRandomPolicy::CRRandomPolicy(CacheBlockFactoryInterace* factory): CRPolicyInterface(factory) {
-  srand (time(NULL));
+void CRRandomPolicy::save(CheckpointWriter &w) {
+  _random.save(w);
+}
+
+void CRRandomPolicy::restore(CheckpointReader &r) {
+  _random.restore(r);
 }
 
 void CRRandomPolicy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
@@ -80,64 +125,87 @@ void CRRandomPolicy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &inf
 }
 
 void CRRandomPolicy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
-  auto blocks = line->get_all_blocks();
-  u32 victim = rand()% blocks.size(); 
-  auto new_block = _factory->create(tag, line->get_block_size(), info);
-  
-  for (u32 i = 0; i < blocks.size(); i++) {
-    if (blocks[i] == NULL) {
-      victim = i;
-      break;
-    }
+  u32 victim = _random.next() % line->get_ways();
+  s32 empty = line->find_invalid();
+  if (empty != -1) {
+    victim = empty;
   }
 
-  line->evict_by_pos(victim, new_block, true);
+  line->fill(victim, tag, info);
 }
 
-void CR_LRU_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
-  (void)info;
-  auto cand = line->get_block_by_pos(pos);
-  for (u32 i = 0; i <= pos; i++) {
-    auto to_evict = line->get_block_by_pos(i);
-    line->evict_by_pos(i, cand, false);
-    cand = to_evict;
+void CR_LRU_Policy::init_stack(CacheSet *line) {
+  for (u32 i = 0; i < line->get_ways(); i++) {
+    line->set_state(i, i);
   }
 }
 
-void CR_LRU_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+void CR_LRU_Policy::init_set(CacheSet *line) {
+  init_stack(line);
+}
+
+u32 CR_LRU_Policy::lru_way(CacheSet *line) {
+  u32 ways = line->get_ways();
+  u32 *states = line->get_states();
+  for (u32 i = 0; i < ways; i++) {
+    if (states[i] == ways - 1) {
+      return i;
+    }
+  }
+  assert(0);
+  return 0;
+}
+
+void CR_LRU_Policy::promote(CacheSet *line, u32 pos) {
   u32 ways = line->get_ways();
-  auto cand = _factory->create(tag, line->get_block_size(), info);
+  u32 *states = line->get_states();
+  u32 stack_pos = states[pos];
   for (u32 i = 0; i < ways; i++) {
-    auto to_evict = line->get_block_by_pos(i);
-    line->evict_by_pos(i, cand, false);
-    cand = to_evict;
+    states[i] += (states[i] < stack_pos);
   }
-  
-  delete cand;
+  states[pos] = 0;
+}
+
+bool CR_LRU_Policy::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  (void)line, (void)info;
+  return true;
+}
+
+void CR_LRU_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  (void)info;
+  promote(line, pos);
+}
+
+void CR_LRU_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  u32 victim = lru_way(line);
+  line->fill(victim, tag, info);
+  promote(line, victim);
+}
+
+void CR_LIP_Policy::init_set(CacheSet *line) {
+  CR_LRU_Policy::init_stack(line);
+}
+
+bool CR_LIP_Policy::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  (void)line, (void)info;
+  return false;
 }
 
 void CR_LIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
   (void)info;
-  auto cand = line->get_block_by_pos(pos);
-  for (u32 i = 0; i <= pos; i++) {
-    auto to_evict = line->get_block_by_pos(i);
-    line->evict_by_pos(i, cand, false);
-    cand = to_evict;
-  }
+  CR_LRU_Policy::promote(line, pos);
 }
 
+// the new block stays at the LRU position
 void CR_LIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info){
-  u32 ways = line->get_ways();
-  auto cand = _factory->create(tag, line->get_block_size(), info);
-  line->evict_by_pos(ways-1, cand, true);
+  line->fill(CR_LRU_Policy::lru_way(line), tag, info);
 }
 
-CR_BIP_Policy::CR_BIP_Policy(CacheBlockFactoryInterace* factory) : CRPolicyInterface(factory) {
+CR_BIP_Policy::CR_BIP_Policy() {
   _throttle = BIP_BIMODAL_THROTTLE;
-  srand(time(NULL));
 
-  _lru = new CR_LRU_Policy(factory);
-  _lip = new CR_LIP_Policy(factory);
+  _lru = new CR_LRU_Policy();
+  _lip = new CR_LIP_Policy();
 }
 
 CR_BIP_Policy::~CR_BIP_Policy() {
@@ -145,8 +213,16 @@ CR_BIP_Policy::~CR_BIP_Policy() {
   delete _lip;
 }
 
-bool CR_BIP_Policy::use_LRU() {
-  return ((rand()) / (double)RAND_MAX) < _throttle;
+void CR_BIP_Policy::save(CheckpointWriter &w) {
+  _random.save(w);
+}
+
+void CR_BIP_Policy::restore(CheckpointReader &r) {
+  _random.restore(r);
+}
+
+void CR_BIP_Policy::init_set(CacheSet *line) {
+  _lru->init_set(line);
 }
 
 void CR_BIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
@@ -158,36 +234,87 @@ void CR_BIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &i
   }
 }
 
+bool CR_BIP_Policy::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  (void)line, (void)info;
+  return use_LRU();
+}
+
 void CR_BIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
   _lru->on_hit(line, pos, info);
 }
 
-CR_DIP_Policy::CR_DIP_Policy(CacheBlockFactoryInterace* factory, u32 sets) : CRPolicyInterface(factory) {
-  // start with LRU
-  _PSEL = 0;
-  _lru = new CR_LRU_Policy(factory);
-  _bip = new CR_BIP_Policy(factory);
+PolicyRandom::PolicyRandom() : _state(POLICY_RANDOM_SEED) {
+}
+
+void PolicyRandom::save(CheckpointWriter &w) {
+  w.write(_state);
+}
+
+void PolicyRandom::restore(CheckpointReader &r) {
+  _state = r.read<u64>();
+  r.check(_state != 0, "policy random state");
+}
+
+SetDueling::SetDueling(u64 sets, u32 threads, bool feedback) : _feedback(feedback) {
+  // start with the base policy
+  _PSEL.assign(threads, 0);
 
-  if (sets < 4) {
-    SIMLOG(SIM_ERROR, "cache need to have at least 4 sets for set dueling\n");
+  if (threads == 0 || sets < 4 * threads) {
+    SIMLOG(SIM_ERROR, "cache need to have at least 4 sets per thread for set dueling\n");
     exit(1);
   }
 
   vector<u32> all_sets;
   for (u32 i = 0; i < sets; i++) {
     all_sets.push_back(i);
-    _sets_type.push_back(DIP_FOLLOWER);
+    _sets_type.push_back(FOLLOWER);
+  }
+  _sets_owner.assign(sets, 0);
+  // Fisher-Yates
+  PolicyRandom random;
+  for (u32 i = sets - 1; i > 0; i--) {
+    swap(all_sets[i], all_sets[random.next() % (i + 1)]);
   }
-  random_shuffle(all_sets.begin(), all_sets.end());
 
   for (u32 i = 0; i < sets/4; i++) {
     u32 rand_idx = all_sets[i];
-    _sets_type[rand_idx] = BIP_LEADER;
+    _sets_type[rand_idx] = BIMODAL_LEADER;
+    _sets_owner[rand_idx] = i % threads;
   }
   for (u32 i = sets/4; i < sets/2; i++) {
     u32 rand_idx = all_sets[i];
-    _sets_type[rand_idx] = LRU_LEADER;
+    _sets_type[rand_idx] = BASE_LEADER;
+    _sets_owner[rand_idx] = (i - sets/4) % threads;
+  }
+}
+
+void SetDueling::save(CheckpointWriter &w) {
+  w.write<u64>(_PSEL.size());
+  for (auto PSEL: _PSEL) {
+    w.write(PSEL);
+  }
+  w.write<u64>(_sets_type.size());
+  for (u64 i = 0; i < _sets_type.size(); i++) {
+    w.write(_sets_type[i]);
+    w.write(_sets_owner[i]);
+  }
+}
+
+void SetDueling::restore(CheckpointReader &r) {
+  r.check(r.read<u64>() == _PSEL.size(), "dueling threads");
+  for (auto &PSEL: _PSEL) {
+    PSEL = r.read<s32>();
   }
+  r.check(r.read<u64>() == _sets_type.size(), "dueling sets");
+  for (u64 i = 0; i < _sets_type.size(); i++) {
+    _sets_type[i] = r.read<DUEL_SET_TYPE>();
+    _sets_owner[i] = r.read<u8>();
+    r.check(_sets_owner[i] < _PSEL.size(), "dueling set owner");
+  }
+}
+
+CR_DIP_Policy::CR_DIP_Policy(u64 sets) : _lru(new CR_LRU_Policy()),
+    _bip(new CR_BIP_Policy()), _dueling(sets) {
 }
 
 CR_DIP_Policy::~CR_DIP_Policy() {
@@ -195,36 +322,608 @@ CR_DIP_Policy::~CR_DIP_Policy() {
   delete _bip;
 }
 
+void CR_DIP_Policy::save(CheckpointWriter &w) {
+  _dueling.save(w);
+  _bip->save(w);
+}
+
+void CR_DIP_Policy::restore(CheckpointReader &r) {
+  _dueling.restore(r);
+  _bip->restore(r);
+}
+
+void CR_DIP_Policy::init_set(CacheSet *line) {
+  _lru->init_set(line);
+}
+
 void CR_DIP_Policy::on_miss(CacheSet *line, const MemoryAccessInfo &info) {
   (void)info;
-  u32 set_no = line->get_set_num();
-  if ((_sets_type[set_no] == BIP_LEADER) && (_PSEL > 0)) {
-    _PSEL--;
-  }
-  else if ((_sets_type[set_no] == LRU_LEADER) && (_PSEL < PSEL_MAX)) {
-    _PSEL++;
-  }
+  _dueling.on_miss(line->get_set_num());
 };
 
 void CR_DIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
-  u32 set_no = line->get_set_num();
-  if (_sets_type[set_no] == BIP_LEADER) {
+  if (_dueling.use_bimodal(line->get_set_num())) {
+    _bip->on_arrive(line, tag, info);
+  }
+  else {
+    _lru->on_arrive(line, tag, info);
+  }
+}
+
+// the same choice as on_arrive
+bool CR_DIP_Policy::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  if (_dueling.use_bimodal(line->get_set_num())) {
+    return _bip->insert_at_mru(line, info);
+  }
+  return true;
+}
+
+void CR_DIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  _lru->on_hit(line, pos, info);
+}
+
+CR_TADIP_Policy::CR_TADIP_Policy(u64 sets, u32 threads, bool feedback) : _lru(new CR_LRU_Policy()),
+    _bip(new CR_BIP_Policy()), _dueling(sets, threads, feedback), _feedback(feedback) {
+}
+
+CR_TADIP_Policy::~CR_TADIP_Policy() {
+  delete _lru;
+  delete _bip;
+}
+
+void CR_TADIP_Policy::save(CheckpointWriter &w) {
+  _dueling.save(w);
+  _bip->save(w);
+}
+
+void CR_TADIP_Policy::restore(CheckpointReader &r) {
+  _dueling.restore(r);
+  _bip->restore(r);
+}
+
+void CR_TADIP_Policy::init_set(CacheSet *line) {
+  _lru->init_set(line);
+}
+
+bool CR_TADIP_Policy::use_bimodal(CacheSet *line, const MemoryAccessInfo &info) {
+  return info.Pid < get_threads() && _dueling.use_bimodal(line->get_set_num(), info.Pid);
+}
+
+void CR_TADIP_Policy::on_miss(CacheSet *line, const MemoryAccessInfo &info) {
+  if (info.Pid < get_threads()) {
+    _dueling.on_miss(line->get_set_num(), info.Pid);
+  }
+}
+
+void CR_TADIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  if (use_bimodal(line, info)) {
     _bip->on_arrive(line, tag, info);
   }
-  else if (_sets_type[set_no] == LRU_LEADER) {
+  else {
     _lru->on_arrive(line, tag, info);
   }
+}
+
+// the same choice as on_arrive
+bool CR_TADIP_Policy::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  if (use_bimodal(line, info)) {
+    return _bip->insert_at_mru(line, info);
+  }
+  return true;
+}
+
+void CR_TADIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  _lru->on_hit(line, pos, info);
+}
+
+void CR_TADIP_Policy::display(FILE *stream, const string &tag) {
+  fprintf(stream, "%s %s:", _feedback ? "TADIP-F" : "TADIP-I", tag.c_str());
+  for (u32 i = 0; i < get_threads(); i++) {
+    fprintf(stream, "%s Pid %u %s (PSEL %d)", i == 0 ? "" : ",", i,
+            follows_bimodal(i) ? "BIP" : "LRU", get_PSEL(i));
+  }
+  fprintf(stream, "\n");
+}
+
+void CR_SRRIP_Policy::init_rrpv(CacheSet *line) {
+  for (u32 i = 0; i < line->get_ways(); i++) {
+    line->set_state(i, RRPV_MAX);
+  }
+}
+
+void CR_SRRIP_Policy::init_set(CacheSet *line) {
+  init_rrpv(line);
+}
+
+// RRPVs are small, the signed compares of SSE2 work. the states of the
+// padding ways are 0 and never the only largest
+static u32 age_to_victim(u32 *states, u32 ways, u32 stride) {
+  __m128i top = _mm_setzero_si128();
+  for (u32 i = 0; i < stride; i += 4) {
+    __m128i rrpv = _mm_loadu_si128((const __m128i *)(states + i));
+    __m128i greater = _mm_cmpgt_epi32(rrpv, top);
+    top = _mm_or_si128(_mm_and_si128(greater, rrpv), _mm_andnot_si128(greater, top));
+  }
+  u32 lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, top);
+  u32 largest = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+
+  __m128i key = _mm_set1_epi32(largest);
+  u32 victim = 0;
+  for (u32 i = 0; i < stride; i += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(states + i)), key);
+    u32 mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    if (mask) {
+      victim = i + __builtin_ctz(mask);
+      break;
+    }
+  }
+  // all ways age together until the largest one is RRPV_MAX
+  u32 age = RRPV_MAX - largest;
+  for (u32 i = 0; age && i < ways; i++) {
+    states[i] += age;
+  }
+  assert(victim < ways);
+  return victim;
+}
+
+u32 CR_SRRIP_Policy::find_victim(CacheSet *line) {
+  s32 empty = line->find_invalid();
+  if (empty != -1) {
+    return empty;
+  }
+  return age_to_victim(line->get_states(), line->get_ways(), line->get_stride());
+}
+
+void CR_SRRIP_Policy::insert(CacheSet *line, u64 tag, const MemoryAccessInfo &info, u32 rrpv) {
+  u32 victim = find_victim(line);
+  line->fill(victim, tag, info);
+  line->set_state(victim, rrpv);
+}
+
+void CR_SRRIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  (void)info;
+  line->set_state(pos, 0);
+}
+
+// a new block is expected to be re-referenced after a long interval
+void CR_SRRIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  insert(line, tag, info, RRPV_MAX - 1);
+}
+
+CR_BRRIP_Policy::CR_BRRIP_Policy() {
+  _throttle = BRRIP_BIMODAL_THROTTLE;
+}
+
+void CR_BRRIP_Policy::save(CheckpointWriter &w) {
+  _random.save(w);
+}
+
+void CR_BRRIP_Policy::restore(CheckpointReader &r) {
+  _random.restore(r);
+}
+
+void CR_BRRIP_Policy::init_set(CacheSet *line) {
+  CR_SRRIP_Policy::init_rrpv(line);
+}
+
+void CR_BRRIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  (void)info;
+  line->set_state(pos, 0);
+}
+
+void CR_BRRIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  CR_SRRIP_Policy::insert(line, tag, info, insertion_rrpv());
+}
+
+CR_DRRIP_Policy::CR_DRRIP_Policy(u64 sets) : _dueling(sets) {
+}
+
+void CR_DRRIP_Policy::save(CheckpointWriter &w) {
+  _dueling.save(w);
+  _brrip.save(w);
+}
+
+void CR_DRRIP_Policy::restore(CheckpointReader &r) {
+  _dueling.restore(r);
+  _brrip.restore(r);
+}
+
+void CR_DRRIP_Policy::init_set(CacheSet *line) {
+  CR_SRRIP_Policy::init_rrpv(line);
+}
+
+void CR_DRRIP_Policy::on_miss(CacheSet *line, const MemoryAccessInfo &info) {
+  (void)info;
+  _dueling.on_miss(line->get_set_num());
+}
+
+void CR_DRRIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  (void)info;
+  line->set_state(pos, 0);
+}
+
+void CR_DRRIP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  u32 rrpv = _dueling.use_bimodal(line->get_set_num()) ? _brrip.insertion_rrpv() : RRPV_MAX - 1;
+  CR_SRRIP_Policy::insert(line, tag, info, rrpv);
+}
+
+// the bits of a signature indexing the counters of the policy
+static u32 signature_bits_of(u32 entries, const char *policy) {
+  if (entries < 2 || (entries & (entries - 1))) {
+    SIMLOG(SIM_ERROR, "%s needs a power of 2 (at least 2) counters, not %u\n", policy, entries);
+    exit(1);
+  }
+  u32 bits = 0;
+  while ((1U << bits) < entries) {
+    bits++;
+  }
+  return bits;
+}
+
+static u32 hash_signature(u64 PC, SIGNATURE_HASH hash, u32 bits) {
+  u64 mask = (1ULL << bits) - 1;
+  switch (hash) {
+    case MULTIPLY_SIGNATURE:
+      return (u32)((PC * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+    case LOW_SIGNATURE:
+      return (u32)(PC & mask);
+    default: {
+      u64 signature = 0;
+      for (; PC; PC >>= bits) {
+        signature ^= PC & mask;
+      }
+      return (u32)signature;
+    }
+  }
+}
+
+CR_SHiP_Policy::CR_SHiP_Policy(const MemoryConfig &config) : _hash(config.signature_hash),
+    _ways(config.ways) {
+  _signature_bits = signature_bits_of(config.predictor_entries, "SHiP");
+  // start weakly reused, the cold cache inserts as SRRIP
+  _shct.assign(config.predictor_entries, 1);
+
+  _sampled_sets = min<u64>(config.sets, config.sampled_sets);
+  _sample_stride = config.sets / _sampled_sets;
+  _sampled_blocks.assign(_sampled_sets * _ways, 0);
+}
+
+u32 CR_SHiP_Policy::signature_of(u64 PC) {
+  return hash_signature(PC, _hash, _signature_bits);
+}
+
+u32* CR_SHiP_Policy::sampled_block(CacheSet *line, u32 pos) {
+  u64 set_no = line->get_set_num();
+  if (set_no % _sample_stride || set_no / _sample_stride >= _sampled_sets) {
+    return NULL;
+  }
+  return &_sampled_blocks[set_no / _sample_stride * _ways + pos];
+}
+
+void CR_SHiP_Policy::save(CheckpointWriter &w) {
+  w.write<u64>(_shct.size());
+  for (auto counter: _shct) {
+    w.write(counter);
+  }
+  w.write<u64>(_sampled_blocks.size());
+  for (auto block: _sampled_blocks) {
+    w.write(block);
+  }
+}
+
+void CR_SHiP_Policy::restore(CheckpointReader &r) {
+  r.check(r.read<u64>() == _shct.size(), "SHiP counters");
+  for (auto &counter: _shct) {
+    counter = r.read<u8>();
+  }
+  r.check(r.read<u64>() == _sampled_blocks.size(), "SHiP sampled blocks");
+  for (auto &block: _sampled_blocks) {
+    block = r.read<u32>();
+  }
+}
+
+void CR_SHiP_Policy::init_set(CacheSet *line) {
+  CR_SRRIP_Policy::init_rrpv(line);
+}
+
+// the signature that inserted the block was right
+void CR_SHiP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  (void)info;
+  line->set_state(pos, 0);
+  u32 *block = sampled_block(line, pos);
+  if (block) {
+    *block |= 1;
+    u8 &counter = _shct[*block >> 1];
+    counter += counter < SHCT_MAX;
+  }
+}
+
+void CR_SHiP_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  u32 victim = CR_SRRIP_Policy::find_victim(line);
+  u32 signature = signature_of(info.PC);
+  u32 *block = sampled_block(line, victim);
+  if (block) {
+    // the evicted block was never reused
+    if (line->is_valid(victim) && !(*block & 1)) {
+      u8 &counter = _shct[*block >> 1];
+      counter -= counter > 0;
+    }
+    *block = signature << 1;
+  }
+  line->fill(victim, tag, info);
+  line->set_state(victim, _shct[signature] ? RRPV_MAX - 1 : RRPV_MAX);
+}
+
+// the traces are loaded before the pipeline is built
+CR_OPT_Policy::CR_OPT_Policy(const MemoryConfig &config) {
+  auto trace_loader = MultiTraceLoaderObj::get_instance();
+  u32 block_bits = AddressDecoder(config.blk_size, 1).get_offset_bits();
+  for (u32 i = 0; i < trace_loader->get_trace_num(); i++) {
+    _files.push_back(new NextUseFile(trace_loader->get_trace_file(i), i, block_bits));
+  }
+  _now.assign(_files.size(), 0);
+}
+
+CR_OPT_Policy::~CR_OPT_Policy() {
+  for (auto f: _files) {
+    delete f;
+  }
+}
+
+void CR_OPT_Policy::save(CheckpointWriter &w) {
+  w.write<u64>(_now.size());
+  for (auto now: _now) {
+    w.write(now);
+  }
+}
+
+void CR_OPT_Policy::restore(CheckpointReader &r) {
+  r.check(r.read<u64>() == _now.size(), "OPT traces");
+  for (auto &now: _now) {
+    now = r.read<u64>();
+  }
+}
+
+void CR_OPT_Policy::init_set(CacheSet *line) {
+  for (u32 i = 0; i < line->get_ways(); i++) {
+    line->set_state(i, NextUseFile::NEVER);
+  }
+}
+
+u32 CR_OPT_Policy::next_use(const MemoryAccessInfo &info) {
+  if (info.ref == NO_REFERENCE || info.Pid >= _files.size()) {
+    return NextUseFile::NEVER;
+  }
+  _now[info.Pid] = max(_now[info.Pid], info.ref);
+  return _files[info.Pid]->next(info.ref);
+}
+
+u32 CR_OPT_Policy::future_use(CacheSet *line, u32 pos) {
+  u32 next = line->get_state(pos);
+  u8 pid = line->get_pid(pos);
+  if (next == NextUseFile::NEVER || pid >= _files.size() || next > _now[pid]) {
+    return next;
+  }
+  while (next != NextUseFile::NEVER && next <= _now[pid]) {
+    next = _files[pid]->next(next);
+  }
+  line->set_state(pos, next);
+  return next;
+}
+
+void CR_OPT_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  line->set_state(pos, next_use(info));
+}
+
+// the first empty way, else the first way used farthest in the future
+void CR_OPT_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  u32 next = next_use(info);
+  s32 victim = line->find_invalid();
+  if (victim == -1) {
+    victim = 0;
+    u32 farthest = future_use(line, 0);
+    for (u32 i = 1; i < line->get_ways() && farthest != NextUseFile::NEVER; i++) {
+      u32 use = future_use(line, i);
+      if (use > farthest) {
+        victim = i;
+        farthest = use;
+      }
+    }
+  }
+  line->fill(victim, tag, info);
+  line->set_state(victim, next);
+}
+
+CR_Hawkeye_Policy::CR_Hawkeye_Policy(const MemoryConfig &config) : _hash(config.signature_hash),
+    _ways(config.ways), _history(HAWKEYE_HISTORY * config.ways) {
+  _signature_bits = signature_bits_of(config.predictor_entries, "Hawkeye");
+  if (_signature_bits > HAWKEYE_RRPV_SHIFT) {
+    SIMLOG(SIM_ERROR, "Hawkeye supports at most %u counters\n", 1U << HAWKEYE_RRPV_SHIFT);
+    exit(1);
+  }
+  // start weakly friendly, the cold cache inserts near MRU
+  _predictor.assign(config.predictor_entries, HAWKEYE_FRIENDLY);
+
+  _sampled_sets = min<u64>(config.sets, config.sampled_sets);
+  _sample_stride = config.sets / _sampled_sets;
+  _times.assign(_sampled_sets, 0);
+  _occupancy.assign(_sampled_sets * _history, 0);
+  SamplerEntry free_entry = {BlockArray::INVALID_TAG, 0, 0};
+  _sampler.assign(_sampled_sets * _history, free_entry);
+}
+
+u32 CR_Hawkeye_Policy::signature_of(u64 PC) {
+  return hash_signature(PC, _hash, _signature_bits);
+}
+
+u32 CR_Hawkeye_Policy::rrpv_of(u32 state) {
+  return state >> HAWKEYE_RRPV_SHIFT;
+}
+
+static inline u32 hawkeye_state(u32 rrpv, u32 signature) {
+  return (rrpv << HAWKEYE_RRPV_SHIFT) | signature;
+}
+
+s64 CR_Hawkeye_Policy::sampled_index(CacheSet *line) {
+  u64 set_no = line->get_set_num();
+  if (set_no % _sample_stride || set_no / _sample_stride >= _sampled_sets) {
+    return -1;
+  }
+  return set_no / _sample_stride;
+}
+
+void CR_Hawkeye_Policy::train(u32 signature, bool opt_hit) {
+  u8 &counter = _predictor[signature];
+  if (opt_hit) {
+    counter += counter < HAWKEYE_COUNTER_MAX;
+  }
   else {
-    // follower
-    if (_PSEL > PSEL_THRS) {
-      _bip->on_arrive(line, tag, info);
+    counter -= counter > 0;
+  }
+}
+
+bool CR_Hawkeye_Policy::is_friendly(u32 signature) {
+  return _predictor[signature] >= HAWKEYE_FRIENDLY;
+}
+
+/*
+ * 占用向量的时刻t表示OPT在t之后、下一次访问之前保留在cache中的块数。
+ * sampler的表项与最近_history次访问一一对应(每次访问只更新或加入一项)，
+ * 满时最老的表项已超出历史，替换它不会丢掉还能判断的块
+ */
+void CR_Hawkeye_Policy::on_sampled_access(u64 index, u64 tag, u32 signature) {
+  u64 now = _times[index]++;
+  u32 *occupancy = &_occupancy[index * _history];
+  SamplerEntry *entries = &_sampler[index * _history];
+  occupancy[now % _history] = 0;
+
+  SamplerEntry *entry = NULL, *oldest = &entries[0];
+  for (u32 i = 0; i < _history; i++) {
+    if (entries[i].tag == tag) {
+      entry = &entries[i];
+      break;
+    }
+    // a free entry, else the least recent one
+    if (oldest->tag != BlockArray::INVALID_TAG &&
+        (entries[i].tag == BlockArray::INVALID_TAG || entries[i].time < oldest->time)) {
+      oldest = &entries[i];
+    }
+  }
+  if (entry) {
+    bool opt_hit = now - entry->time < _history;
+    for (u64 t = entry->time; opt_hit && t < now; t++) {
+      opt_hit = occupancy[t % _history] < _ways;
     }
-    else {
-      _lru->on_arrive(line, tag, info);
+    if (opt_hit) {
+      for (u64 t = entry->time; t < now; t++) {
+        occupancy[t % _history]++;
+      }
     }
+    train(entry->signature, opt_hit);
   }
+  else {
+    entry = oldest;
+    if (entry->tag != BlockArray::INVALID_TAG) {
+      train(entry->signature, false);
+    }
+  }
+  entry->tag = tag;
+  entry->time = now;
+  entry->signature = signature;
 }
 
-void CR_DIP_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
-  _lru->on_hit(line, pos, info);
+void CR_Hawkeye_Policy::save(CheckpointWriter &w) {
+  w.write<u64>(_predictor.size());
+  for (auto counter: _predictor) {
+    w.write(counter);
+  }
+  w.write<u64>(_times.size());
+  for (auto time: _times) {
+    w.write(time);
+  }
+  for (auto occupancy: _occupancy) {
+    w.write(occupancy);
+  }
+  for (auto &entry: _sampler) {
+    w.write(entry.tag);
+    w.write(entry.time);
+    w.write(entry.signature);
+  }
+}
+
+void CR_Hawkeye_Policy::restore(CheckpointReader &r) {
+  r.check(r.read<u64>() == _predictor.size(), "Hawkeye counters");
+  for (auto &counter: _predictor) {
+    counter = r.read<u8>();
+  }
+  r.check(r.read<u64>() == _times.size(), "Hawkeye sampled sets");
+  for (auto &time: _times) {
+    time = r.read<u64>();
+  }
+  for (auto &occupancy: _occupancy) {
+    occupancy = r.read<u32>();
+  }
+  for (auto &entry: _sampler) {
+    entry.tag = r.read<u64>();
+    entry.time = r.read<u64>();
+    entry.signature = r.read<u32>();
+  }
+}
+
+void CR_Hawkeye_Policy::init_set(CacheSet *line) {
+  for (u32 i = 0; i < line->get_ways(); i++) {
+    line->set_state(i, hawkeye_state(HAWKEYE_RRPV_MAX, 0));
+  }
+}
+
+void CR_Hawkeye_Policy::on_miss(CacheSet *line, const MemoryAccessInfo &info) {
+  s64 index = sampled_index(line);
+  if (index != -1) {
+    on_sampled_access(index, line->calulate_tag(info.addr), signature_of(info.PC));
+  }
+}
+
+void CR_Hawkeye_Policy::on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) {
+  u32 signature = signature_of(info.PC);
+  s64 index = sampled_index(line);
+  if (index != -1) {
+    on_sampled_access(index, line->get_tag(pos), signature);
+  }
+  u32 rrpv = is_friendly(signature) ? 0 : HAWKEYE_RRPV_MAX;
+  line->set_state(pos, hawkeye_state(rrpv, signature));
+}
+
+// the first empty way, else the first averse way, else the oldest friendly way
+void CR_Hawkeye_Policy::on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) {
+  u32 ways = line->get_ways();
+  s32 victim = line->find_invalid();
+  if (victim == -1) {
+    victim = 0;
+    for (u32 i = 1; i < ways && rrpv_of(line->get_state(victim)) != HAWKEYE_RRPV_MAX; i++) {
+      if (rrpv_of(line->get_state(i)) > rrpv_of(line->get_state(victim))) {
+        victim = i;
+      }
+    }
+    u32 state = line->get_state(victim);
+    // the friendly prediction was wrong, the sampled sets train alone
+    if (rrpv_of(state) != HAWKEYE_RRPV_MAX && sampled_index(line) != -1) {
+      train(state & ((1U << HAWKEYE_RRPV_SHIFT) - 1), false);
+    }
+  }
+
+  u32 signature = signature_of(info.PC);
+  line->fill(victim, tag, info);
+  if (is_friendly(signature)) {
+    for (u32 i = 0; i < ways; i++) {
+      u32 rrpv = rrpv_of(line->get_state(i));
+      if (line->is_valid(i) && rrpv < HAWKEYE_RRPV_MAX - 1) {
+        line->set_state(i, line->get_state(i) + (1U << HAWKEYE_RRPV_SHIFT));
+      }
+    }
+    line->set_state(victim, hawkeye_state(0, signature));
+  }
+  else {
+    line->set_state(victim, hawkeye_state(HAWKEYE_RRPV_MAX, signature));
+  }
 }
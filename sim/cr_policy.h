@@ -2,29 +2,85 @@
 #define CR_POLICY_H
 
 #include "memory_hierarchy.h"
+#include "next_use.h"
 
-class BaseBlockFactory: public CacheBlockFactoryInterace {
- public:
-  CacheBlockBase* create(u64 tag, u64 blk_size, const MemoryAccessInfo &info);
-};
+// also used by the inline dueling and the cache kernels
+#define PSEL_WIDTH 10
+#define PSEL_MAX ((1<<PSEL_WIDTH)-1)
+#define PSEL_THRS PSEL_MAX/2
+#define RRPV_BITS 2
+#define RRPV_MAX ((1U<<RRPV_BITS)-1)
 
+/*
+ * LRU栈: 每个way的state保存它在LRU栈中的位置(0为MRU，ways-1为LRU)，
+ * 所有way(包括空way)的位置构成一个排列，初始时way i位于位置i。
+ * 命中和填充只更新位置，块不在way之间移动，与按位置排列块的实现
+ * 做出完全相同的替换决定。LIP/BIP/DIP共用这一表示
+ */
 class CR_LRU_Policy: public CRPolicyInterface {
  public:
-  CR_LRU_Policy(CacheBlockFactoryInterace* factory): CRPolicyInterface(factory) {};
+  CR_LRU_Policy() {};
+  void init_set(CacheSet *line);
+  bool is_recency_insertion() {return true;};
+  bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
   void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
   void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+
+  // way i at position i
+  static void init_stack(CacheSet *line);
+  // the way at the LRU position, it can be empty
+  static u32 lru_way(CacheSet *line);
+  // move the way to the MRU position
+  static void promote(CacheSet *line, u32 pos);
+};
+
+/*
+ * 策略自己的伪随机数(xorshift64*)。种子固定，同样的配置与trace每次得到
+ * 同样的结果，也不受其他cache、sweep或并行线程使用rand()的影响；状态随
+ * 策略的checkpoint保存，恢复后继续原来的序列
+ */
+class PolicyRandom {
+ private:
+  u64                 _state;
+
+ public:
+  PolicyRandom();
+
+  inline u64 next() {
+    _state ^= _state >> 12;
+    _state ^= _state << 25;
+    _state ^= _state >> 27;
+    return _state * 0x2545F4914F6CDD1DULL;
+  }
+
+  // in [0, 1)
+  inline double uniform() {
+    return (next() >> 11) * (1.0 / (1ULL << 53));
+  }
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 class CRRandomPolicy: public CRPolicyInterface {
+ private:
+  PolicyRandom        _random;
+
  public:
-  CRRandomPolicy(CacheBlockFactoryInterace* factory);
+  CRRandomPolicy() {};
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
   void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
   void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
 };
 
 class CR_LIP_Policy: public CRPolicyInterface {
  public:
-  CR_LIP_Policy(CacheBlockFactoryInterace* factory): CRPolicyInterface(factory) {};
+  CR_LIP_Policy() {};
+  void init_set(CacheSet *line);
+  bool is_recency_insertion() {return true;};
+  bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
   void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
   void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
 };
@@ -32,39 +88,389 @@ class CR_LIP_Policy: public CRPolicyInterface {
 class CR_BIP_Policy: public CRPolicyInterface {
  private:
   double              _throttle;
+  PolicyRandom        _random;
   CRPolicyInterface*  _lru;
   CRPolicyInterface*  _lip;
 
-  bool use_LRU();
-
  public:
-  CR_BIP_Policy(CacheBlockFactoryInterace* factory);
+  CR_BIP_Policy();
   ~CR_BIP_Policy();
+
+  // the new block enters at the MRU position once in a while
+  inline bool use_LRU() {
+    return _random.uniform() < _throttle;
+  }
+
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  bool is_recency_insertion() {return true;};
+  bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
   void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
   void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
 };
 
-enum DIP_SET_TYPE {
-  BIP_LEADER,
-  LRU_LEADER,
-  DIP_FOLLOWER,
+enum DUEL_SET_TYPE {
+  BIMODAL_LEADER,
+  BASE_LEADER,
+  FOLLOWER,
+};
+
+/*
+ * 两种插入策略的set dueling(DIP: LRU与BIP，DRRIP: SRRIP与BRRIP)。
+ * 随机选出各占1/4的leader set固定使用基础策略或bimodal策略，leader set
+ * 的缺失调整PSEL，其余follower set使用缺失较少的一方。
+ * 多个线程(TADIP，线程即Pid)时每个线程有自己的PSEL，leader set轮流分给
+ * 各线程，只有线程自己在其中的缺失调整它的PSEL。线程在其他线程的leader
+ * set中使用基础策略(TADIP-I)或者按自己的PSEL选择(TADIP-F，feedback)
+ */
+class SetDueling {
+ private:
+  // per thread, 0(base) --- PESL_THRA --- (PESL_MAX)bimodal
+  vector<s32>             _PSEL;
+  vector<DUEL_SET_TYPE>   _sets_type;
+  // the thread owning each leader set
+  vector<u8>              _sets_owner;
+  bool                    _feedback;
+
+ public:
+  SetDueling(u64 sets, u32 threads = 1, bool feedback = true);
+
+  inline DUEL_SET_TYPE get_type(u32 set_no) {
+    return _sets_type[set_no];
+  }
+
+  inline u32 get_owner(u32 set_no) {
+    return _sets_owner[set_no];
+  }
+
+  inline u32 get_threads() {
+    return _PSEL.size();
+  }
+
+  inline s32 get_PSEL(u32 thread) {
+    return _PSEL[thread];
+  }
+
+  inline void on_miss(u32 set_no, u32 thread = 0) {
+    if (_sets_type[set_no] == FOLLOWER || _sets_owner[set_no] != thread) {
+      return;
+    }
+    s32 &PSEL = _PSEL[thread];
+    if ((_sets_type[set_no] == BIMODAL_LEADER) && (PSEL > 0)) {
+      PSEL--;
+    }
+    else if ((_sets_type[set_no] == BASE_LEADER) && (PSEL < PSEL_MAX)) {
+      PSEL++;
+    }
+  }
+
+  // the follower sets insert the blocks of the thread with the bimodal policy
+  inline bool follows_bimodal(u32 thread) {
+    return _PSEL[thread] > PSEL_THRS;
+  }
+
+  // the access of the thread inserts with the bimodal policy in the set
+  inline bool use_bimodal(u32 set_no, u32 thread = 0) {
+    if (_sets_type[set_no] != FOLLOWER) {
+      if (_sets_owner[set_no] == thread) {
+        return _sets_type[set_no] == BIMODAL_LEADER;
+      }
+      if (!_feedback) {
+        return false;
+      }
+    }
+    return follows_bimodal(thread);
+  }
+
+  // the leader sets are drawn from a PolicyRandom, keep them with PSEL
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 class CR_DIP_Policy: public CRPolicyInterface {
  private:
-  // 0(LRU) --- PESL_THRA --- (PESL_MAX)BIP
-  s32                     _PSEL;
   CRPolicyInterface*      _lru;
-  CRPolicyInterface*      _bip;
-  vector<DIP_SET_TYPE>    _sets_type;
+  CR_BIP_Policy*          _bip;
+  SetDueling              _dueling;
 
  public:
-  CR_DIP_Policy(CacheBlockFactoryInterace* factory, u32 sets);
+  CR_DIP_Policy(u64 sets);
   ~CR_DIP_Policy();
+
+  inline SetDueling& get_dueling() {
+    return _dueling;
+  }
+
+  inline CR_BIP_Policy* get_bip() {
+    return _bip;
+  }
+
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  bool is_recency_insertion() {return true;};
+  bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
+  void on_miss(CacheSet *line, const MemoryAccessInfo &info);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+};
+
+/*
+ * TADIP: 共享cache上的线程感知DIP，每个线程(Pid)独立地在LRU与BIP插入
+ * 之间选择，互相干扰(streaming)的程序以BIP插入，不再冲掉其他程序的
+ * 工作集。线程数为加载的trace数，Pid不小于线程数的访问(没有PSEL)以LRU
+ * 插入也不训练。TADIP-I在其他线程的leader set中以LRU插入，TADIP-F按
+ * 线程自己的PSEL插入，见SetDueling
+ */
+class CR_TADIP_Policy: public CRPolicyInterface {
+ private:
+  CRPolicyInterface*      _lru;
+  CRPolicyInterface*      _bip;
+  SetDueling              _dueling;
+  bool                    _feedback;
+
+  bool use_bimodal(CacheSet *line, const MemoryAccessInfo &info);
+
+ public:
+  CR_TADIP_Policy(u64 sets, u32 threads, bool feedback);
+  ~CR_TADIP_Policy();
   bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  bool is_recency_insertion() {return true;};
+  bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
   void on_miss(CacheSet *line, const MemoryAccessInfo &info);
   void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
   void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+  void display(FILE *stream, const string &tag);
+
+  inline u32 get_threads() {
+    return _dueling.get_threads();
+  }
+
+  // the follower sets insert the blocks of the Pid with BIP
+  inline bool follows_bimodal(u32 Pid) {
+    return Pid < get_threads() && _dueling.follows_bimodal(Pid);
+  }
+
+  inline s32 get_PSEL(u32 Pid) {
+    return _dueling.get_PSEL(Pid);
+  }
+};
+
+/*
+ * RRIP: 每个way的state保存RRPV_BITS位的重引用预测值(RRPV)，0表示即将
+ * 被再次访问，RRPV_MAX表示很久以后才会被访问。命中把RRPV清零，替换时
+ * 优先选空way，否则选RRPV最大的第一个way，并把所有way的RRPV一起增加到
+ * 使它等于RRPV_MAX(与逐次加一直到出现RRPV_MAX的way的结果相同)。
+ * 只更新计数，不移动块也不维护栈，高相联度时比LRU便宜。
+ * SRRIP以RRPV_MAX-1插入，BRRIP大多以RRPV_MAX插入，DRRIP用set dueling
+ * 在两者之间选择
+ */
+class CR_SRRIP_Policy: public CRPolicyInterface {
+ public:
+  CR_SRRIP_Policy() {};
+  void init_set(CacheSet *line);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+
+  // every way distant
+  static void init_rrpv(CacheSet *line);
+  // the first empty way, else the first way at the largest RRPV after aging
+  // the set until it is RRPV_MAX
+  static u32 find_victim(CacheSet *line);
+  // fill the victim of the set with the RRPV
+  static void insert(CacheSet *line, u64 tag, const MemoryAccessInfo &info, u32 rrpv);
+};
+
+class CR_BRRIP_Policy: public CRPolicyInterface {
+ private:
+  double              _throttle;
+  PolicyRandom        _random;
+
+ public:
+  CR_BRRIP_Policy();
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  // the RRPV of a new block, RRPV_MAX - 1 once in a while
+  inline u32 insertion_rrpv() {
+    return _random.uniform() < _throttle ? RRPV_MAX - 1 : RRPV_MAX;
+  }
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+};
+
+class CR_DRRIP_Policy: public CRPolicyInterface {
+ private:
+  CR_BRRIP_Policy         _brrip;
+  SetDueling              _dueling;
+
+ public:
+  CR_DRRIP_Policy(u64 sets);
+
+  inline SetDueling& get_dueling() {
+    return _dueling;
+  }
+
+  inline CR_BRRIP_Policy* get_brrip() {
+    return &_brrip;
+  }
+
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  void on_miss(CacheSet *line, const MemoryAccessInfo &info);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+};
+
+/*
+ * SHiP: 访问的PC哈希成签名(signature)，签名历史计数表(SHCT)记录这个签名
+ * 插入的块后来是否被再次访问。在SRRIP之上只改变插入的RRPV: 计数为0的
+ * 签名预测不会被再次访问，以RRPV_MAX插入，其余以RRPV_MAX-1插入。
+ * 只有均匀抽样的sampled_sets个set训练SHCT，这些set的块另外记下
+ * 插入时的签名和是否命中过: 命中时计数加一，没有命中过的块被替换时
+ * 计数减一。填充时的PC是该块primary miss的PC(见MSHRTable)
+ */
+class CR_SHiP_Policy: public CRPolicyInterface {
+ private:
+  SIGNATURE_HASH      _hash;
+  u32                 _signature_bits;
+  u32                 _ways;
+  // every _sample_stride-th set trains the table, _sampled_sets of them
+  u64                 _sample_stride;
+  u64                 _sampled_sets;
+  // saturating counters indexed by signature
+  vector<u8>          _shct;
+  // signature << 1 | reused, of the blocks of the sampled sets
+  vector<u32>         _sampled_blocks;
+
+  // the training state of the way if the set is sampled, else NULL
+  u32* sampled_block(CacheSet *line, u32 pos);
+
+ public:
+  CR_SHiP_Policy(const MemoryConfig &config);
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+
+  u32 signature_of(u64 PC);
+
+  inline u32 get_counter(u32 signature) {
+    return _shct[signature];
+  }
+};
+
+/*
+ * OPT(Belady): 替换下一次使用最远的块。块的state保存它下一次被引用的
+ * 编号(访问的ref，见count_references)，由各trace的下次使用文件
+ * (NextUseFile，按本cache的块大小预处理)在命中和填充时查出。
+ * 下层cache只看到被上层过滤后的访问，state记下的下一次引用可能命中在
+ * 上层而不到达这里，替换时已经过去(不大于该trace在这里见过的最大编号)
+ * 的state沿文件追到下一个未来的引用再比较。
+ * 多个核共享的cache比较的是不同trace各自的编号，只是近似的先后。
+ * 不知道编号的访问(NO_REFERENCE)当作不再使用
+ */
+class CR_OPT_Policy: public CRPolicyInterface {
+ private:
+  // indexed by Pid, the trace of the same id
+  vector<NextUseFile*>    _files;
+  // the latest reference of each trace seen by the cache
+  vector<u64>             _now;
+
+  // the next reference to the block of the access
+  u32 next_use(const MemoryAccessInfo &info);
+  // the next use of the way, past the references already seen
+  u32 future_use(CacheSet *line, u32 pos);
+
+ public:
+  CR_OPT_Policy(const MemoryConfig &config);
+  ~CR_OPT_Policy();
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+};
+
+/*
+ * Hawkeye: 在抽样的set上用OPTgen重建OPT对过去访问的决定，训练以PC签名
+ * 索引的预测器，预测一个PC访问的块在OPT下会命中(cache-friendly)还是
+ * 不命中(cache-averse)。
+ * OPTgen: 抽样set记录最近HAWKEYE_HISTORY*ways次访问时刻的占用向量，
+ * sampler记下每个块最近一次访问的时刻与签名。块再次被访问时，若从上次
+ * 访问到现在每个时刻的占用都小于ways，OPT能一直保留它，区间的占用加一
+ * 并正向训练上次访问的签名，否则反向训练；超出历史被挤出sampler的块
+ * 同样反向训练。抽样的set越多，预测器越准，仿真开销越大(sampled_sets)。
+ * 替换是RRIP式的HAWKEYE_RRPV_BITS位RRPV: averse的块以最大RRPV插入，
+ * friendly的块以0插入，并使其他friendly块老化一步；优先替换averse块，
+ * 没有时替换最老的friendly块，抽样set中还反向训练它的签名。
+ * 块的state高位是RRPV，低位是最近一次访问的签名
+ */
+class CR_Hawkeye_Policy: public CRPolicyInterface {
+ private:
+  struct SamplerEntry {
+    // BlockArray::INVALID_TAG for a free entry
+    u64       tag;
+    u64       time;
+    u32       signature;
+  };
+
+  SIGNATURE_HASH          _hash;
+  u32                     _signature_bits;
+  u32                     _ways;
+  // accesses covered by the occupancy vector of a sampled set
+  u32                     _history;
+  // every _sample_stride-th set trains the predictor, _sampled_sets of them
+  u64                     _sample_stride;
+  u64                     _sampled_sets;
+  // saturating counters indexed by signature
+  vector<u8>              _predictor;
+  // per sampled set: accesses so far, the occupancy of the last _history
+  // times (time t in slot t % _history) and _history sampler entries
+  vector<u64>             _times;
+  vector<u32>             _occupancy;
+  vector<SamplerEntry>    _sampler;
+
+  // the sampled set of the line, -1 if it is not sampled
+  s64 sampled_index(CacheSet *line);
+  // OPTgen on an access to the sampled set
+  void on_sampled_access(u64 index, u64 tag, u32 signature);
+  void train(u32 signature, bool opt_hit);
+  // the new block (or hit) of the signature enters at RRPV 0
+  bool is_friendly(u32 signature);
+
+ public:
+  CR_Hawkeye_Policy(const MemoryConfig &config);
+  bool is_shared() {return false;};
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void init_set(CacheSet *line);
+  void on_miss(CacheSet *line, const MemoryAccessInfo &info);
+  void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info);
+  void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info);
+
+  u32 signature_of(u64 PC);
+  static u32 rrpv_of(u32 state);
+
+  inline u32 get_counter(u32 signature) {
+    return _predictor[signature];
+  }
+
+  inline u64 get_sampled_sets() {
+    return _sampled_sets;
+  }
 };
 
 #endif
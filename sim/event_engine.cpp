@@ -1,5 +1,8 @@
 #include "event_engine.h"
 
+#include <algorithm>
+#include <atomic>
+
 static const u8 TICK_FACTOR = 10;
 static const u8 TYPE_FACTOR = 6;
 
@@ -13,9 +16,25 @@ static string type_name[TypeCount] = {
   "InstIssue",
   "InstDispatch",
   "InstFetch",
-  "PidCensus",
 };
 
+u32 next_pool_id() {
+  static atomic<u32> counter(0);
+  return counter++;
+}
+
+void PoolBase::accumulate(PoolBase *other) {
+  _allocs += other->_allocs;
+  _slabs += other->_slabs;
+  _in_use += other->_in_use;
+  _peak += other->_peak;
+}
+
+void PoolBase::display(FILE *stream) {
+  fprintf(stream, "\t%s: allocs %llu, slabs %llu (%llu objects), in use %llu, peak %llu\n",
+          _name.c_str(), _allocs, _slabs, _slabs * SLAB_OBJECTS, _in_use, _peak);
+}
+
 string event_type_to_string(EventType type) {
   return type_name[type];
 }
@@ -25,21 +44,326 @@ void EventHandler::proc_event(u64 tick, Event *e) {
   proc(tick, e->callbackdata, e->type);
 }
 
-void Event::execute(u64 tick) {
-  handler->proc_event(tick, this);
+EventProcFn EventDispatcher::_table[MAX_HANDLER_KINDS][TypeCount] = {};
+
+u32 EventDispatcher::new_kind() {
+  static atomic<u32> counter(1);
+  u32 kind = counter++;
+  assert(kind < MAX_HANDLER_KINDS);
+  return kind;
 }
 
-void EventEngine::register_after_now(Event* e, u32 ticks, u32 priority) {
-  assert(priority < (1 << TYPE_FACTOR));
+static_assert(PRIORITY_LIMIT == 1 << TYPE_FACTOR, "priority bits of the PV");
+
+static inline s64 calc_pv(s64 tick, EventType type, u32 priority) {
+  assert(priority < PRIORITY_LIMIT);
 
-  s64 pv = ((_tick + ticks) << TICK_FACTOR);
+  s64 pv = (tick << TICK_FACTOR);
   pv += 1 << TICK_FACTOR;
-  pv -= e->type << TYPE_FACTOR;
+  pv -= type << TYPE_FACTOR;
   pv -= priority;
-  _queue.insert({pv, e});
+  return pv;
+}
+
+/*
+ * binary min heap on (pv, seq), written out rather than using std::push_heap
+ * so that the comparisons stay inline in the hot path
+ */
+static inline bool entry_later(const EventEntry &a, const EventEntry &b) {
+  return (a.pv > b.pv) || (a.pv == b.pv && a.seq > b.seq);
+}
+
+static void heap_push(vector<EventEntry> &heap, const EventEntry &entry) {
+  heap.push_back(entry);
+  EventEntry *h = heap.data();
+  size_t i = heap.size() - 1;
+  while (i > 0) {
+    size_t parent = (i - 1) >> 1;
+    if (!entry_later(h[parent], entry)) {
+      break;
+    }
+    h[i] = h[parent];
+    i = parent;
+  }
+  h[i] = entry;
+}
+
+static EventEntry heap_pop(vector<EventEntry> &heap) {
+  EventEntry *h = heap.data();
+  EventEntry top = h[0];
+  EventEntry last = h[heap.size() - 1];
+  size_t n = heap.size() - 1;
+  size_t i = 0;
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && entry_later(h[child], h[child + 1])) {
+      child++;
+    }
+    if (!entry_later(last, h[child])) {
+      break;
+    }
+    h[i] = h[child];
+    i = child;
+  }
+  h[i] = last;
+  heap.pop_back();
+  return top;
+}
+
+EventEngine::EventEngine() : _tick(0), _base(0), _seq(0), _size(0),
+    _hooked_tick(-1), _lp(false), _provisional(false), _cur_pv(LLONG_MIN),
+    _cur_index(0), _child(0), _executed(0) {
+  memset(_occupied, 0, sizeof(_occupied));
+}
+
+EventEngine::~EventEngine() {
+  for (u32 i = 0; i < WHEEL_SIZE; i++) {
+    for (auto &entry: _wheel[i]) {
+      delete entry.e;
+    }
+  }
+  for (auto &entry: _overflow) {
+    delete entry.e;
+  }
+  for (auto pool: _pools) {
+    delete pool;
+  }
+}
+
+void EventEngine::display_pools(FILE *stream) {
+  fprintf(stream, "event pools:\n");
+  for (auto pool: _pools) {
+    if (pool) {
+      pool->display(stream);
+    }
+  }
+}
+
+void EventEngine::insert(const EventEntry &entry) {
+  s64 t = entry.pv >> TICK_FACTOR;
+  assert(t >= _base);
+
+  if (t - _base < WHEEL_SIZE) {
+    u32 slot = t & WHEEL_MASK;
+    heap_push(_wheel[slot], entry);
+    _occupied[slot >> 6] |= (1ULL << (slot & 63));
+  }
+  else {
+    heap_push(_overflow, entry);
+  }
+}
+
+// keep the invariant: all events in overflow heap are beyond the wheel window
+void EventEngine::migrate_overflow() {
+  while (!_overflow.empty()) {
+    s64 t = _overflow.front().pv >> TICK_FACTOR;
+    if (t - _base >= WHEEL_SIZE) {
+      break;
+    }
+    insert(heap_pop(_overflow));
+  }
+}
+
+s64 EventEngine::peek_tick() {
+  if (_size == 0) {
+    return LLONG_MAX;
+  }
+
+  u32 start = _base & WHEEL_MASK;
+  u32 idx = start >> 6;
+  u64 word = _occupied[idx] & (~0ULL << (start & 63));
+  for (u32 n = 0; n <= BITMAP_WORDS; n++) {
+    if (word) {
+      u32 slot = (idx << 6) | __builtin_ctzll(word);
+      return _base + ((slot - start) & WHEEL_MASK);
+    }
+    idx = (idx + 1) % BITMAP_WORDS;
+    word = _occupied[idx];
+  }
+  return _overflow.front().pv >> TICK_FACTOR;
+}
+
+// find the earliest non-empty slot, turn the wheel to it
+s64 EventEngine::next_tick() {
+  assert(_size > 0);
+
+  while (true) {
+    u32 start = _base & WHEEL_MASK;
+    u32 idx = start >> 6;
+    u64 word = _occupied[idx] & (~0ULL << (start & 63));
+    for (u32 n = 0; n <= BITMAP_WORDS; n++) {
+      if (word) {
+        u32 slot = (idx << 6) | __builtin_ctzll(word);
+        s64 offset = (slot - start) & WHEEL_MASK;
+        if (offset > 0) {
+          _base += offset;
+          migrate_overflow();
+        }
+        return _base;
+      }
+      idx = (idx + 1) % BITMAP_WORDS;
+      word = _occupied[idx];
+    }
+
+    // wheel is empty, jump to the first overflow event
+    assert(!_overflow.empty());
+    _base = _overflow.front().pv >> TICK_FACTOR;
+    migrate_overflow();
+  }
+}
+
+void EventEngine::register_after_now(Event* e, u32 ticks, u32 priority) {
+  s64 pv = calc_pv(_tick + ticks, e->type, priority);
+  if (_lp) {
+    register_lp(e, pv);
+    return;
+  }
+  insert(EventEntry(pv, _seq++, e));
+  _size++;
+}
+
+// events can only be registered by a running event in a logical process
+void EventEngine::register_lp(Event* e, s64 pv) {
+  assert(_cur_pv != LLONG_MIN);
+  u64 seq = LPStamp::make(pv - _cur_pv, _provisional, _cur_index, _child++);
+  EventEngine *owner = e->handler->get_engine();
+  if (owner == NULL || owner == this) {
+    insert(EventEntry(pv, seq, e));
+    _size++;
+  }
+  else {
+    _outbox.push_back(make_pair(owner, EventEntry(pv, seq, e)));
+  }
+}
+
+void EventEngine::save(CheckpointWriter &w, const EventSaver &save_event) {
+  assert(!_lp);
+  vector<EventEntry> entries(_overflow);
+  for (u32 i = 0; i < WHEEL_SIZE; i++) {
+    entries.insert(entries.end(), _wheel[i].begin(), _wheel[i].end());
+  }
+  sort(entries.begin(), entries.end(),
+       [](const EventEntry &a, const EventEntry &b) { return entry_later(b, a); });
+
+  w.begin_section("event engine");
+  w.write(_tick);
+  w.write(_hooked_tick);
+  w.write<u64>(entries.size());
+  for (auto &entry: entries) {
+    w.write(entry.pv);
+    save_event(w, entry.e);
+  }
+}
+
+void EventEngine::restore(CheckpointReader &r, const EventLoader &load_event) {
+  assert(!_lp && _size == 0);
+  r.check_section("event engine");
+  _tick = r.read<s64>();
+  _base = _tick;
+  _hooked_tick = r.read<s64>();
+  u64 n = r.read<u64>();
+  for (u64 i = 0; i < n; i++) {
+    s64 pv = r.read<s64>();
+    r.check((pv >> TICK_FACTOR) > _tick, "event before the checkpoint tick");
+    insert(EventEntry(pv, _seq++, load_event(r)));
+    _size++;
+  }
+}
+
+void EventEngine::add_tick_hook(const TickHook &hook) {
+  _tick_hooks.push_back(hook);
+}
+
+void EventEngine::fire_tick_hooks(s64 tick) {
+  if (tick > _hooked_tick) {
+    _hooked_tick = tick;
+    for (auto &hook: _tick_hooks) {
+      hook(tick);
+    }
+  }
+}
+
+void EventEngine::enter_tick(s64 tick) {
+  _tick = tick;
+  fire_tick_hooks(tick);
 }
 
 s32 EventEngine::loop() {
+  if (_size == 0) {
+    return 0;
+  }
+
+  s64 t = next_tick();
+  enter_tick(t);
+
+  u32 slot = t & WHEEL_MASK;
+  auto &bucket = _wheel[slot];
+  auto entry = heap_pop(bucket);
+  if (bucket.empty()) {
+    _occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+  }
+  _size--;
+
+  if (_lp) {
+    begin_lp_event(entry);
+  }
+  auto e = entry.e;
+  e->execute(_tick);
+  delete e;
+  return 1;
+}
+
+s32 EventEngine::drain_tick() {
+  if (_size == 0) {
+    return 0;
+  }
+
+  s64 t = next_tick();
+  enter_tick(t);
+
+  // a slot only holds events of one tick, events registered to the
+  // current tick during processing go to the same slot
+  u32 slot = t & WHEEL_MASK;
+  auto &bucket = _wheel[slot];
+  s32 cnt = 0;
+  while (!bucket.empty()) {
+    auto entry = heap_pop(bucket);
+    _size--;
+    if (_lp) {
+      begin_lp_event(entry);
+    }
+    auto e = entry.e;
+    e->execute(_tick);
+    delete e;
+    cnt++;
+  }
+  _occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+  return cnt;
+}
+
+s32 EventEngine::run_until(s64 end) {
+  s32 cnt = 0;
+  while (peek_tick() < end) {
+    cnt += drain_tick();
+  }
+  return cnt;
+}
+
+MultimapEventEngine::~MultimapEventEngine() {
+  for (auto &entry: _queue) {
+    delete entry.second;
+  }
+}
+
+void MultimapEventEngine::register_after_now(Event* e, u32 ticks, u32 priority) {
+  s64 pv = calc_pv(_tick + ticks, e->type, priority);
+  _queue.insert({pv, e});
+}
+
+s32 MultimapEventEngine::loop() {
   if (_queue.size() == 0) {
     return 0;
   }
@@ -2,12 +2,16 @@
 #define EVENT_H
 
 #include "inc_all.h"
+#include "checkpoint.h"
 
+#include <cstddef>
 #include <map>
+#include <type_traits>
 
 using namespace std;
 
 struct Event;
+class EventHandler;
 class EventEngine;
 
 /*
@@ -41,36 +45,91 @@ enum EventType {
   InstDispatch,
   InstFetch,
 
-  // Census
-  PidCensus,
-
   // always keep this type count as the last one
   TypeCount
 };
 
 string event_type_to_string(EventType type);
 
+// priorities given to register_after_now are below this bound
+static const u32 PRIORITY_LIMIT = 64;
+
 // base class for callbackdata
 struct EventDataBase {
   virtual ~EventDataBase() {};
 };
 
+/*
+ * 静态分派表: 注册过的handler类型拥有一个kind，表中保存(kind, EventType)
+ * 到处理函数的映射，处理函数在编译期绑定到具体类的非虚成员函数，省去
+ * proc_event -> validate -> proc 的虚函数调用以及proc中的switch，validate
+ * 的检查也转移到了注册阶段(未绑定的类型为空)。
+ * 未注册的handler(kind 0)以及未绑定的事件类型仍然走虚函数proc_event
+ */
+typedef void (*EventProcFn)(EventHandler *handler, u64 tick, EventDataBase *data);
+
+class EventDispatcher {
+ private:
+  static const u32 MAX_HANDLER_KINDS = 32;
+  static EventProcFn    _table[MAX_HANDLER_KINDS][TypeCount];
+
+  template <typename T, void (T::*Method)(u64, EventDataBase*)>
+  static void trampoline(EventHandler *handler, u64 tick, EventDataBase *data) {
+    (static_cast<T *>(handler)->*Method)(tick, data);
+  }
+
+ public:
+  // kind 0 is reserved for handlers that only provide the virtual proc
+  static u32 new_kind();
+
+  template <typename T, void (T::*Method)(u64, EventDataBase*)>
+  static void bind(u32 kind, EventType type) {
+    assert(kind > 0 && kind < MAX_HANDLER_KINDS);
+    _table[kind][type] = &trampoline<T, Method>;
+  }
+
+  static inline EventProcFn lookup(u32 kind, EventType type) {
+    return _table[kind][type];
+  }
+};
+
 class EventHandler {
  private:
-  string    _tag;
+  string        _tag;
+  u32           _kind;
+  // engine of the logical process the handler belongs to, only set in the
+  // parallel simulation
+  EventEngine*  _engine;
 
  protected:
   virtual void proc(u64 tick, EventDataBase* data, EventType type) = 0;
   // validate if this hander can handle the comming event
   virtual bool validate(EventType type) = 0;
 
+  // handlers registered in EventDispatcher set their kind in constructor
+  inline void set_kind(u32 kind) {
+    _kind = kind;
+  }
+
  public:
-  EventHandler(const string &tag) : _tag(tag) {};
+  EventHandler(const string &tag) : _tag(tag), _kind(0), _engine(NULL) {};
   virtual ~EventHandler() {};
   void proc_event(u64 tick, Event *e);
   inline string get_tag() {
     return _tag;
   }
+
+  inline u32 get_kind() {
+    return _kind;
+  }
+
+  inline EventEngine* get_engine() {
+    return _engine;
+  }
+
+  inline void set_engine(EventEngine *engine) {
+    _engine = engine;
+  }
 };
 
 struct Event {
@@ -85,25 +144,390 @@ struct Event {
     delete callbackdata;
   }
 
-  void execute(u64 tick);
+  inline void execute(u64 tick) {
+    EventProcFn fn = EventDispatcher::lookup(handler->get_kind(), type);
+    if (fn) {
+      fn(handler, tick, callbackdata);
+    }
+    else {
+      handler->proc_event(tick, this);
+    }
+  }
+
+  static void* operator new(size_t size);
+  static void operator delete(void *p);
+};
+
+/*
+ * 对象池，每次从系统申请一个slab(SLAB_OBJECTS个对象)，释放的对象挂在
+ * free list上重复利用，因此稳态下不再调用malloc/free
+ * 每个对象前保存所属的池，并行仿真中由其他线程(逻辑进程)释放的对象先挂在
+ * 释放者的remote list上，在同步点由reclaim_remote归还给所属的池
+ */
+class PoolBase {
+ protected:
+  static const u32 SLAB_OBJECTS = 256;
+
+  string            _name;
+  // counters
+  u64               _allocs;
+  u64               _slabs;
+  u64               _in_use;
+  u64               _peak;
+
+ public:
+  PoolBase(const string &name) : _name(name), _allocs(0), _slabs(0),
+      _in_use(0), _peak(0) {};
+  virtual ~PoolBase() {};
+
+  // give the objects freed by this thread back to their owners, only
+  // called when no other thread is using the pools
+  virtual void reclaim_remote() {};
+
+  inline const string &get_name() {
+    return _name;
+  }
+
+  inline u64 get_allocs() {
+    return _allocs;
+  }
+
+  // times the pool called malloc
+  inline u64 get_slab_allocs() {
+    return _slabs;
+  }
+
+  inline u64 get_in_use() {
+    return _in_use;
+  }
+
+  // sum up the counters of the same pool in several engines
+  void accumulate(PoolBase *other);
+  void display(FILE *stream);
+};
+
+template <typename T>
+class ObjectPool: public PoolBase {
+ private:
+  struct Node {
+    ObjectPool*     owner;
+    union {
+      Node*         next;
+      typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+  };
+
+  Node*             _free;
+  Node*             _remote;
+  vector<Node*>     _slab_list;
+
+  void grow() {
+    Node *slab = (Node *)malloc(sizeof(Node) * SLAB_OBJECTS);
+    assert(slab);
+    for (u32 i = 0; i < SLAB_OBJECTS; i++) {
+      slab[i].owner = this;
+      slab[i].next = (i + 1 < SLAB_OBJECTS) ? &slab[i + 1] : _free;
+    }
+    _free = slab;
+    _slab_list.push_back(slab);
+    _slabs++;
+  }
+
+  inline void release(Node *node) {
+    node->next = _free;
+    _free = node;
+    _in_use--;
+  }
+
+ public:
+  ObjectPool(const string &name) : PoolBase(name), _free(NULL), _remote(NULL) {};
+  ObjectPool(const ObjectPool &) = delete;
+
+  ~ObjectPool() {
+    assert(_remote == NULL);
+    for (auto slab: _slab_list) {
+      free(slab);
+    }
+  }
+
+  inline void* allocate() {
+    if (_free == NULL) {
+      grow();
+    }
+    Node *node = _free;
+    _free = node->next;
+    _allocs++;
+    if (++_in_use > _peak) {
+      _peak = _in_use;
+    }
+    return &node->storage;
+  }
+
+  inline void deallocate(void *p) {
+    if (p == NULL) {
+      return;
+    }
+    Node *node = (Node *)((char *)p - offsetof(Node, storage));
+    if (node->owner == this) {
+      release(node);
+    }
+    else {
+      node->next = _remote;
+      _remote = node;
+    }
+  }
+
+  void reclaim_remote() {
+    while (_remote) {
+      Node *node = _remote;
+      _remote = node->next;
+      node->owner->release(node);
+    }
+  }
 };
 
+u32 next_pool_id();
+
+template <typename T>
+u32 pool_id() {
+  static const u32 id = next_pool_id();
+  return id;
+}
+
+// 在类定义中使用，使该类的new/delete从事件引擎的对象池中分配
+#define POOL_ALLOCATED(T) \
+  static void* operator new(size_t size) { \
+    assert(size == sizeof(T)); \
+    (void)size; \
+    return EventEngineObj::get_instance()->get_pool<T>(#T)->allocate(); \
+  } \
+  static void operator delete(void *p) { \
+    EventEngineObj::get_instance()->get_pool<T>(#T)->deallocate(p); \
+  }
+
+
+/*
+ * 时间轮(timing wheel)实现的事件队列
+ * 最近 WHEEL_SIZE 个cycle内的事件按cycle放入对应的槽中，每个槽是一个以
+ * (PV, 注册顺序)排序的小顶堆，槽的占用情况记录在bitmap中，以便快速跳过空槽
+ * 更远的事件(如main memory的1000 cycle延迟，census的周期事件)放入溢出堆，
+ * 当时间轮转动到其窗口内时再迁移进槽中
+ * 处理顺序与原先的multimap实现完全一致: (cycle, type, priority, FIFO)
+ */
+struct EventEntry {
+  s64       pv;
+  u64       seq;
+  Event*    e;
+
+  EventEntry(s64 pv_, u64 seq_, Event* e_) : pv(pv_), seq(seq_), e(e_) {};
+};
+
+// called at the beginning of every tick, before the first event of the tick
+typedef function<void(u64 tick)> TickHook;
+
+// the handlers and callback data of the events are known by the pipeline,
+// they are written and read by these callbacks
+typedef function<void(CheckpointWriter &w, Event *e)> EventSaver;
+typedef function<Event*(CheckpointReader &r)> EventLoader;
+
+/*
+ * 并行仿真(见parallel_engine.h)中，全局的注册顺序(seq)无法直接得到，
+ * 因此用父事件来描述一个事件的注册顺序: 先注册的事件，其父事件先被处理，
+ * 父事件相同时按父事件中注册的先后。父事件的处理顺序为(PV, 同一PV中的序号)，
+ * 编码为一个u64，比较结果与串行引擎中的seq一致:
+ * | PV差的反码(31) | provisional(1) | 父事件在同一PV中的序号(20) | 第几个子事件(12) |
+ * PV差越大父事件越早。provisional表示序号只在本逻辑进程内有效，
+ * 由同步点的合并(merge)换成全局的序号
+ */
+struct LPStamp {
+  static const u32 CHILD_BITS = 12;
+  static const u32 INDEX_BITS = 20;
+  static const u32 INDEX_SHIFT = CHILD_BITS;
+  static const u32 DISTANCE_SHIFT = CHILD_BITS + INDEX_BITS + 1;
+  static const u64 PROVISIONAL = 1ULL << (CHILD_BITS + INDEX_BITS);
+  static const s64 MAX_DISTANCE = (1LL << 31) - 1;
+  static const u64 INDEX_MASK = ((1ULL << INDEX_BITS) - 1) << INDEX_SHIFT;
+
+  static inline u64 make(s64 distance, bool provisional, u32 index, u32 child) {
+    assert(distance >= 0 && distance < MAX_DISTANCE);
+    assert(index < (1U << INDEX_BITS) && child < (1U << CHILD_BITS));
+    return ((u64)(MAX_DISTANCE - distance) << DISTANCE_SHIFT) |
+           (provisional ? PROVISIONAL : 0) | ((u64)index << INDEX_SHIFT) | child;
+  }
+
+  // events registered before the simulation starts have no parent, they
+  // keep their registration order in the index
+  static inline u64 initial(u64 seq) {
+    assert(seq < (1U << INDEX_BITS));
+    return seq << INDEX_SHIFT;
+  }
+
+  static inline bool is_provisional(u64 stamp) {
+    return stamp & PROVISIONAL;
+  }
+
+  static inline s64 distance(u64 stamp) {
+    return MAX_DISTANCE - (s64)(stamp >> DISTANCE_SHIFT);
+  }
+
+  static inline u32 index(u64 stamp) {
+    return (stamp & INDEX_MASK) >> INDEX_SHIFT;
+  }
+
+  static inline u64 resolve(u64 stamp, u32 index) {
+    assert(index < (1U << INDEX_BITS));
+    return (stamp & ~(PROVISIONAL | INDEX_MASK)) | ((u64)index << INDEX_SHIFT);
+  }
+};
 
 class EventEngine {
  private:
-  multimap<s64, Event*>     _queue;
+  static const u32 WHEEL_BITS = 8;
+  static const u32 WHEEL_SIZE = 1 << WHEEL_BITS;
+  static const u32 WHEEL_MASK = WHEEL_SIZE - 1;
+  static const u32 BITMAP_WORDS = WHEEL_SIZE / 64;
+
+  vector<EventEntry>        _wheel[WHEEL_SIZE];
+  u64                       _occupied[BITMAP_WORDS];
+  // events beyond the wheel window, min heap
+  vector<EventEntry>        _overflow;
   s64                       _tick;
+  // tick of the first slot of the wheel window
+  s64                       _base;
+  u64                       _seq;
+  u64                       _size;
+  // object pools for events and callback data, indexed by pool_id<T>()
+  vector<PoolBase*>         _pools;
+  vector<TickHook>          _tick_hooks;
+  s64                       _hooked_tick;
+
+  // logical process of the parallel simulation
+  struct ExecRecord {
+    s64     pv;
+    u64     seq;
+  };
+
+  bool                      _lp;
+  // stamps of a private logical process are provisional until merged
+  bool                      _provisional;
+  // the running event, parent of the registered events
+  s64                       _cur_pv;
+  u32                       _cur_index;
+  u32                       _child;
+  u64                       _executed;
+  // executed events since the last merge, only for provisional stamps
+  vector<ExecRecord>        _exec_log;
+  // events for handlers of other logical processes
+  vector<pair<EventEngine*, EventEntry> > _outbox;
+
+  void insert(const EventEntry &entry);
+  void migrate_overflow();
+  s64 next_tick();
+  void enter_tick(s64 tick);
+  void register_lp(Event* e, s64 pv);
+
+  inline void begin_lp_event(const EventEntry &entry) {
+    if (entry.pv != _cur_pv) {
+      _cur_pv = entry.pv;
+      _cur_index = 0;
+    }
+    else {
+      _cur_index++;
+    }
+    _child = 0;
+    _executed++;
+    if (_provisional) {
+      _exec_log.push_back({entry.pv, entry.seq});
+    }
+  }
+
+  friend class ParallelEngine;
 
  public:
-  EventEngine() : _tick(0) {};
+  EventEngine();
+  ~EventEngine();
   EventEngine(const EventEngine &) = delete;
   EventEngine & operator= (const EventEngine &) = delete;
   EventEngine(EventEngine &&) = delete;
 
+  void register_after_now(Event* e, u32 ticks, u32 priority);
+  // process one event
+  s32 loop();
+  // process all events of the next tick, including the ones registered
+  // to the same tick during processing, return the number of events
+  s32 drain_tick();
+
+  // process all events before the tick end, return the number of events
+  s32 run_until(s64 end);
+  // the earliest tick in the queue, LLONG_MAX if empty
+  s64 peek_tick();
+
+  // write the tick and the queued events in processing order, only between
+  // two ticks of the serial simulation
+  void save(CheckpointWriter &w, const EventSaver &save_event);
+  // the queue must be empty, the events are registered again in the same
+  // order
+  void restore(CheckpointReader &r, const EventLoader &load_event);
+
+  void add_tick_hook(const TickHook &hook);
+  // call the hooks if they have not seen the tick yet
+  void fire_tick_hooks(s64 tick);
+
+  inline s64 get_tick() {
+    return _tick;
+  }
+
+  inline u64 size() {
+    return _size;
+  }
+
+  template <typename T>
+  ObjectPool<T>* get_pool(const char *name) {
+    u32 id = pool_id<T>();
+    if (id >= _pools.size()) {
+      _pools.resize(id + 1, NULL);
+    }
+    if (_pools[id] == NULL) {
+      _pools[id] = new ObjectPool<T>(name);
+    }
+    return (ObjectPool<T>*)_pools[id];
+  }
+
+  void display_pools(FILE *stream);
+};
+
+/*
+ * 原先基于multimap(红黑树)的事件队列，保留用于性能对比和顺序一致性测试
+ */
+class MultimapEventEngine {
+ private:
+  multimap<s64, Event*>     _queue;
+  s64                       _tick;
+
+ public:
+  MultimapEventEngine() : _tick(0) {};
+  ~MultimapEventEngine();
+  MultimapEventEngine(const MultimapEventEngine &) = delete;
+  MultimapEventEngine & operator= (const MultimapEventEngine &) = delete;
+
   void register_after_now(Event* e, u32 ticks, u32 priority);
   s32 loop();
+
+  inline s64 get_tick() {
+    return _tick;
+  }
 };
 
 typedef Singleton <EventEngine> EventEngineObj;
 
+inline void* Event::operator new(size_t size) {
+  assert(size == sizeof(Event));
+  (void)size;
+  return EventEngineObj::get_instance()->get_pool<Event>("Event")->allocate();
+}
+
+inline void Event::operator delete(void *p) {
+  EventEngineObj::get_instance()->get_pool<Event>("Event")->deallocate(p);
+}
+
 #endif
@@ -0,0 +1,156 @@
+#include "hashed_cache.h"
+
+const u32 HashedCacheUnit::NIL;
+
+HashedCacheUnit::HashedCacheUnit(const string &tag, const MemoryConfig &config)
+    : CacheUnit(tag, config) {
+  if (_ways >= NIL) {
+    SIMLOG(SIM_ERROR, "hashed organization supports less than %u ways\n", NIL);
+    exit(1);
+  }
+  if (!_cr_policy->is_recency_insertion()) {
+    SIMLOG(SIM_ERROR, "policy of %s does not fit the hashed organization\n", tag.c_str());
+    exit(1);
+  }
+
+  _index_bits = LinearProbing::bits_for(_ways);
+  _index.assign(_sets << _index_bits, NIL);
+  _heads.assign(_sets, 0);
+  init_lists();
+}
+
+// way i at position i, as the LRU stack
+void HashedCacheUnit::init_lists() {
+  for (u64 s = 0; s < _sets; s++) {
+    u32 *links = _blocks->get_states(s);
+    for (u32 i = 0; i < _ways; i++) {
+      links[i] = link_of((i + _ways - 1) % _ways, (i + 1) % _ways);
+    }
+    _heads[s] = 0;
+  }
+}
+
+void HashedCacheUnit::build_index() {
+  _index.assign(_index.size(), NIL);
+  for (u64 s = 0; s < _sets; s++) {
+    u64 *tags = _blocks->get_tags(s);
+    for (u32 i = 0; i < _ways; i++) {
+      if (tags[i] != BlockArray::INVALID_TAG) {
+        index_insert(s, tags[i], i);
+      }
+    }
+  }
+}
+
+s32 HashedCacheUnit::find(u64 set_no, u64 tag) {
+  u32 *index = index_of(set_no);
+  s32 slot = LinearProbing::find(index, _index_bits, tag, ops_of(set_no));
+  return slot == -1 ? -1 : (s32)index[slot];
+}
+
+// the way already holds the tag
+void HashedCacheUnit::index_insert(u64 set_no, u64 tag, u32 way) {
+  u32 *index = index_of(set_no);
+  index[LinearProbing::insert_at(index, _index_bits, tag, ops_of(set_no))] = way;
+}
+
+void HashedCacheUnit::index_erase(u64 set_no, u64 tag) {
+  u32 *index = index_of(set_no);
+  SlotOps ops = ops_of(set_no);
+  s32 hole = LinearProbing::find(index, _index_bits, tag, ops);
+  assert(hole != -1);
+  LinearProbing::erase(index, _index_bits, hole, ops);
+}
+
+void HashedCacheUnit::promote(u64 set_no, u32 way) {
+  u32 head = _heads[set_no];
+  if (way == head) {
+    return;
+  }
+  u32 *links = _blocks->get_states(set_no);
+  u32 tail = prev_of(links[head]);
+  if (way != tail) {
+    // unlink, then insert between the tail and the head
+    u32 prev = prev_of(links[way]);
+    u32 next = next_of(links[way]);
+    links[prev] = link_of(prev_of(links[prev]), next);
+    links[next] = link_of(prev, next_of(links[next]));
+    links[way] = link_of(tail, head);
+    links[tail] = link_of(prev_of(links[tail]), way);
+    links[head] = link_of(way, next_of(links[head]));
+  }
+  // the tail is already between the tail and the head
+  _heads[set_no] = way;
+}
+
+bool HashedCacheUnit::try_access_memory(const MemoryAccessInfo &info) {
+  u64 set_no = get_set_no(info.addr);
+  s32 way = find(set_no, _decoder.get_tag(info.addr));
+  if (way == -1) {
+    _cr_policy->on_miss(&_cache_sets[set_no], info);
+    _stats->increment_miss(info.Pid);
+    return false;
+  }
+  // the recency policies all move a hit block to the MRU position
+  promote(set_no, way);
+  _stats->increment_hit(info.Pid);
+  return true;
+}
+
+bool HashedCacheUnit::try_fast_hit(const MemoryAccessInfo &info) {
+  if (has_pending()) {
+    return false;
+  }
+  u64 set_no = get_set_no(info.addr);
+  s32 way = find(set_no, _decoder.get_tag(info.addr));
+  if (way == -1) {
+    return false;
+  }
+  promote(set_no, way);
+  _stats->increment_hit(info.Pid);
+  return true;
+}
+
+void HashedCacheUnit::on_memory_arrive(const MemoryAccessInfo &info) {
+  u64 set_no = get_set_no(info.addr);
+  u64 tag = _decoder.get_tag(info.addr);
+  CacheSet *line = &_cache_sets[set_no];
+  // the mshr merges the misses to a block, it arrives once
+  assert(find(set_no, tag) == -1);
+
+  u32 head = _heads[set_no];
+  u32 victim = prev_of(_blocks->get_states(set_no)[head]);
+  if (line->is_valid(victim)) {
+    index_erase(set_no, line->get_tag(victim));
+  }
+  line->fill(victim, tag, info);
+  index_insert(set_no, tag, victim);
+  // the victim is the tail, the block before the head
+  if (_cr_policy->insert_at_mru(line, info)) {
+    _heads[set_no] = victim;
+  }
+}
+
+// the home slot of the tag, the recency links and the head, the tags are
+// only read at the ways the index points to
+void HashedCacheUnit::prefetch_set(u64 set_no, u64 addr) {
+  __builtin_prefetch(&index_of(set_no)[LinearProbing::home_of(_decoder.get_tag(addr), _index_bits)]);
+  __builtin_prefetch(_blocks->get_states(set_no));
+  __builtin_prefetch(&_heads[set_no]);
+}
+
+void HashedCacheUnit::save(CheckpointWriter &w) {
+  CacheUnit::save(w);
+  for (auto head: _heads) {
+    w.write(head);
+  }
+}
+
+void HashedCacheUnit::restore(CheckpointReader &r) {
+  CacheUnit::restore(r);
+  for (auto &head: _heads) {
+    head = r.read<u32>();
+    r.check(head < _ways, "recency list head");
+  }
+  build_index();
+}
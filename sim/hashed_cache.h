@@ -0,0 +1,87 @@
+#ifndef HASHED_CACHE_H
+#define HASHED_CACHE_H
+
+#include "memory_hierarchy.h"
+
+/*
+ * 高相联度/全相联cache的组织方式("organization": "hashed")。
+ * 每个set一个开放寻址的哈希索引(tag -> way，见LinearProbing)与一个
+ * 循环双向的最近使用(recency)链表，命中、填充、替换都是O(1)，不再随
+ * 相联度线性增长，适合TLB、victim cache、软件cache等上千路甚至全相联
+ * (sets为1)的结构。
+ * 链表的前后指针保存在块元数据的state列中(高16位prev，低16位next)，
+ * 与LRU栈一样所有way(包括空way)都在链表中，初始时way i在位置i，因此
+ * 与按set组织的cache做出完全相同的替换决定。块元数据仍在BlockArray中，
+ * census、检查点、打印照常进行，索引在恢复检查点后重建。
+ * 只支持按LRU顺序替换、只决定新块插入位置的策略(LRU/LIP/BIP/DIP/TADIP，
+ * 见CRPolicyInterface::is_recency_insertion)
+ */
+class HashedCacheUnit: public CacheUnit {
+ private:
+  static const u32 NIL = 0xFFFF;
+
+  // the MRU way of each set, the LRU way is the one before it
+  vector<u32>       _heads;
+  // the slots of LinearProbing hold ways, keyed by the tags of the set
+  struct SlotOps {
+    const u64 *     tags;
+
+    inline bool is_free(u32 way) const {
+      return way == NIL;
+    }
+    inline u64 key_of(u32 way) const {
+      return tags[way];
+    }
+    inline void clear(u32 &way) const {
+      way = NIL;
+    }
+  };
+
+  // per set 2^_index_bits slots holding the way of a tag, NIL if free
+  vector<u32>       _index;
+  u32               _index_bits;
+
+  inline u32* index_of(u64 set_no) {
+    return &_index[set_no << _index_bits];
+  }
+
+  inline SlotOps ops_of(u64 set_no) {
+    return SlotOps{_blocks->get_tags(set_no)};
+  }
+
+  static inline u32 prev_of(u32 link) {
+    return link >> 16;
+  }
+
+  static inline u32 next_of(u32 link) {
+    return link & 0xFFFF;
+  }
+
+  static inline u32 link_of(u32 prev, u32 next) {
+    return (prev << 16) | next;
+  }
+
+  // the way holding the tag, -1 if none
+  s32 find(u64 set_no, u64 tag);
+  void index_insert(u64 set_no, u64 tag, u32 way);
+  void index_erase(u64 set_no, u64 tag);
+  // make the way the MRU block of the set
+  void promote(u64 set_no, u32 way);
+  void init_lists();
+  void build_index();
+
+ protected:
+  bool try_access_memory(const MemoryAccessInfo &info);
+  void on_memory_arrive(const MemoryAccessInfo &info);
+  void prefetch_set(u64 set_no, u64 addr);
+
+ public:
+  HashedCacheUnit(const string &tag, const MemoryConfig &config);
+
+  bool try_fast_hit(const MemoryAccessInfo &info);
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+};
+
+#endif
@@ -1,60 +1,51 @@
 #include "cmdline/cmdline.h"
 
-#include "memory_hierarchy.h"
-#include "trace_loader.h"
-#include "cfg_loader.h"
+#include "sim_context.h"
 
 #include <iostream>
+#include <sstream>
+#include <thread>
 
-void run_simulation(string cfg, string trace_cfg, unsigned int processes, 
-                    int freq, long long signed inst) {
-  auto cfg_loader = CfgLoaderObj::get_instance();
-  auto builder = PipeLineBuilderObj::get_instance();
-  auto trace_cfg_loader = TraceCfgLoaderObj::get_instance();
-  auto trace_loader = MultiTraceLoaderObj::get_instance();
-  auto census_taker = CensusTakerObj::get_instance();
-
-  census_taker->init(freq, stdout);
-
-  // 0. set instructions
-  assert(inst >= -1);
-  assert(inst < 1000000000);
-  trace_loader->set_read_bound(inst);
-
-  // 1. load trace file 
-  trace_cfg_loader->parse(trace_cfg);
-  auto traces = trace_cfg_loader->get_traces();
-  for (auto &trace: traces) {
-    trace_loader->adding_trace(trace);
-  }
-  if (traces.size() != processes) {
-    SIMLOG(SIM_ERROR, "process number should equals to trace files\n");
-    exit(1);
+// run the same simulation with every policy on its own thread, print the
+// reports in the order of the policies
+void run_sweep(const SimulationOptions &options, const string &policies) {
+  vector<SimulationOptions> runs;
+  stringstream ss(policies);
+  string policy;
+  while (getline(ss, policy, ',')) {
+    if (policy.empty()) {
+      continue;
+    }
+    runs.push_back(options);
+    runs.back().policy = policy;
   }
- 
-  // 2. load architecture
-  cfg_loader->parse(cfg);
-  builder->load(cfg_loader->get_nodes());
 
-  auto connectors = builder->get_connectors();
-  if (connectors.size() < processes) {
-    SIMLOG(SIM_WARNING, "available cores is fewer than processes, \
-           only %d processes will be simulated\n", (int)connectors.size());
-  }
-  
-  for (unsigned int i = 0; i < processes; i++) {
-    connectors[i]->start();
+  vector<FILE *> reports;
+  vector<thread> threads;
+  for (auto &run: runs) {
+    FILE *report = tmpfile();
+    if (report == NULL) {
+      SIMLOG(SIM_ERROR, "can not create the report of policy %s\n", run.policy.c_str());
+      exit(1);
+    }
+    reports.push_back(report);
+    threads.push_back(thread([&run, report]() {
+      SimulationContext context;
+      context.run(run, report);
+    }));
   }
 
-  EventEngine *evnet_queue = EventEngineObj::get_instance();
-  while (true) {
-    auto ret = evnet_queue->loop();
-    if (ret == 0)
-      break;
+  char buf[4096];
+  for (u32 i = 0; i < runs.size(); i++) {
+    threads[i].join();
+    fprintf(stdout, "policy: %s\n", runs[i].policy.c_str());
+    rewind(reports[i]);
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), reports[i])) > 0) {
+      fwrite(buf, 1, n, stdout);
+    }
+    fclose(reports[i]);
   }
-  // print stats
-  auto stats_manager = MemoryStatsManagerObj::get_instance();
-  stats_manager->display_all(stdout);
 }
 
 int main(int argc, char *argv[])
@@ -66,17 +57,41 @@ int main(int argc, char *argv[])
   a.add<unsigned int>("process", 'p', "processes to simulate", true, 0, cmdline::range(1, 8));
   a.add<long long signed>("inst", 'n', "simulation instructions", false, -1);
   a.add("verbose", 'v', "verbose output");
+  a.add("parallel", 'P', "simulate the cores in parallel threads");
+  a.add<string>("sweep", 's', "comma separated policies, each runs concurrently in its own simulation", false, "");
+  a.add<string>("sweep-cache", 'S', "caches whose policy is swept (name contains)", false, "L2");
+  a.add<string>("checkpoint", 'w', "save a checkpoint to the file", false, "");
+  a.add<long long signed>("checkpoint-at", 'W', "save the checkpoint once a cpu has read this many instructions", false, -1);
+  a.add<string>("restore", 'r', "start from a checkpoint file", false, "");
 
   a.parse_check(argc, argv);
 
   if (a.exist("verbose"))
     set_verbose();
 
-  run_simulation(a.get<string>("cfg"), 
-                 a.get<string>("trace"),
-                 a.get<unsigned int>("process"),
-                 a.get<int>("freq"),
-                 a.get<long long signed>("inst"));
+  SimulationOptions options;
+  options.cfg = a.get<string>("cfg");
+  options.trace_cfg = a.get<string>("trace");
+  options.processes = a.get<unsigned int>("process");
+  options.freq = a.get<int>("freq");
+  options.inst = a.get<long long signed>("inst");
+  options.parallel = a.exist("parallel");
+  options.policy_cache = a.get<string>("sweep-cache");
+  options.checkpoint = a.get<string>("checkpoint");
+  options.checkpoint_at = a.get<long long signed>("checkpoint-at");
+  options.restore = a.get<string>("restore");
+
+  if (!a.get<string>("sweep").empty()) {
+    if (!options.checkpoint.empty()) {
+      SIMLOG(SIM_ERROR, "checkpoint can not be saved by a sweep\n");
+      exit(1);
+    }
+    run_sweep(options, a.get<string>("sweep"));
+  }
+  else {
+    SimulationContext context;
+    context.run(options, stdout);
+  }
 
   return 0;
 }
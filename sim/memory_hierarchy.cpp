@@ -1,4 +1,10 @@
 #include "memory_hierarchy.h"
+#include "cache_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TAG_ARRAY_SIMD
+#endif
 
 extern bool VERBOSE;
 
@@ -35,27 +41,238 @@ MemoryConfig::MemoryConfig(const CacheNodeCfg cfg, u32 priority_) {
            cfg.cr_policy == "Dip") {
     policy_type = DIP_POLICY;
   }
+  else if (cfg.cr_policy == "srrip" || 
+           cfg.cr_policy == "SRRIP" ||
+           cfg.cr_policy == "Srrip") {
+    policy_type = SRRIP_POLICY;
+  }
+  else if (cfg.cr_policy == "brrip" || 
+           cfg.cr_policy == "BRRIP" ||
+           cfg.cr_policy == "Brrip") {
+    policy_type = BRRIP_POLICY;
+  }
+  else if (cfg.cr_policy == "drrip" || 
+           cfg.cr_policy == "DRRIP" ||
+           cfg.cr_policy == "Drrip") {
+    policy_type = DRRIP_POLICY;
+  }
+  else if (cfg.cr_policy == "ship" || 
+           cfg.cr_policy == "SHIP" ||
+           cfg.cr_policy == "SHiP") {
+    policy_type = SHIP_POLICY;
+  }
+  else if (cfg.cr_policy == "opt" || 
+           cfg.cr_policy == "OPT" ||
+           cfg.cr_policy == "Opt") {
+    policy_type = OPT_POLICY;
+  }
+  else if (cfg.cr_policy == "hawkeye" || 
+           cfg.cr_policy == "HAWKEYE" ||
+           cfg.cr_policy == "Hawkeye") {
+    policy_type = HAWKEYE_POLICY;
+  }
+  else if (cfg.cr_policy == "tadip-i" || 
+           cfg.cr_policy == "TADIP-I" ||
+           cfg.cr_policy == "Tadip-I") {
+    policy_type = TADIP_I_POLICY;
+  }
+  else if (cfg.cr_policy == "tadip-f" || 
+           cfg.cr_policy == "TADIP-F" ||
+           cfg.cr_policy == "Tadip-F") {
+    policy_type = TADIP_F_POLICY;
+  }
   else {
     SIMLOG(SIM_ERROR, "unsupported policy type %s\n", cfg.cr_policy.c_str());
     exit(1);
   }
+
+  if (cfg.mshrs < 0) {
+    SIMLOG(SIM_ERROR, "mshrs of %s can not be negative\n", cfg.name.c_str());
+    exit(1);
+  }
+  mshrs = cfg.mshrs > 0 ? cfg.mshrs : DEFAULT_MSHR_ENTRIES;
+
+  if (cfg.organization == "set") {
+    organization = SET_ORGANIZATION;
+  }
+  else if (cfg.organization == "hashed") {
+    organization = HASHED_ORGANIZATION;
+  }
+  else {
+    SIMLOG(SIM_ERROR, "unsupported organization %s\n", cfg.organization.c_str());
+    exit(1);
+  }
+
+  if (cfg.predictor_entries < 0 || (cfg.predictor_entries & (cfg.predictor_entries - 1))) {
+    SIMLOG(SIM_ERROR, "predictor_entries of %s should be a power of 2\n", cfg.name.c_str());
+    exit(1);
+  }
+  predictor_entries = cfg.predictor_entries > 0 ? cfg.predictor_entries :
+                      DEFAULT_PREDICTOR_ENTRIES;
+
+  if (cfg.signature == "fold") {
+    signature_hash = FOLD_SIGNATURE;
+  }
+  else if (cfg.signature == "multiply") {
+    signature_hash = MULTIPLY_SIGNATURE;
+  }
+  else if (cfg.signature == "low") {
+    signature_hash = LOW_SIGNATURE;
+  }
+  else {
+    SIMLOG(SIM_ERROR, "unsupported signature %s\n", cfg.signature.c_str());
+    exit(1);
+  }
+
+  if (cfg.sampled_sets < 0) {
+    SIMLOG(SIM_ERROR, "sampled_sets of %s can not be negative\n", cfg.name.c_str());
+    exit(1);
+  }
+  sampled_sets = cfg.sampled_sets > 0 ? cfg.sampled_sets : DEFAULT_SAMPLED_SETS;
 }
 
 MemoryConfig::MemoryConfig(const MemoryNodeCfg cfg, u32 priority_) {
   priority = priority_;
   latency = cfg.latency;
+  mshrs = DEFAULT_MSHR_ENTRIES;
+  organization = SET_ORGANIZATION;
 }
 
 MemoryEventData::MemoryEventData(const MemoryAccessInfo &info): 
-    addr(info.addr), PC(info.PC), Pid(info.Pid) {};
+    addr(info.addr), PC(info.PC), Pid(info.Pid), ref(info.ref), requester(0), line_bits(0) {};
 
 MemoryAccessInfo::MemoryAccessInfo(const MemoryEventData &data):
-    addr(data.addr), PC(data.PC), Pid(data.Pid) {};
+    addr(data.addr), PC(data.PC), Pid(data.Pid), ref(data.ref) {};
+
+void MemoryEventData::save(CheckpointWriter &w) {
+  w.write(addr);
+  w.write(PC);
+  w.write(Pid);
+  w.write(ref);
+  w.write(requester);
+  w.write(line_bits);
+}
 
-CacheSet::CacheSet(u32 ways, u32 blk_size, u32 sets, CRPolicyInterface *policy) :_ways(ways), 
-    _blk_size(blk_size), _sets(sets), _blocks(ways, NULL), _cr_policy(policy) {
+void MemoryEventData::restore(CheckpointReader &r) {
+  addr = r.read<u64>();
+  PC = r.read<u64>();
+  Pid = r.read<u8>();
+  ref = r.read<u64>();
+  requester = r.read<u8>();
+  line_bits = r.read<u8>();
+}
+
+size_t BlockArray::region_size(u64 sets, u32 ways) {
+  u64 n = sets * stride_of(ways);
+  return column_size(n * sizeof(u64)) + column_size(n * sizeof(u8)) +
+         column_size(n * sizeof(u32));
+}
+
+BlockArray::BlockArray(u64 sets, u32 ways) : _region(region_size(sets, ways)), _sets(sets),
+    _stride(stride_of(ways)) {
+  u64 n = sets * _stride;
+  char *base = (char *)_region.get_base();
+  _tags = (u64 *)base;
+  _pids = (u8 *)(base + column_size(n * sizeof(u64)));
+  _states = (u32 *)(base + column_size(n * sizeof(u64)) + column_size(n * sizeof(u8)));
+  // INVALID_TAG is all ones, pids and states start zeroed
+  memset(_tags, 0xff, n * sizeof(u64));
+}
+
+s32 BlockArray::find_scalar(const u64 *tags, u32 stride, u64 tag) {
+  for (u32 i = 0; i < stride; i++) {
+    if (tags[i] == tag) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#ifdef TAG_ARRAY_SIMD
+__attribute__((target("avx2")))
+static s32 find_avx2(const u64 *tags, u32 stride, u64 tag) {
+  __m256i key = _mm256_set1_epi64x(tag);
+  for (u32 i = 0; i < stride; i += 4) {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)(tags + i)), key);
+    u32 mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return -1;
+}
+
+// SSE2 has no 64 bit compare, both 32 bit halves have to match
+static s32 find_sse2(const u64 *tags, u32 stride, u64 tag) {
+  __m128i key = _mm_set1_epi64x(tag);
+  for (u32 i = 0; i < stride; i += 2) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(tags + i)), key);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    u32 mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return -1;
+}
+#endif
+
+typedef s32 (*TagFindFn)(const u64 *tags, u32 stride, u64 tag);
+
+static TagFindFn select_tag_find() {
+#ifdef TAG_ARRAY_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return find_avx2;
+  }
+  return find_sse2;
+#else
+  return BlockArray::find_scalar;
+#endif
+}
+
+static TagFindFn tag_find() {
+  static const TagFindFn find_fn = select_tag_find();
+  return find_fn;
+}
+
+s32 BlockArray::find(const u64 *tags, u32 stride, u64 tag) {
+  assert(tag != INVALID_TAG);
+  return tag_find()(tags, stride, tag);
+}
+
+// the padding ways are always empty, a first empty way among them means the
+// set is full
+s32 BlockArray::find_invalid(const u64 *tags, u32 ways, u32 stride) {
+  s32 pos = tag_find()(tags, stride, INVALID_TAG);
+  return pos < (s32)ways ? pos : -1;
+}
+
+CacheSet::CacheSet(u32 ways, u32 blk_size, u64 sets, CRPolicyInterface *policy,
+                   BlockArray *blocks, u64 set_no) :
+    CacheSet(ways, AddressDecoder(blk_size, sets), policy, blocks, set_no) {
+  assert(blk_size < MAX_BLOCK_SIZE);
+}
+
+CacheSet::CacheSet(u32 ways, const AddressDecoder &decoder, CRPolicyInterface *policy,
+                   BlockArray *blocks, u64 set_no) : _ways(ways), _decoder(decoder),
+    _cr_policy(policy) {
   assert(_cr_policy);
-  assert(_blk_size < MAX_BLOCK_SIZE);
+  init_blocks(blocks, set_no);
+}
+
+void CacheSet::init_blocks(BlockArray *blocks, u64 set_no) {
+  _own_blocks = NULL;
+  if (blocks == NULL) {
+    _own_blocks = new BlockArray(1, _ways);
+    blocks = _own_blocks;
+    set_no = 0;
+  }
+  _stride = blocks->get_stride();
+  _tags = blocks->get_tags(set_no);
+  _pids = blocks->get_pids(set_no);
+  _states = blocks->get_states(set_no);
+  _cr_policy->init_set(this);
 }
 
 // default do nothing. when use set dueling, we need use the 
@@ -64,60 +281,67 @@ void CRPolicyInterface::on_miss(CacheSet *line, const MemoryAccessInfo &info) {
   (void)line, void(info);
 }
 
+void CRPolicyInterface::init_set(CacheSet *line) {
+  (void)line;
+}
+
+bool CRPolicyInterface::is_recency_insertion() {
+  return false;
+}
+
+bool CRPolicyInterface::insert_at_mru(CacheSet *line, const MemoryAccessInfo &info) {
+  (void)line, (void)info;
+  return true;
+}
+
 bool CRPolicyInterface::is_shared() {
   return true; 
 }
 
-CacheSet::CacheSet(u32 ways, u32 blk_size, u32 sets, CRPolicyInterface *policy, const string &tag): _ways(ways), 
-    _blk_size(blk_size), _sets(sets), _blocks(ways, NULL), _cr_policy(policy), _set_tag(tag) {
-  assert(_cr_policy);
-  assert(_blk_size < MAX_BLOCK_SIZE);
+void CRPolicyInterface::display(FILE *stream, const string &tag) {
+  (void)stream, (void)tag;
+}
+
+// shared policies keep all their state in the cache blocks
+void CRPolicyInterface::save(CheckpointWriter &w) {
+  (void)w;
+}
+
+void CRPolicyInterface::restore(CheckpointReader &r) {
+  (void)r;
 }
 
 CacheSet::~CacheSet() {
-  for (u32 i = 0; i < _ways; i++) {
-    if (_blocks[i] == NULL) {
-      continue;
-    }
-    else {
-      delete _blocks[i];
-    }
-  }
+  delete _own_blocks;
 }
   
 void CacheSet::set_set_num(u32 set_num) {
   _set_num = set_num;
 }
 
-u64 CacheSet::calulate_tag(u64 addr) {
-  u32 s = len_of_binary(_sets);
-  u32 b = len_of_binary(_blk_size);
-  return addr >> (s+b);
+s32 CacheSet::find_pos_by_tag(u64 tag) {
+  return BlockArray::find(_tags, _stride, tag);
 }
 
-s32 CacheSet::find_pos_by_tag(u64 tag) {
-  for (u32 i = 0; i < _ways; i++) {
-    if (_blocks[i] == NULL) {
-      continue;
-    }
-    else if (_blocks[i]->get_tag() == tag) {
-      return i;
-    }
-  }
-  return -1;
+u64 CacheSet::get_addr(u32 pos) {
+  return _decoder.get_block_addr(get_tag(pos), _set_num);
+}
+
+s32 CacheSet::find_invalid() {
+  return BlockArray::find_invalid(_tags, _ways, _stride);
 }
 
-void CacheSet::evict_by_pos(u32 pos, CacheBlockBase *blk, bool is_delete) {
+void CacheSet::fill(u32 pos, u64 tag, const MemoryAccessInfo &info) {
   assert(pos < _ways);
-  if (is_delete && _blocks[pos]) {
-    delete _blocks[pos];
-  }
-  _blocks[pos] = blk;
+  assert(tag != BlockArray::INVALID_TAG);
+  _tags[pos] = tag;
+  _pids[pos] = info.Pid;
 }
 
-CacheBlockBase* CacheSet::get_block_by_pos(u32 pos) {
+void CacheSet::invalidate(u32 pos) {
   assert(pos < _ways);
-  return _blocks[pos];
+  _tags[pos] = BlockArray::INVALID_TAG;
+  _pids[pos] = 0;
 }
 
 bool CacheSet::try_access_memory(const MemoryAccessInfo &info) {
@@ -138,95 +362,320 @@ bool CacheSet::try_access_memory(const MemoryAccessInfo &info) {
 
 void CacheSet::on_memory_arrive(const MemoryAccessInfo &info) {
   u64 tag = calulate_tag(info.addr);
+  // the mshr merges the misses to a block, it arrives once
+  assert(find_pos_by_tag(tag) == -1);
   //printf("on arrive\n");
   //print_blocks(stdout);
   _cr_policy->on_arrive(this, tag, info);
   //print_blocks(stdout);
 }
 
+bool CacheSet::contains(u64 addr) {
+  return find_pos_by_tag(calulate_tag(addr)) != -1;
+}
+
 void CacheSet::print_blocks(FILE* fs) {
-  fprintf(fs, "set NO.%s:\t", _set_tag.c_str());
-  for (auto blk: _blocks) {
-    if (blk == NULL) {
+  fprintf(fs, "set NO.%u:\t", _set_num);
+  for (u32 i = 0; i < _ways; i++) {
+    if (!is_valid(i)) {
       fprintf(fs, "null\t");
     }
     else {
-      fprintf(fs, "%llu\t", blk->get_addr());
+      fprintf(fs, "%llu\t", get_addr(i));
     }
   }
   fprintf(fs, "\n");
 }
 
 void CacheSet::pid_census(vector<u32> &table) {
-  for (auto block: _blocks) {
-    if (block) {
-      table[block->get_pid()]++;
+  for (u32 i = 0; i < _ways; i++) {
+    if (is_valid(i)) {
+      table[_pids[i]]++;
     }
   }
 }
 
+void CacheSet::save(CheckpointWriter &w) {
+  for (u32 i = 0; i < _ways; i++) {
+    w.write(_tags[i]);
+    w.write(_pids[i]);
+    w.write(_states[i]);
+  }
+}
+
+void CacheSet::restore(CheckpointReader &r) {
+  for (u32 i = 0; i < _ways; i++) {
+    _tags[i] = r.read<u64>();
+    _pids[i] = r.read<u8>();
+    _states[i] = r.read<u32>();
+  }
+}
+
 void MemoryUnit::proc(u64 tick, EventDataBase* data, EventType type) {
-  MemoryEventData *memory_data = (MemoryEventData *)data;
+  if (type == MemoryOnAccess) {
+    handle_MemoryOnAccess(tick, data);
+  }
+  else if (type == MemoryOnArrive) {
+    handle_MemoryOnArrive(tick, data);
+  }
+}
 
+u32 MemoryUnit::dispatch_kind() {
+  static const u32 kind = []() {
+    u32 k = EventDispatcher::new_kind();
+    EventDispatcher::bind<MemoryUnit, &MemoryUnit::handle_MemoryOnAccess>(k, MemoryOnAccess);
+    EventDispatcher::bind<MemoryUnit, &MemoryUnit::handle_MemoryOnArrive>(k, MemoryOnArrive);
+    return k;
+  }();
+  return kind;
+}
+
+void MemoryUnit::handle_MemoryOnAccess(u64 tick, EventDataBase* data) {
+  access(tick, (MemoryEventData *)data);
+}
+
+void MemoryUnit::access(u64 tick, MemoryEventData *memory_data) {
   EventEngine *evnet_queue = EventEngineObj::get_instance();
 
-  if (type == MemoryOnAccess) {
-    auto iter = _pending_refs.find(memory_data->addr);
-    if (iter != _pending_refs.end()) {
-      return;
-    }
+  // the requester of the unit itself (cpu connector) has no previous unit
+  u64 requester = _prev_units.empty() ? 0 : (1ULL << memory_data->requester);
+  u64 line = _mshr.line_of(memory_data->addr);
+  MSHREntry *entry = _mshr.find(line);
+  if (entry) {
+    // the miss is on the way, the requester gets the data with the others
+    entry->waiters |= requester;
+    _mshr.count_merge();
+    return;
+  }
 
-    if (is_verbose()) {
-      SIMLOG(SIM_INFO, "handler: %s, type: %s\ttick: %lld\taddr: %llu\n", 
-             get_tag().c_str(), event_type_to_string(type).c_str(), tick, memory_data->addr);
-    }
+  // no room to track another miss, the unit does not take new accesses
+  // until an entry is released
+  if (_mshr.full()) {
+    _blocked.push_back(new MemoryEventData(*memory_data));
+    _mshr.count_stall();
+    return;
+  }
 
-    MemoryAccessInfo access_info(*memory_data);
-    bool ret = try_access_memory(access_info);
-    if (ret == true) {
-      for (auto prev_unit: _prev_units) {
-        MemoryEventData *d = new MemoryEventData(*memory_data);
-        Event *e = new Event(MemoryOnArrive, prev_unit, d);
-        evnet_queue->register_after_now(e, get_latency(), prev_unit->get_priority());
-      }
-    }
-    else {
-      _pending_refs.insert(memory_data->addr);
-      MemoryEventData *d = new MemoryEventData(*memory_data);
-      Event *e = new Event(MemoryOnAccess, _next_unit, d);      
-      evnet_queue->register_after_now(e, 1, _next_unit->get_priority());
-    }
+  if (is_verbose()) {
+    SIMLOG(SIM_INFO, "handler: %s, type: %s\ttick: %lld\taddr: %llu\n", 
+           get_tag().c_str(), event_type_to_string(MemoryOnAccess).c_str(), tick, memory_data->addr);
   }
 
-  else if (type == MemoryOnArrive) {
-    if (_pending_refs.find(memory_data->addr) == _pending_refs.end()) {
-      // ingnore a boradcase event
-      return;
+  MemoryAccessInfo access_info(*memory_data);
+  bool ret = try_access_memory(access_info);
+  if (ret == true) {
+    send_arrive(*memory_data, requester);
+  }
+  else {
+    _mshr.allocate(line, *memory_data, requester);
+    MemoryEventData *d = new MemoryEventData(*memory_data);
+    d->requester = _prev_index;
+    Event *e = new Event(MemoryOnAccess, _next_unit, d);      
+    evnet_queue->register_after_now(e, 1, _next_unit->get_priority());
+  }
+}
+
+/*
+ * 下级完成一个miss时送回它的整个块，可能比本单元的块大(如L2的块是L1的
+ * 两倍)。下级会把落在同一个块中的不同miss合并，只送回primary miss的地址，
+ * 因此完成本单元中落在该块内的所有表项。命中只回答一个请求(line_bits为0)
+ */
+void MemoryUnit::handle_MemoryOnArrive(u64 tick, EventDataBase* data) {
+  MemoryEventData *memory_data = (MemoryEventData *)data;
+
+  u32 span_bits = memory_data->line_bits;
+  u64 first = _mshr.line_of(memory_data->addr);
+  u64 last = first;
+  if (span_bits > _mshr.get_line_bits()) {
+    u64 base = memory_data->addr >> span_bits << span_bits;
+    first = _mshr.line_of(base);
+    last = _mshr.line_of(base + (1ULL << span_bits) - 1);
+  }
+
+  for (u64 line = first; line <= last; line++) {
+    MSHREntry *entry = _mshr.find(line);
+    if (!entry) {
+      continue;
     }
-    _pending_refs.erase(memory_data->addr);
+    MemoryEventData done(entry->addr, entry->PC, entry->Pid, entry->ref);
+    u64 waiters = entry->waiters;
+    _mshr.release(entry);
 
     if (is_verbose()) {
       SIMLOG(SIM_INFO, "handler: %s, type: %s\ttick: %lld\taddr: %llu\n", 
-             get_tag().c_str(), event_type_to_string(type).c_str(), tick, memory_data->addr);
+             get_tag().c_str(), event_type_to_string(MemoryOnArrive).c_str(), tick, done.addr);
     }
 
-    MemoryAccessInfo arrive_info(*memory_data);
+    MemoryAccessInfo arrive_info(done);
     on_memory_arrive(arrive_info);
-    for (auto prev_unit: _prev_units) {
-      MemoryEventData *d = new MemoryEventData(*memory_data);
-      Event *e = new Event(MemoryOnArrive, prev_unit, d);
-      evnet_queue->register_after_now(e, get_latency(), prev_unit->get_priority());
+    done.line_bits = _mshr.get_line_bits();
+    send_arrive(done, waiters);
+  }
+
+  while (!_blocked.empty() && !_mshr.full()) {
+    MemoryEventData *blocked = _blocked.front();
+    _blocked.pop_front();
+    access(tick, blocked);
+    delete blocked;
+  }
+}
+
+void MemoryUnit::send_arrive(const MemoryEventData &data, u64 waiters) {
+  EventEngine *evnet_queue = EventEngineObj::get_instance();
+  u32 sent = 0;
+  for (u32 i = 0; i < _prev_units.size(); i++) {
+    if (!(waiters & (1ULL << i))) {
+      continue;
     }
+    MemoryUnit *prev_unit = _prev_units[i];
+    MemoryEventData *d = new MemoryEventData(data);
+    Event *e = new Event(MemoryOnArrive, prev_unit, d);
+    evnet_queue->register_after_now(e, get_latency(), prev_unit->get_priority());
+    sent++;
   }
+  _saved_events += _prev_units.size() - sent;
 }
 
 bool MemoryUnit::validate(EventType type) {
   return ((type == MemoryOnAccess) || (type == MemoryOnArrive));
 }
 
+bool MemoryUnit::try_fast_hit(const MemoryAccessInfo &info) {
+  (void)info;
+  return false;
+}
+
+MemoryUnit::~MemoryUnit() {
+  for (auto d: _blocked) {
+    delete d;
+  }
+}
+
+void MemoryUnit::save(CheckpointWriter &w) {
+  _mshr.save(w);
+  w.write<u64>(_blocked.size());
+  for (auto d: _blocked) {
+    d->save(w);
+  }
+  w.write(_saved_events);
+}
+
+void MemoryUnit::restore(CheckpointReader &r) {
+  _mshr.restore(r);
+  for (auto d: _blocked) {
+    delete d;
+  }
+  _blocked.clear();
+  u64 n = r.read<u64>();
+  for (u64 i = 0; i < n; i++) {
+    MemoryEventData *d = new MemoryEventData(0, 0, 0);
+    d->restore(r);
+    _blocked.push_back(d);
+  }
+  _saved_events = r.read<u64>();
+}
+
+MSHRTable::MSHRTable(u32 capacity) : _capacity(capacity), _size(0), _line_bits(0),
+    _misses(0), _merged(0), _stalls(0), _occupancy(0), _peak(0) {
+  assert(capacity > 0);
+  _bits = LinearProbing::bits_for(capacity);
+  MSHREntry free_slot;
+  SlotOps().clear(free_slot);
+  _slots.assign(1U << _bits, free_slot);
+}
+
+MSHREntry* MSHRTable::find(u64 line) {
+  s32 i = LinearProbing::find(_slots.data(), _bits, line, SlotOps());
+  return i == -1 ? NULL : &_slots[i];
+}
+
+MSHREntry* MSHRTable::allocate(u64 line, const MemoryEventData &data, u64 waiters) {
+  assert(!full() && line != INVALID_LINE);
+  MSHREntry &entry = _slots[LinearProbing::insert_at(_slots.data(), _bits, line, SlotOps())];
+  entry.line = line;
+  entry.waiters = waiters;
+  entry.addr = data.addr;
+  entry.PC = data.PC;
+  entry.Pid = data.Pid;
+  entry.ref = data.ref;
+
+  _size++;
+  _misses++;
+  _occupancy += _size;
+  _peak = max(_peak, _size);
+  return &entry;
+}
+
+void MSHRTable::release(MSHREntry *entry) {
+  LinearProbing::erase(_slots.data(), _bits, entry - &_slots[0], SlotOps());
+  _size--;
+}
+
+void MSHRTable::save(CheckpointWriter &w) {
+  // sorted, the checkpoint does not depend on the slots
+  vector<MSHREntry> entries;
+  for (auto &slot: _slots) {
+    if (slot.line != INVALID_LINE) {
+      entries.push_back(slot);
+    }
+  }
+  sort(entries.begin(), entries.end(), [](const MSHREntry &a, const MSHREntry &b) {
+    return a.line < b.line;
+  });
+  w.write(_line_bits);
+  w.write<u64>(entries.size());
+  for (auto &entry: entries) {
+    w.write(entry.line);
+    w.write(entry.waiters);
+    w.write(entry.addr);
+    w.write(entry.PC);
+    w.write(entry.Pid);
+    w.write(entry.ref);
+  }
+  w.write(_misses);
+  w.write(_merged);
+  w.write(_stalls);
+  w.write(_occupancy);
+  w.write(_peak);
+}
+
+void MSHRTable::restore(CheckpointReader &r) {
+  MSHREntry free_slot;
+  SlotOps().clear(free_slot);
+  _slots.assign(_slots.size(), free_slot);
+  _size = 0;
+  _line_bits = r.read<u32>();
+  u64 n = r.read<u64>();
+  if (n > _capacity) {
+    SIMLOG(SIM_ERROR, "checkpoint has %llu mshr entries, the table holds %u\n", n, _capacity);
+    exit(1);
+  }
+  for (u64 i = 0; i < n; i++) {
+    MemoryEventData data(0, 0, 0);
+    u64 line = r.read<u64>();
+    u64 waiters = r.read<u64>();
+    data.addr = r.read<u64>();
+    data.PC = r.read<u64>();
+    data.Pid = r.read<u8>();
+    data.ref = r.read<u64>();
+    allocate(line, data, waiters);
+  }
+  _misses = r.read<u64>();
+  _merged = r.read<u64>();
+  _stalls = r.read<u64>();
+  _occupancy = r.read<u64>();
+  _peak = r.read<u32>();
+}
+
 CacheUnit::CacheUnit(const string &tag, const MemoryConfig &config)
-  : MemoryUnit(tag, config.latency, config.priority), 
-    _ways(config.ways), _blk_size(config.blk_size), _sets(config.sets){
+  : MemoryUnit(tag, config.latency, config.priority, config.mshrs), 
+    _ways(config.ways), _blk_size(config.blk_size), _sets(config.sets),
+    _policy_type(config.policy_type), _organization(config.organization) {
+  // is_power_of_two takes 0, the decoder would mask every address to set 0
+  if (_sets == 0) {
+    SIMLOG(SIM_ERROR, "cache needs at least one set\n");
+    exit(1);
+  }
   auto factory = PolicyFactoryObj::get_instance();
   _cr_policy = factory->get_policy(config);
   if (!_cr_policy) {
@@ -249,66 +698,176 @@ CacheUnit::CacheUnit(const string &tag, const MemoryConfig &config)
     SIMLOG(SIM_ERROR, "block size should be power of 2");
     exit(1);
   }
+  else if (config.mshrs == 0) {
+    SIMLOG(SIM_ERROR, "mshr table needs at least one entry");
+    exit(1);
+  }
 
-  u32 s = len_of_binary(_sets);
-  u32 b = len_of_binary(_sets);
-
-  if (s + b >= MACHINE_WORD_SIZE) {
+  _decoder = AddressDecoder(_blk_size, _sets);
+  if (_decoder.get_tag_shift() >= MACHINE_WORD_SIZE) {
     SIMLOG(SIM_ERROR, "cache size too large");
     exit(1);
   }
+  set_line_bits(_decoder.get_offset_bits());
   
-  for (u32 i = 0; i < _sets; i++) {
-    CacheSet *line = new CacheSet(_ways, _blk_size, _sets, _cr_policy);
+  _stats = MemoryStatsManagerObj::get_instance()->get_stats_handler(tag);
+  _blocks = new BlockArray(_sets, _ways);
+  // no allocation per set, a million sets cost two regions
+  _sets_region = new MemoryRegion(_sets * sizeof(CacheSet));
+  _cache_sets = (CacheSet *)_sets_region->get_base();
+  for (u64 i = 0; i < _sets; i++) {
+    CacheSet *line = new (&_cache_sets[i]) CacheSet(_ways, _decoder, _cr_policy, _blocks, i);
     line->set_set_num(i);
-    _cache_sets.push_back(line);
   }
 }
 
 CacheUnit::~CacheUnit() {
-  for (u32 i = 0; i < _sets; i++) {
-    delete _cache_sets[i];
+  for (u64 i = 0; i < _sets; i++) {
+    _cache_sets[i].~CacheSet();
   }
-}
-
-u64 CacheUnit::get_set_no(u64 addr) {
-  u32 s = len_of_binary(_sets);
-  u32 b = len_of_binary(_blk_size);
-  if (s == 0)
-    return 0;
-  else
-    return addr << (MACHINE_WORD_SIZE - s - b) >> (MACHINE_WORD_SIZE - s);
+  delete _sets_region;
+  delete _blocks;
 }
 
 void CacheUnit::pid_census(vector<u32> &table) {
-  for (u32 i = 0; i < _sets; i++) {
-    _cache_sets[i]->pid_census(table);
+  for (u64 i = 0; i < _sets; i++) {
+    _cache_sets[i].pid_census(table);
   }
 }
 
+size_t CacheUnit::get_block_footprint() {
+  return _blocks->get_region().get_size();
+}
+
+size_t CacheUnit::get_set_footprint() {
+  return _sets_region->get_size();
+}
+
+size_t CacheUnit::get_mshr_footprint() {
+  return get_mshr().get_footprint();
+}
+
+bool CacheUnit::is_thp_requested() {
+  return _blocks->get_region().is_thp_requested();
+}
+
 bool CacheUnit::try_access_memory(const MemoryAccessInfo &info) {
   u64 set_no = get_set_no(info.addr);
-  assert(set_no < _cache_sets.size());
-  auto cache_set = _cache_sets[set_no];
+  assert(set_no < _sets);
+  auto cache_set = &_cache_sets[set_no];
   auto ret = cache_set->try_access_memory(info);
-  auto stats_manager = MemoryStatsManagerObj::get_instance();
-  auto stats = stats_manager->get_stats_handler(get_tag());
   if (ret == true) {
-    stats->increment_hit(info.Pid);
+    _stats->increment_hit(info.Pid);
   }
   else {
-    stats->increment_miss(info.Pid);
+    _stats->increment_miss(info.Pid);
+  }
+  return ret;
+}
+
+// without pending misses no arrival can change the unit before the access
+bool CacheUnit::try_fast_hit(const MemoryAccessInfo &info) {
+  if (has_pending()) {
+    return false;
+  }
+  u64 set_no = get_set_no(info.addr);
+  assert(set_no < _sets);
+  if (!_cache_sets[set_no].contains(info.addr)) {
+    return false;
+  }
+  return try_access_memory(info);
+}
+
+void CacheUnit::prefetch_set(u64 set_no, u64 addr) {
+  _blocks->prefetch(set_no);
+  __builtin_prefetch(&_cache_sets[set_no]);
+}
+
+/*
+ * 批量的功能性访问: 按原顺序逐个处理，同一set的访问顺序自然不变；处理第i个
+ * 访问时预取第i+BATCH_PREFETCH_DISTANCE个访问所在set的元数据，工作集远大于
+ * 宿主机cache时访存延迟与前面访问的处理重叠。
+ * 不按set分组重排: DIP的PSEL、BIP/RANDOM的随机数等策略状态跨set共享，
+ * 重排会改变替换决定，按原顺序才与逐个调用的结果完全一致
+ */
+u64 CacheUnit::access_batch(const MemoryAccessInfo *accesses, size_t n, bool *hits) {
+  // the accesses bypass the mshr, no timed miss may be outstanding
+  assert(!has_pending());
+  const size_t ahead = BATCH_PREFETCH_DISTANCE;
+  for (size_t i = 0; i < n && i < ahead; i++) {
+    prefetch_set(get_set_no(accesses[i].addr), accesses[i].addr);
+  }
+  u64 ret = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i + ahead < n) {
+      const MemoryAccessInfo &next = accesses[i + ahead];
+      prefetch_set(get_set_no(next.addr), next.addr);
+    }
+    bool hit = try_access_memory(accesses[i]);
+    if (hit) {
+      ret++;
+    }
+    else {
+      on_memory_arrive(accesses[i]);
+    }
+    if (hits) {
+      hits[i] = hit;
+    }
   }
   return ret;
 }
 
 void CacheUnit::on_memory_arrive(const MemoryAccessInfo &info) {
   u64 set_no = get_set_no(info.addr);
-  assert(set_no < _cache_sets.size());
-  auto cache_set = _cache_sets[set_no];
+  assert(set_no < _sets);
+  auto cache_set = &_cache_sets[set_no];
   cache_set->on_memory_arrive(info);
 }
 
+void CacheUnit::save(CheckpointWriter &w) {
+  MemoryUnit::save(w);
+  w.write(_ways);
+  w.write(_blk_size);
+  w.write(_sets);
+  w.write(_organization);
+  for (u64 i = 0; i < _sets; i++) {
+    _cache_sets[i].save(w);
+  }
+  w.write(_policy_type);
+  w.begin_block();
+  _cr_policy->save(w);
+  w.end_block();
+}
+
+// the blocks can be restored under another policy, e.g. to compare the
+// policies on the same warmed cache
+void CacheUnit::restore(CheckpointReader &r) {
+  MemoryUnit::restore(r);
+  r.check(r.read<u32>() == _ways, "cache ways");
+  r.check(r.read<u32>() == _blk_size, "cache block size");
+  r.check(r.read<u64>() == _sets, "cache sets");
+  r.check(r.read<CACHE_ORGANIZATION>() == _organization, "cache organization");
+  for (u64 i = 0; i < _sets; i++) {
+    _cache_sets[i].restore(r);
+  }
+  CR_POLICY saved_policy = r.read<CR_POLICY>();
+  if (saved_policy == _policy_type) {
+    r.begin_block();
+    _cr_policy->restore(r);
+  }
+  else {
+    SIMLOG(SIM_WARNING, "policy of %s changed, only the blocks are restored\n",
+           get_tag().c_str());
+    r.skip_block();
+    // e.g. RRPVs are no LRU stack, start the blocks over in the new policy
+    if (!PolicyFactory::is_same_block_state(saved_policy, _policy_type)) {
+      for (u64 i = 0; i < _sets; i++) {
+        _cr_policy->init_set(&_cache_sets[i]);
+      }
+    }
+  }
+}
+
 MainMemory::MainMemory(const string &tag, const MemoryConfig &config) :
     MemoryUnit(tag, config.latency, config.priority) {}
 
@@ -332,7 +891,7 @@ void MemoryStats::display(FILE *stream, const string &tag) {
     fprintf(stream, "\t\tcache hits %llu\n", _hits[i]);
     fprintf(stream, "\t\tcache misses %llu\n", _misses[i]);
   }
-  printf("\n");
+  fprintf(stream, "\n");
 }
 
 void MemoryStats::clear() {
@@ -341,9 +900,26 @@ void MemoryStats::clear() {
   }
 }
 
-void CensusTaker::proc(u64 tick, EventDataBase* data, EventType type) {
-  (void)data, void(type);
+void MemoryStats::save(CheckpointWriter &w) {
+  w.write(_misses);
+  w.write(_hits);
+}
 
+void MemoryStats::restore(CheckpointReader &r) {
+  r.read_bytes(_misses, sizeof(_misses));
+  r.read_bytes(_hits, sizeof(_hits));
+}
+
+bool MemoryStats::is_empty() {
+  for (int i = 0; i < 4; i++) {
+    if (_misses[i] || _hits[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CensusTaker::take_census(u64 tick) {
   for (auto llc: _llcs) {
     vector<u32> census_table(8,0);
     llc->pid_census(census_table);
@@ -353,66 +929,199 @@ void CensusTaker::proc(u64 tick, EventDataBase* data, EventType type) {
     }
     fprintf(_file, "\n");
   }
-
-  if (!_shutdown) {
-    EventEngine *evnet_queue = EventEngineObj::get_instance();
-    Event *e = new Event(PidCensus, this, NULL);
-    evnet_queue->register_after_now(e, _period, 0);
-  }
 }
 
-bool CensusTaker::validate(EventType type) {
-  return (type == PidCensus);
+// the hook runs before any event of the tick, the cache state is the
+// same as it was at every census point passed since the last tick
+void CensusTaker::on_tick(u64 tick) {
+  while (_next <= tick && _next <= _shutdown_tick.load(memory_order_acquire)) {
+    take_census(_next);
+    _next += _period;
+  }
 }
 
 void CensusTaker::init(u64 period, FILE *file) {
   _period = period;
+  _next = period;
   _file = file;
   EventEngine *evnet_queue = EventEngineObj::get_instance();
-  Event *e = new Event(PidCensus, this, NULL);
-  evnet_queue->register_after_now(e, _period, 0);
+  evnet_queue->add_tick_hook([this](u64 tick) { on_tick(tick); });
 }
 
-void CensusTaker::shutdown() {
-  _shutdown = true;
+// cpus may finish in different logical processes, keep the earliest tick
+void CensusTaker::shutdown(u64 tick) {
+  u64 cur = _shutdown_tick.load(memory_order_relaxed);
+  while (tick < cur && !_shutdown_tick.compare_exchange_weak(cur, tick)) {
+  }
 }
 
 void CensusTaker::register_llc(CacheUnit *c) {
   _llcs.push_back(c);
 }
 
+bool CensusTaker::is_registered(CacheUnit *c) {
+  return find(_llcs.begin(), _llcs.end(), c) != _llcs.end();
+}
+
+void CensusTaker::save(CheckpointWriter &w) {
+  w.begin_section("census");
+  w.write(_period);
+  w.write(_next);
+  w.write(_shutdown_tick.load());
+}
+
+// the census continues with the period of this run from the checkpoint
+void CensusTaker::restore(CheckpointReader &r) {
+  r.check_section("census");
+  u64 period = r.read<u64>();
+  u64 next = r.read<u64>();
+  _shutdown_tick = r.read<u64>();
+  if (period == _period) {
+    _next = next;
+  }
+  else {
+    _next = next - period + _period;
+  }
+}
+
 MemoryStatsManager::~MemoryStatsManager() {
   for (auto &entry: _stats_handlers) {
-    delete entry.second;
+    entry.second->~MemoryStats();
+    free(entry.second);
   }
 }
 
+// c++11 new does not keep the alignment of MemoryStats
 MemoryStats* MemoryStatsManager::get_stats_handler(const string &tag) {
   auto iter = _stats_handlers.find(tag);
   if (iter == _stats_handlers.end()) {
-    auto handler = new MemoryStats();
-    _stats_handlers[tag] = handler;
+    void *p = NULL;
+    if (posix_memalign(&p, alignof(MemoryStats), sizeof(MemoryStats)) != 0) {
+      SIMLOG(SIM_ERROR, "can not allocate the stats of %s\n", tag.c_str());
+      exit(1);
+    }
+    iter = _stats_handlers.insert(make_pair(tag, new (p) MemoryStats())).first;
   }
 
-  return _stats_handlers[tag];
+  return iter->second;
+}
+
+void MemoryStatsManager::save(CheckpointWriter &w) {
+  w.begin_section("stats");
+  w.write<u64>(_stats_handlers.size());
+  for (auto &entry: _stats_handlers) {
+    w.write_string(entry.first);
+    entry.second->save(w);
+  }
+}
+
+void MemoryStatsManager::restore(CheckpointReader &r) {
+  r.check_section("stats");
+  u64 n = r.read<u64>();
+  for (u64 i = 0; i < n; i++) {
+    string tag = r.read_string();
+    get_stats_handler(tag)->restore(r);
+  }
 }
 
 void MemoryStatsManager::display_all(FILE *stream) {
   for (auto &entry: _stats_handlers) {
+    // created with the cache but never accessed
+    if (entry.second->is_empty()) {
+      continue;
+    }
     entry.second->display(stream, entry.first);
   }
 }
 
 CpuConnector::CpuConnector(const string &tag, u8 id): MemoryUnit(tag, 0, 0),
-                                               _waiting_event_data(nullptr) {
+    _waiting_event_data(nullptr), _fast_path(false), _queued(0),
+    _fast_ready(-1), _fast_hits(0) {
   _cpu_ptr = new SequentialCPU(tag, id, this);
+  set_kind(dispatch_kind());
+}
+
+u32 CpuConnector::dispatch_kind() {
+  static const u32 kind = []() {
+    u32 k = EventDispatcher::new_kind();
+    EventDispatcher::bind<CpuConnector, &CpuConnector::handle_MemoryOnAccess>(k, MemoryOnAccess);
+    EventDispatcher::bind<CpuConnector, &CpuConnector::handle_MemoryOnArrive>(k, MemoryOnArrive);
+    return k;
+  }();
+  return kind;
+}
+
+void CpuConnector::proc(u64 tick, EventDataBase* data, EventType type) {
+  if (type == MemoryOnAccess) {
+    handle_MemoryOnAccess(tick, data);
+  }
+  else if (type == MemoryOnArrive) {
+    handle_MemoryOnArrive(tick, data);
+  }
+}
+
+void CpuConnector::handle_MemoryOnAccess(u64 tick, EventDataBase* data) {
+  assert(_queued > 0);
+  _queued--;
+  MemoryUnit::handle_MemoryOnAccess(tick, data);
+}
+
+void CpuConnector::handle_MemoryOnArrive(u64 tick, EventDataBase* data) {
+  MemoryUnit::handle_MemoryOnArrive(tick, data);
 }
 
 CpuConnector::~CpuConnector() {
   delete _cpu_ptr;
+  delete _waiting_event_data;
 }
 
-void CpuConnector::set_tracer(const vector<u64> &traces) {
+void CpuConnector::save(CheckpointWriter &w) {
+  MemoryUnit::save(w);
+  w.write<u64>(_waiting_refs.size());
+  for (auto line: _waiting_refs) {
+    w.write(line);
+  }
+  w.write<bool>(_waiting_event_data != nullptr);
+  if (_waiting_event_data) {
+    _waiting_event_data->save(w);
+  }
+  w.write(_queued);
+  w.write<u64>(_fast_refs.size());
+  for (auto &ref: _fast_refs) {
+    w.write(ref.first);
+    w.write(ref.second);
+  }
+  w.write(_fast_ready);
+  w.write(_fast_hits);
+  _cpu_ptr->save(w);
+}
+
+void CpuConnector::restore(CheckpointReader &r) {
+  MemoryUnit::restore(r);
+  _waiting_refs.clear();
+  u64 n = r.read<u64>();
+  for (u64 i = 0; i < n; i++) {
+    _waiting_refs.push_back(r.read<u64>());
+  }
+  delete _waiting_event_data;
+  _waiting_event_data = nullptr;
+  if (r.read<bool>()) {
+    _waiting_event_data = new CPUEventData(TraceFormat());
+    _waiting_event_data->restore(r);
+  }
+  _queued = r.read<u32>();
+  _fast_refs.clear();
+  n = r.read<u64>();
+  for (u64 i = 0; i < n; i++) {
+    u64 addr = r.read<u64>();
+    _fast_refs.push_back(make_pair(addr, r.read<s64>()));
+  }
+  _fast_ready = r.read<s64>();
+  _fast_hits = r.read<u64>();
+  _cpu_ptr->restore(r);
+}
+
+void CpuConnector::set_tracer(const vector<MemoryAccessInfo> &traces) {
   _traces = traces;
   _idx = 0;
 }
@@ -424,11 +1133,11 @@ bool CpuConnector::try_access_memory(const MemoryAccessInfo &info) {
 
 void CpuConnector::on_memory_arrive(const MemoryAccessInfo &info) {
   if (! _waiting_event_data) return;
-  auto iter = _pending_refs.find(info.addr);
-  if (iter != _pending_refs.end()) {
-    _pending_refs.erase(iter);
+  auto iter = find(_waiting_refs.begin(), _waiting_refs.end(), info.addr);
+  if (iter != _waiting_refs.end()) {
+    _waiting_refs.erase(iter);
   }
-  if (_pending_refs.empty()) {
+  if (_waiting_refs.empty()) {
     auto evnet_queue = EventEngineObj::get_instance();
     Event *e = new Event(InstExecution, _cpu_ptr, _waiting_event_data);
     evnet_queue->register_after_now(e, 1, get_priority());
@@ -438,23 +1147,83 @@ void CpuConnector::on_memory_arrive(const MemoryAccessInfo &info) {
 }
 
 void CpuConnector::issue_memory_access() {
-  u64 addr = _traces[_idx++];
-  MemoryAccessInfo info(addr, 0, 0);
-  issue_memory_access(info, nullptr);
+  issue_memory_access(_traces[_idx++], nullptr);
+}
+
+/*
+ * L1命中的快速路径: 访问 connector -> L1 -> connector 的三个事件只是把数据
+ * 在 tick + 1 + L1 latency 送回，命中时直接修改L1并记下送达的tick，
+ * 指令的全部访问都走快速路径时由 end_issue 直接安排执行。
+ * 与事件路径结果一致的条件:
+ * 1. connector没有未处理的访问、没有未完成的miss，L1没有未完成的miss，
+ *    因此在访问本应到达L1之前没有其他事件会修改L1
+ * 2. 已由快速路径访问、尚未"送达"的地址与事件路径一样合并(coalesce)
+ * 3. connector和L1私有，且每个CPU的事件有自己的优先级(见
+ *    PipeLineBuilder::order_cpu_events)，跳过的事件不会改变与其他CPU
+ *    在同一tick中的事件顺序
+ */
+bool CpuConnector::try_fast_access(const MemoryAccessInfo &info, s64 tick) {
+  s64 arrival = -1;
+  for (auto iter = _fast_refs.begin(); iter != _fast_refs.end();) {
+    if (iter->second <= tick) {
+      iter = _fast_refs.erase(iter);
+      continue;
+    }
+    if (iter->first == info.addr) {
+      arrival = iter->second;
+    }
+    ++iter;
+  }
+
+  if (arrival == -1) {
+    if (_queued > 0 || has_pending() || !get_next()->try_fast_hit(info)) {
+      return false;
+    }
+    arrival = tick + 1 + get_next()->get_latency();
+    _fast_refs.push_back(make_pair(info.addr, arrival));
+    _fast_hits++;
+  }
+  _fast_ready = max(_fast_ready, arrival);
+  return true;
 }
 
 void CpuConnector::issue_memory_access(const MemoryAccessInfo &info,
                                        CPUEventData *event_data) {
   auto evnet_queue = EventEngineObj::get_instance();
+  if (_fast_path && try_fast_access(info, evnet_queue->get_tick())) {
+    if (!event_data) {
+      _fast_ready = -1;
+    }
+    return;
+  }
+
   MemoryEventData *d = new MemoryEventData(info);
   Event *e = new Event(MemoryOnAccess, this, d);
   evnet_queue->register_after_now(e, 0, get_priority());
+  _queued++;
   if (event_data) {
     _waiting_event_data = event_data;
-    _pending_refs.insert(info.addr);
+    if (find(_waiting_refs.begin(), _waiting_refs.end(), info.addr) == _waiting_refs.end()) {
+      _waiting_refs.push_back(info.addr);
+    }
   }
 }
 
+void CpuConnector::end_issue(CPUEventData *event_data) {
+  s64 ready = _fast_ready;
+  _fast_ready = -1;
+  // the last event-path arrival schedules the execution
+  if (_waiting_event_data) {
+    return;
+  }
+
+  assert(ready >= 0);
+  auto evnet_queue = EventEngineObj::get_instance();
+  Event *e = new Event(InstExecution, _cpu_ptr, event_data);
+  evnet_queue->register_after_now(e, ready + 1 - evnet_queue->get_tick(), get_priority());
+  event_data->memory_ready = true;
+}
+
 void CpuConnector::start() {
   auto event_queue = EventEngineObj::get_instance();
   Event *e = new Event(InstFetch, _cpu_ptr, nullptr);
@@ -521,7 +1290,10 @@ MemoryUnit* PipeLineBuilder::create_node(BaseNodeCfg *cfg, u8 level) {
       case CacheNode: {
         CacheNodeCfg* cache_cfg = (CacheNodeCfg *)cfg;
         MemoryConfig memcfg(*cache_cfg, level);
-        cur_unit = new CacheUnit(cfg->name, memcfg);
+        cur_unit = create_cache_unit(cfg->name, memcfg, _kernels);
+        if (_kernels && has_cache_kernel(memcfg)) {
+          _kernel_caches++;
+        }
         if (cfg->name.find("LLC") != string::npos) {
           auto cencus = CensusTakerObj::get_instance();
           cencus->register_llc((CacheUnit *)cur_unit);
@@ -579,6 +1351,158 @@ PipeLineBuilder::~PipeLineBuilder() {
   }
 }
 
+const vector<EventHandler*>& PipeLineBuilder::get_handlers() {
+  if (_handlers.empty()) {
+    for (auto &entry: _nodes) {
+      _handlers.push_back(entry.second);
+      if (_nodes_cfg[entry.first]->type == CpuNode) {
+        _handlers.push_back(((CpuConnector *)entry.second)->get_cpu());
+      }
+    }
+  }
+  return _handlers;
+}
+
+void PipeLineBuilder::save(CheckpointWriter &w) {
+  w.begin_section("pipeline");
+  w.write<u64>(_nodes.size());
+  for (auto &entry: _nodes) {
+    w.write_string(entry.first);
+    entry.second->save(w);
+  }
+}
+
+void PipeLineBuilder::restore(CheckpointReader &r) {
+  r.check_section("pipeline");
+  r.check(r.read<u64>() == _nodes.size(), "number of memory units");
+  for (auto &entry: _nodes) {
+    r.check(r.read_string() == entry.first, "memory unit names");
+    entry.second->restore(r);
+  }
+}
+
+enum CheckpointEventData {
+  NoEventData,
+  CPUEventDataKind,
+  MemoryEventDataKind,
+};
+
+void PipeLineBuilder::save_event(CheckpointWriter &w, Event *e) {
+  auto &handlers = get_handlers();
+  auto iter = find(handlers.begin(), handlers.end(), e->handler);
+  assert(iter != handlers.end());
+  w.write<u32>(iter - handlers.begin());
+  w.write(e->type);
+
+  if (e->callbackdata == nullptr) {
+    w.write(NoEventData);
+  }
+  else if (auto d = dynamic_cast<CPUEventData *>(e->callbackdata)) {
+    w.write(CPUEventDataKind);
+    d->save(w);
+  }
+  else if (auto d = dynamic_cast<MemoryEventData *>(e->callbackdata)) {
+    w.write(MemoryEventDataKind);
+    d->save(w);
+  }
+  else {
+    assert(0);
+  }
+}
+
+Event* PipeLineBuilder::load_event(CheckpointReader &r) {
+  auto &handlers = get_handlers();
+  u32 index = r.read<u32>();
+  r.check(index < handlers.size(), "event handler");
+  EventType type = r.read<EventType>();
+  r.check(type < TypeCount, "event type");
+
+  EventDataBase *data = nullptr;
+  switch (r.read<CheckpointEventData>()) {
+    case NoEventData:
+      break;
+    case CPUEventDataKind: {
+      auto d = new CPUEventData(TraceFormat());
+      d->restore(r);
+      data = d;
+    } break;
+    case MemoryEventDataKind: {
+      auto d = new MemoryEventData(0, 0, 0);
+      d->restore(r);
+      data = d;
+    } break;
+    default:
+      r.check(false, "event data");
+  }
+  return new Event(type, handlers[index], data);
+}
+
+u64 PipeLineBuilder::get_fast_hits() {
+  u64 hits = 0;
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type == CpuNode) {
+      hits += ((CpuConnector *)entry.second)->get_fast_hits();
+    }
+  }
+  return hits;
+}
+
+u64 PipeLineBuilder::get_batched() {
+  u64 batched = 0;
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type == CpuNode) {
+      batched += ((CpuConnector *)entry.second)->get_cpu()->get_batched();
+    }
+  }
+  return batched;
+}
+
+void PipeLineBuilder::display_mshr(FILE *stream) {
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type != CacheNode) {
+      continue;
+    }
+    MSHRTable &mshr = entry.second->get_mshr();
+    u64 misses = mshr.get_misses() + mshr.get_merged();
+    fprintf(stream, "mshr %s: %u entries, peak %u, mean %.2f, "
+            "%llu of %llu misses merged (%.2f%%), %llu stalls\n",
+            entry.first.c_str(), mshr.get_capacity(), mshr.get_peak(),
+            mshr.get_mean_occupancy(), mshr.get_merged(), misses,
+            misses ? 100.0 * mshr.get_merged() / misses : 0.0, mshr.get_stalls());
+  }
+}
+
+void PipeLineBuilder::display_footprint(FILE *stream) {
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type != CacheNode) {
+      continue;
+    }
+    CacheUnit *cache = (CacheUnit *)entry.second;
+    fprintf(stream, "footprint %s: %llu sets, blocks %.1f KB, sets %.1f KB, "
+            "mshr %.1f KB%s\n", entry.first.c_str(), cache->get_sets(),
+            cache->get_block_footprint() / 1024.0, cache->get_set_footprint() / 1024.0,
+            cache->get_mshr_footprint() / 1024.0,
+            cache->is_thp_requested() ? ", THP requested" : "");
+  }
+}
+
+void PipeLineBuilder::display_policies(FILE *stream) {
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type != CacheNode) {
+      continue;
+    }
+    ((CacheUnit *)entry.second)->get_policy()->display(stream, entry.first);
+  }
+}
+
+u64 PipeLineBuilder::get_saved_events() {
+  u64 saved = 0;
+  for (auto &entry: _nodes) {
+    saved += entry.second->get_saved_events();
+  }
+  return saved;
+}
+
 vector<CpuConnector* > PipeLineBuilder::get_connectors() {
   vector<CpuConnector* > cpus;
   vector<BaseNodeCfg*> cpu_cfgs;
@@ -596,5 +1520,143 @@ vector<CpuConnector* > PipeLineBuilder::get_connectors() {
     }
   }
 
+  map<MemoryUnit*, set<u32> > owners;
+  for (u32 i = 0; i < cpus.size(); i++) {
+    for (MemoryUnit *unit = cpus[i]; unit; unit = unit->get_next()) {
+      owners[unit].insert(i);
+    }
+  }
+  if (!_prioritized) {
+    _prioritized = true;
+    _cpu_ordered = order_cpu_events(cpus, owners);
+  }
+
+  // the L1 hit fast path and the instruction batching change when the cpu
+  // events are registered. with the per-cpu priorities that only reorders
+  // the events of the cpu itself, so a cpu whose connector and L1 are
+  // private keeps the same results, without them only a cpu sharing no
+  // unit with others
+  auto census = CensusTakerObj::get_instance();
+  for (auto conn: cpus) {
+    CacheUnit *l1 = dynamic_cast<CacheUnit *>(conn->get_next());
+    bool is_private = true, l1_private = true;
+    for (MemoryUnit *unit = conn; unit; unit = unit->get_next()) {
+      is_private = is_private && owners[unit].size() == 1;
+      if (unit == conn || unit == l1) {
+        l1_private = is_private;
+      }
+    }
+    l1_private = _cpu_ordered ? l1_private : is_private;
+    conn->set_fast_path(_fast_path && l1_private && l1 && !census->is_registered(l1));
+    conn->get_cpu()->set_batching(_batching && l1_private);
+  }
+
   return cpus;
 }
+
+/*
+ * 同一cycle中同类型、同优先级的事件按注册顺序处理，快速路径和批处理改变了
+ * CPU事件的注册时机，因此不同CPU的事件不能共用优先级。
+ * 每个单元的优先级(层次)作为主序，再按所属CPU分成 CPU数 + 1 个槽:
+ * 私有单元和CPU自己的事件用所属CPU的槽，共享单元用最后一个槽，
+ * 这样不同CPU的事件之间由优先级定序，共享单元中的事件由它们的父事件定序。
+ * 私有与共享单元的优先级也因此互不相同(见partition)。
+ * 单元数超出优先级的范围时保持原来的优先级，返回false
+ */
+bool PipeLineBuilder::order_cpu_events(const vector<CpuConnector*> &cpus,
+                                       const map<MemoryUnit*, set<u32> > &owners) {
+  u32 slots = cpus.size() + 1;
+  u32 levels = 0;
+  for (auto &entry: owners) {
+    levels = max(levels, entry.first->get_priority() + 1U);
+  }
+  if (levels * slots > PRIORITY_LIMIT) {
+    SIMLOG(SIM_WARNING, "too many cpus to give each one its own priorities\n");
+    return false;
+  }
+
+  for (auto &entry: owners) {
+    MemoryUnit *unit = entry.first;
+    u32 slot = entry.second.size() == 1 ? *entry.second.begin() : cpus.size();
+    unit->set_priority(unit->get_priority() * slots + slot);
+  }
+  for (auto conn: cpus) {
+    conn->get_cpu()->set_priority(conn->get_priority());
+  }
+  return true;
+}
+
+
+/*
+ * 按CPU划分逻辑进程: 只被一个CPU访问到的单元归该CPU的逻辑进程，其余归共享
+ * 逻辑进程。要求:
+ * 1. 私有单元与共享单元的事件优先级互不相同，否则同一cycle中的事件顺序无法
+ *    在不同逻辑进程之间确定
+ * 2. 参与统计(census)的LLC在共享逻辑进程中，census在共享部分的tick上进行
+ * 3. 共享单元返回私有单元的延迟(lookahead)至少为1
+ */
+bool PipeLineBuilder::partition(LPLayout &layout) {
+  vector<CpuConnector*> connectors;
+  for (auto &entry: _nodes) {
+    if (_nodes_cfg[entry.first]->type == CpuNode) {
+      connectors.push_back((CpuConnector *)entry.second);
+    }
+  }
+
+  map<MemoryUnit*, set<u32> > owners;
+  for (u32 i = 0; i < connectors.size(); i++) {
+    for (MemoryUnit *unit = connectors[i]; unit; unit = unit->get_next()) {
+      owners[unit].insert(i);
+    }
+  }
+
+  layout.privates.assign(connectors.size(), vector<EventHandler*>());
+  layout.shared.clear();
+  layout.lookahead = ~0U;
+  set<u8> private_priorities, shared_priorities;
+  auto census = CensusTakerObj::get_instance();
+  for (auto &entry: owners) {
+    MemoryUnit *unit = entry.first;
+    CacheUnit *cache = dynamic_cast<CacheUnit *>(unit);
+
+    if (entry.second.size() == 1) {
+      layout.privates[*entry.second.begin()].push_back(unit);
+      private_priorities.insert(unit->get_priority());
+      if (cache && census->is_registered(cache)) {
+        SIMLOG(SIM_WARNING, "%s is not shared, can not take census in parallel\n",
+               unit->get_tag().c_str());
+        return false;
+      }
+      continue;
+    }
+
+    layout.shared.push_back(unit);
+    shared_priorities.insert(unit->get_priority());
+    for (auto prev: unit->get_prevs()) {
+      if (owners[prev].size() == 1) {
+        layout.lookahead = min(layout.lookahead, unit->get_latency());
+      }
+    }
+  }
+
+  for (u32 i = 0; i < connectors.size(); i++) {
+    layout.privates[i].push_back(connectors[i]->get_cpu());
+  }
+
+  for (auto priority: private_priorities) {
+    if (shared_priorities.count(priority)) {
+      SIMLOG(SIM_WARNING, "private and shared memory units have the same priority %u\n",
+             (u32)priority);
+      return false;
+    }
+  }
+
+  if (layout.shared.empty()) {
+    layout.lookahead = 0;
+  }
+  else if (layout.lookahead == 0) {
+    SIMLOG(SIM_WARNING, "shared memory units without latency\n");
+    return false;
+  }
+  return true;
+}
\ No newline at end of file
@@ -1,10 +1,15 @@
 #ifndef MEMORY_HIERARCHY
 #define MEMORY_HIERARCHY
 
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "inc_all.h"
 #include "event_engine.h"
+#include "parallel_engine.h"
 #include "cfg_loader.h"
 #include "ooo_cpu.h"
 
@@ -14,8 +19,6 @@ struct MemoryConfig;
 struct MemoryEventData;
 struct MemoryAccessInfo;
 struct CPUEventData;
-class CacheBlockBase;
-class CacheBlockFactoryInterace;
 class CacheSet;
 class CRPolicyInterface;
 class MemoryInterface;
@@ -34,8 +37,33 @@ enum CR_POLICY {
   LIP_POLICY,
   BIP_POLICY,
   DIP_POLICY,
+  SRRIP_POLICY,
+  BRRIP_POLICY,
+  DRRIP_POLICY,
+  SHIP_POLICY,
+  OPT_POLICY,
+  HAWKEYE_POLICY,
+  TADIP_I_POLICY,
+  TADIP_F_POLICY,
   POLICY_CNT
 };
+
+enum CACHE_ORGANIZATION {
+  // ways of a set are searched and ordered by scanning them
+  SET_ORGANIZATION,
+  // hash index and recency list per set, see HashedCacheUnit
+  HASHED_ORGANIZATION
+};
+
+// how SHiP and Hawkeye hash the PC of an access into a signature
+enum SIGNATURE_HASH {
+  // xor of the PC bits, a signature wide piece at a time
+  FOLD_SIGNATURE,
+  // Fibonacci hashing, the high bits of the product
+  MULTIPLY_SIGNATURE,
+  // the low bits of the PC
+  LOW_SIGNATURE
+};
 /**************************************************************************/
 
 /*********************************  DTO   ********************************/
@@ -52,31 +80,60 @@ struct MemoryConfig {
   u32           blk_size;
   u64           sets;
   CR_POLICY     policy_type;
-
-  MemoryConfig() {};
-  MemoryConfig(u8 priority_, u32 latency_) : priority(priority_), latency(latency_) {};
+  // entries of the mshr table
+  u32           mshrs;
+  CACHE_ORGANIZATION  organization;
+  // SHiP and Hawkeye only
+  u32           predictor_entries = DEFAULT_PREDICTOR_ENTRIES;
+  SIGNATURE_HASH signature_hash = FOLD_SIGNATURE;
+  u32           sampled_sets = DEFAULT_SAMPLED_SETS;
+
+  MemoryConfig() : mshrs(DEFAULT_MSHR_ENTRIES), organization(SET_ORGANIZATION) {};
+  MemoryConfig(u8 priority_, u32 latency_) : priority(priority_), latency(latency_),
+               mshrs(DEFAULT_MSHR_ENTRIES), organization(SET_ORGANIZATION) {};
   MemoryConfig(u8 priority_, u32 latency_, u32 ways_, u32 blk_size_, u64 sets_, 
-               CR_POLICY policy_type_) : priority(priority_), latency(latency_), 
-               ways(ways_), blk_size(blk_size_), sets(sets_), policy_type(policy_type_) {};
+               CR_POLICY policy_type_, u32 mshrs_ = DEFAULT_MSHR_ENTRIES,
+               CACHE_ORGANIZATION organization_ = SET_ORGANIZATION) :
+               priority(priority_), latency(latency_), ways(ways_), blk_size(blk_size_),
+               sets(sets_), policy_type(policy_type_), mshrs(mshrs_),
+               organization(organization_) {};
   MemoryConfig(const CacheNodeCfg cfg, u32 priority_);
   MemoryConfig(const MemoryNodeCfg cfg, u32 priority_);
 };
 
+// the position of an access among the memory references of its trace (see
+// count_references), for the policies knowing the future of the trace
+const u64 NO_REFERENCE = ~0ULL;
+
 struct MemoryEventData : public EventDataBase {
   u64 addr;
   u64 PC;
   u8  Pid;
-
-  MemoryEventData(u64 addr_, u64 PC_, u8 Pid_) : addr(addr_), PC(PC_), Pid(Pid_) {};
+  u64 ref;
+  // index of the requesting unit among the previous units of the receiver
+  u8  requester;
+  // arrived data of a completed miss covers the 2^line_bits bytes block of
+  // addr, 0 for a hit (only addr)
+  u8  line_bits;
+
+  MemoryEventData(u64 addr_, u64 PC_, u8 Pid_, u64 ref_ = NO_REFERENCE)
+      : addr(addr_), PC(PC_), Pid(Pid_), ref(ref_), requester(0), line_bits(0) {};
   MemoryEventData(const MemoryAccessInfo &info);
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+
+  POOL_ALLOCATED(MemoryEventData)
 };
 
 struct MemoryAccessInfo {
   u64 addr;
   u64 PC;
   u8  Pid;
+  u64 ref;
 
-  MemoryAccessInfo(u64 addr_, u64 PC_, u8 Pid_) : addr(addr_), PC(PC_), Pid(Pid_) {};
+  MemoryAccessInfo(u64 addr_, u64 PC_, u8 Pid_, u64 ref_ = NO_REFERENCE)
+      : addr(addr_), PC(PC_), Pid(Pid_), ref(ref_) {};
   MemoryAccessInfo(const MemoryEventData &data);
 };
 
@@ -84,63 +141,31 @@ struct MemoryAccessInfo {
 
 
 /********************************  Objects ********************************/
-class CacheBlockBase {
- protected:
-  u64             _addr; 
-  u32             _blk_size;       // length of the block
-  u64             _tag;
-  u8              _pid;
-
-  CacheBlockBase() {};
-
- public:
-  CacheBlockBase(u64 addr, u32 blk_size, u64 tag, u8 pid):
-      _addr(addr), _blk_size(blk_size), _tag(tag), _pid(pid) {
-        assert(is_power_of_two(blk_size));
-      } 
-
-  CacheBlockBase(const CacheBlockBase &other): 
-      _addr(other._addr), _blk_size(other._blk_size), _tag(other._blk_size) {};
-
-  virtual ~CacheBlockBase() {};
-
-  inline u64 get_addr() {
-    return _addr;
-  }
-
-  inline u32 get_blk_size() {
-    return _blk_size;
-  }
-
-  inline u64 get_tag() {
-    return _tag;
-  }
-
-  inline u64 get_pid() {
-    return _pid;
-  }
-};
-
-class CacheBlockFactoryInterace{
- public:
-  CacheBlockFactoryInterace() {};
-  virtual ~CacheBlockFactoryInterace() {};
-  virtual CacheBlockBase* create(u64 tag, u64 blk_size, const MemoryAccessInfo &info) = 0;
-};
-
 class CRPolicyInterface {
- protected:
-  CacheBlockFactoryInterace *_factory;
-
  public:
-  CRPolicyInterface(CacheBlockFactoryInterace *factory): _factory(factory) {};
+  CRPolicyInterface() {};
   virtual ~CRPolicyInterface() {};
   virtual void on_hit(CacheSet *line, u32 pos, const MemoryAccessInfo &info) = 0;
   virtual void on_miss(CacheSet *line, const MemoryAccessInfo &info);
   virtual void on_arrive(CacheSet *line, u64 tag, const MemoryAccessInfo &info) = 0;
+  // set up the per-block state of a new set, default do nothing
+  virtual void init_set(CacheSet *line);
+  // the policy keeps the blocks in LRU order, evicts the LRU block and only
+  // chooses where a new block enters the order, it also runs on the hashed
+  // organization (see HashedCacheUnit). default false
+  virtual bool is_recency_insertion();
+  // the new block of the access enters the set at the MRU position, else at
+  // the LRU position. called once per fill
+  virtual bool insert_at_mru(CacheSet *line, const MemoryAccessInfo &info);
   // some cache replacement policy need to store private information, make the
   // policy unsharable
   virtual bool is_shared();
+  // the private information of unsharable policies for the checkpoint
+  virtual void save(CheckpointWriter &w);
+  virtual void restore(CheckpointReader &r);
+  // the state the policy of the cache ended in, for the report. default
+  // nothing
+  virtual void display(FILE *stream, const string &tag);
 };
 
 class PolicyFactory {
@@ -154,44 +179,178 @@ class PolicyFactory {
   ~PolicyFactory();
 
   CRPolicyInterface* get_policy(const MemoryConfig &config);
+
+  // the per-block states mean the same under both policies (e.g. the LRU
+  // stack of LRU and DIP), blocks restored under another policy keep them
+  static bool is_same_block_state(CR_POLICY a, CR_POLICY b);
+};
+
+
+/*
+ * 地址译码: 地址 = | tag | set号(index) | 块内偏移(offset) |
+ * 各段的移位与掩码在cache构造时计算一次，查找、填充时只做移位与按位与。
+ * 构造函数是constexpr，几何参数为常量时(如 constexpr AddressDecoder d(64, 1024))
+ * 在编译期完成计算
+ */
+class AddressDecoder {
+ private:
+  u32       _offset_bits;
+  u32       _tag_shift;
+  u64       _index_mask;
+
+  static constexpr u32 bits_of(u64 num) {
+    return num <= 1 ? 0 : 1 + bits_of(num >> 1);
+  }
+
+ public:
+  // both are powers of 2
+  constexpr AddressDecoder(u64 blk_size, u64 sets) :
+      _offset_bits(bits_of(blk_size)), _tag_shift(bits_of(blk_size) + bits_of(sets)),
+      _index_mask(sets - 1) {};
+  constexpr AddressDecoder() : AddressDecoder(1, 1) {};
+
+  constexpr u32 get_offset_bits() const {
+    return _offset_bits;
+  }
+
+  constexpr u32 get_tag_shift() const {
+    return _tag_shift;
+  }
+
+  constexpr u64 get_set_no(u64 addr) const {
+    return (addr >> _offset_bits) & _index_mask;
+  }
+
+  constexpr u64 get_tag(u64 addr) const {
+    return addr >> _tag_shift;
+  }
+
+  constexpr u64 get_block_addr(u64 tag, u64 set_no) const {
+    return (tag << _tag_shift) | (set_no << _offset_bits);
+  }
 };
 
+/*
+ * 块元数据阵列(structure of arrays): 一个cache所有块的元数据按值存放在
+ * 同一块连续内存(MemoryRegion)中，各列首地址按64字节对齐，不再为每次填充
+ * 在堆上分配块对象。各列都按 set * stride + way 索引:
+ *   tag   - stride向上取整到TAG_LANES的倍数，每个set的起始地址按32字节对齐，
+ *           查找时用AVX2(4路)或SSE2(2路)一次比较多个way，不支持的平台退化为
+ *           标量循环。无效的way保存INVALID_TAG: 地址至少去掉了块内偏移，任何
+ *           tag都不会是全1，因此有效位与tag在同一次比较中完成
+ *   pid   - 填充该块的进程，用于census
+ *   state - 替换策略私有的每块状态(如LRU栈位置)，由策略通过init_set初始化
+ *           并维护，fill/invalidate不改变它，块填充后不在way之间移动
+ * 块地址由tag与set号还原，不单独保存
+ */
+class BlockArray {
+ private:
+  MemoryRegion  _region;
+  u64*          _tags;
+  u8*           _pids;
+  u32*          _states;
+  u64           _sets;
+  u32           _stride;
+
+  static size_t column_size(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+  }
+
+ public:
+  static const u64 INVALID_TAG = ~0ULL;
+  static const u32 TAG_LANES = 4;
+
+  BlockArray(u64 sets, u32 ways);
+  BlockArray(const BlockArray &) = delete;
+  BlockArray & operator= (const BlockArray &) = delete;
+
+  inline u64* get_tags(u64 set_no) {
+    assert(set_no < _sets);
+    return _tags + set_no * _stride;
+  }
+
+  inline u8* get_pids(u64 set_no) {
+    assert(set_no < _sets);
+    return _pids + set_no * _stride;
+  }
+
+  inline u32* get_states(u64 set_no) {
+    assert(set_no < _sets);
+    return _states + set_no * _stride;
+  }
+
+  inline u32 get_stride() {
+    return _stride;
+  }
+
+  // start loading the tags and states of a set, at most the first two lines
+  // of the tags, a wider set is scanned sequentially
+  inline void prefetch(u64 set_no) {
+    u64 *tags = _tags + set_no * _stride;
+    __builtin_prefetch(tags);
+    if (_stride > 8) {
+      __builtin_prefetch(tags + 8);
+    }
+    __builtin_prefetch(_states + set_no * _stride);
+  }
+
+  inline MemoryRegion& get_region() {
+    return _region;
+  }
+
+  // bytes of the region for the blocks of sets sets
+  static size_t region_size(u64 sets, u32 ways);
+
+  static constexpr u32 stride_of(u32 ways) {
+    return (ways + TAG_LANES - 1) / TAG_LANES * TAG_LANES;
+  }
+
+  // position of the tag among the stride entries of a set, -1 if not found
+  static s32 find(const u64 *tags, u32 stride, u64 tag);
+  // the first empty way among the ways of a set, -1 if the set is full
+  static s32 find_invalid(const u64 *tags, u32 ways, u32 stride);
+  static s32 find_scalar(const u64 *tags, u32 stride, u64 tag);
+};
 
 /**
- * Cache Set, all cache blokcs are stored in vector rather than queue
- * to give more exexpansibility
+ * Cache Set, a view of one set in the block array of the cache. A block
+ * stays in its way until it is evicted, the replacement policies keep
+ * their ordering in the per-block state
  */
 class CacheSet {
  private:
+  // a cache holds one view per set, keep it small
   u32                               _ways;
-  u32                               _blk_size;
-  u32                               _sets;
   u32                               _set_num = 0;   // not necessary, only used for set dueling
-  vector<CacheBlockBase *>          _blocks;
+  u32                               _stride;
+  const AddressDecoder              _decoder;
+  // the columns of this set in the block array of the cache
+  u64 *                             _tags;
+  u8 *                              _pids;
+  u32 *                             _states;
+  // a set outside a cache keeps its own blocks
+  BlockArray *                      _own_blocks;
   CRPolicyInterface *               _cr_policy;
-  // for verbose output
-  string                            _set_tag;
 
   CacheSet() {};                        // forbid default constructor
   CacheSet(const CacheSet&) {};         // forbid copy constructor
 
-  s32 find_pos_by_tag(u64 tag);
+  void init_blocks(BlockArray *blocks, u64 set_no);
 
  public:
-  CacheSet(u32 ways, u32 blk_size, u32 sets, CRPolicyInterface *policy);
-  CacheSet(u32 ways, u32 blk_size, u32 sets, CRPolicyInterface *policy, const string &tag);
+  CacheSet(u32 ways, u32 blk_size, u64 sets, CRPolicyInterface *policy,
+           BlockArray *blocks = NULL, u64 set_no = 0);
+  // a set of a cache, with the decoder of the cache
+  CacheSet(u32 ways, const AddressDecoder &decoder, CRPolicyInterface *policy,
+           BlockArray *blocks, u64 set_no);
   ~CacheSet();
 
-  inline const vector<CacheBlockBase *>& get_all_blocks() {
-    return _blocks;
-  }
-
   inline u32 get_ways() {
     return _ways;
   }
 
   inline u32 get_block_size() {
-    return _blk_size;
+    return 1U << _decoder.get_offset_bits();
   }
 
   inline u32 get_set_num() {
@@ -200,17 +359,66 @@ class CacheSet {
 
   void set_set_num(u32 set_num);
 
-  u64 calulate_tag(u64 addr);
+  inline u64 calulate_tag(u64 addr) {
+    return _decoder.get_tag(addr);
+  }
+
+  inline bool is_valid(u32 pos) {
+    assert(pos < _ways);
+    return _tags[pos] != BlockArray::INVALID_TAG;
+  }
+
+  inline u64 get_tag(u32 pos) {
+    assert(pos < _ways);
+    return _tags[pos];
+  }
+
+  inline u8 get_pid(u32 pos) {
+    assert(pos < _ways);
+    return _pids[pos];
+  }
+
+  inline u32 get_state(u32 pos) {
+    assert(pos < _ways);
+    return _states[pos];
+  }
+
+  inline void set_state(u32 pos, u32 state) {
+    assert(pos < _ways);
+    _states[pos] = state;
+  }
+
+  // the per-block state of all ways, for policies that scan it
+  inline u32* get_states() {
+    return _states;
+  }
+
+  // the ways padded to the lanes of the block array, the states of the
+  // padding stay 0
+  inline u32 get_stride() {
+    return _stride;
+  }
+
+  s32 find_pos_by_tag(u64 tag);
+  // block address rebuilt from the tag and the set number
+  u64 get_addr(u32 pos);
+  // the first empty way, -1 if the set is full
+  s32 find_invalid();
 
-  // can evict an empty
-  void evict_by_pos(u32 pos, CacheBlockBase *blk, bool is_delete = true);
-  CacheBlockBase* get_block_by_pos(u32 pos);
+  // replace the block at pos (can be empty) with the new block
+  void fill(u32 pos, u64 tag, const MemoryAccessInfo &info);
+  void invalidate(u32 pos);
 
   bool try_access_memory(const MemoryAccessInfo &info);
   void on_memory_arrive(const MemoryAccessInfo &info);
+  // lookup without touching the replacement state
+  bool contains(u64 addr);
 
   void print_blocks(FILE* fs);
   void pid_census(vector<u32> &table);
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 class MemoryInterface : public EventHandler {
@@ -221,16 +429,151 @@ class MemoryInterface : public EventHandler {
   MemoryInterface(const string &tag) : EventHandler(tag) {};
 };
 
+/*
+ * MSHR(miss status holding registers): 单元中未完成的miss，每个块(line)一项，
+ * 以 块地址 = addr >> line bits 为键。同一块的后续miss(secondary miss)只把
+ * 请求的上级单元记入已有表项，不再向下级发送；数据送达时完成整个表项。
+ * 表项数固定，槽按LinearProbing组织，插入、删除都不分配内存。
+ * 表满时新的访问阻塞(见MemoryUnit::_blocked)，直到有表项释放
+ */
+struct MSHREntry {
+  // block address, INVALID_LINE for a free slot
+  u64   line;
+  // bitmask of the previous units waiting for the block
+  u64   waiters;
+  // the primary miss, sent to the next unit
+  u64   addr;
+  u64   PC;
+  u8    Pid;
+  u64   ref;
+};
+
+class MSHRTable {
+ private:
+  // the slots of LinearProbing, keyed by the line
+  struct SlotOps {
+    inline bool is_free(const MSHREntry &e) const {
+      return e.line == INVALID_LINE;
+    }
+    inline u64 key_of(const MSHREntry &e) const {
+      return e.line;
+    }
+    inline void clear(MSHREntry &e) const {
+      e = {INVALID_LINE, 0, 0, 0, 0, NO_REFERENCE};
+    }
+  };
+
+  vector<MSHREntry>   _slots;
+  u32                 _bits;
+  u32                 _capacity;
+  u32                 _size;
+  u32                 _line_bits;
+
+  // statistics
+  u64                 _misses;        // entries allocated (primary misses)
+  u64                 _merged;        // secondary misses merged into an entry
+  u64                 _stalls;        // accesses blocked by a full table
+  u64                 _occupancy;     // sum of the entries in use at each allocation
+  u32                 _peak;
+
+ public:
+  static const u64 INVALID_LINE = ~0ULL;
+
+  explicit MSHRTable(u32 capacity);
+
+  inline u64 line_of(u64 addr) {
+    return addr >> _line_bits;
+  }
+
+  inline u32 get_line_bits() {
+    return _line_bits;
+  }
+
+  inline void set_line_bits(u32 bits) {
+    assert(_size == 0);
+    _line_bits = bits;
+  }
+
+  inline u32 get_capacity() {
+    return _capacity;
+  }
+
+  inline u32 size() {
+    return _size;
+  }
+
+  inline bool empty() {
+    return _size == 0;
+  }
+
+  inline bool full() {
+    return _size == _capacity;
+  }
+
+  // the entry of the block, NULL if there is no outstanding miss to it
+  MSHREntry* find(u64 line);
+  // a new entry for the primary miss, the table must not be full
+  MSHREntry* allocate(u64 line, const MemoryEventData &data, u64 waiters);
+  // free the entry, the pointers to other entries are invalidated
+  void release(MSHREntry *entry);
+
+  inline void count_merge() {
+    _merged++;
+  }
+
+  inline void count_stall() {
+    _stalls++;
+  }
+
+  inline u64 get_misses() {
+    return _misses;
+  }
+
+  inline u64 get_merged() {
+    return _merged;
+  }
+
+  inline u64 get_stalls() {
+    return _stalls;
+  }
+
+  inline u32 get_peak() {
+    return _peak;
+  }
+
+  inline size_t get_footprint() {
+    return _slots.size() * sizeof(MSHREntry);
+  }
+
+  // mean entries in use seen by a primary miss, itself included
+  inline double get_mean_occupancy() {
+    return _misses ? (double)_occupancy / _misses : 0;
+  }
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+};
+
 class MemoryUnit : public MemoryInterface {
  private:
   // for LLC there are multiple previous memory units
   vector<MemoryUnit*>     _prev_units;
   MemoryUnit *            _next_unit;
   
-  // since there could be more than one previous memory units
-  // we store all pending address to identify if need process a 
-  // memory on arrive event
-  unordered_set<u64>      _pending_refs;
+  // index of this unit among the previous units of the next unit
+  u8                      _prev_index;
+
+  // outstanding misses, the arrived data only goes to the previous units
+  // waiting for it instead of all previous units
+  MSHRTable               _mshr;
+  // accesses that found the mshr table full, replayed in order as entries
+  // are released
+  deque<MemoryEventData*> _blocked;
+  // MemoryOnArrive events not sent to previous units that did not ask
+  u64                     _saved_events;
+
+  void access(u64 tick, MemoryEventData *memory_data);
+  void send_arrive(const MemoryEventData &data, u64 waiters);
 
  protected:
   // for event engine
@@ -240,11 +583,23 @@ class MemoryUnit : public MemoryInterface {
   void proc(u64 tick, EventDataBase* data, EventType type);
   bool validate(EventType type);
 
+  // statically dispatched event handlers
+  void handle_MemoryOnAccess(u64 tick, EventDataBase* data);
+  void handle_MemoryOnArrive(u64 tick, EventDataBase* data);
+  static u32 dispatch_kind();
+
+  inline bool has_pending() {
+    return !_mshr.empty();
+  }
+
  public:
-  MemoryUnit(string tag, u32 latency, u8 priority) : MemoryInterface(tag),
-    _next_unit(NULL), _latency(latency), _priority(priority) {};
+  MemoryUnit(string tag, u32 latency, u8 priority, u32 mshrs = DEFAULT_MSHR_ENTRIES) :
+    MemoryInterface(tag), _next_unit(NULL), _prev_index(0), _mshr(mshrs),
+    _saved_events(0), _latency(latency), _priority(priority) {
+    set_kind(dispatch_kind());
+  };
 
-  virtual ~MemoryUnit(){};
+  virtual ~MemoryUnit();
 
   inline u32 get_latency() {
     return _latency;
@@ -254,29 +609,80 @@ class MemoryUnit : public MemoryInterface {
     return _priority;
   }
 
+  inline void set_priority(u8 priority) {
+    assert(priority < PRIORITY_LIMIT);
+    _priority = priority;
+  }
+
   inline void add_prev(MemoryUnit *p) {
+    assert(_prev_units.size() < 64);
+    p->_prev_index = _prev_units.size();
     _prev_units.push_back(p);
   }
 
   inline void set_next(MemoryUnit *n) {
     _next_unit = n;
   }
+
+  inline MemoryUnit* get_next() {
+    return _next_unit;
+  }
+
+  inline const vector<MemoryUnit*>& get_prevs() {
+    return _prev_units;
+  }
+
+  inline u64 get_saved_events() {
+    return _saved_events;
+  }
+
+  // misses are merged per 2^line_bits bytes, the block size of a cache and
+  // single addresses elsewhere
+  inline u32 get_line_bits() {
+    return _mshr.get_line_bits();
+  }
+
+  inline void set_line_bits(u32 bits) {
+    _mshr.set_line_bits(bits);
+  }
+
+  inline MSHRTable& get_mshr() {
+    return _mshr;
+  }
+
+  // serve the access at once if it is a hit that no outstanding miss of the
+  // unit can affect, false leaves the unit untouched
+  virtual bool try_fast_hit(const MemoryAccessInfo &info);
+
+  virtual void save(CheckpointWriter &w);
+  virtual void restore(CheckpointReader &r);
 };
 
 class CacheUnit: public MemoryUnit {
- private:
+ protected:
   // for memory
   u32                             _ways;
   u32                             _blk_size;
   u64                             _sets;
+  CR_POLICY                       _policy_type;
+  CACHE_ORGANIZATION              _organization;
   CRPolicyInterface *             _cr_policy;
-  vector<CacheSet*>               _cache_sets;
+  AddressDecoder                  _decoder;
+  BlockArray *                    _blocks;
+  // the views of all sets, constructed in place in one region
+  MemoryRegion *                  _sets_region;
+  CacheSet *                      _cache_sets;
+  MemoryStats *                   _stats;
 
- protected:
   bool try_access_memory(const MemoryAccessInfo &info);
   void on_memory_arrive(const MemoryAccessInfo &info);
+  // start loading the metadata an access of addr in the set will touch
+  virtual void prefetch_set(u64 set_no, u64 addr);
 
  public:
+  // accesses of a batch are prefetched this many accesses ahead
+  static const u32 BATCH_PREFETCH_DISTANCE = 8;
+
   CacheUnit(const string &tag, const MemoryConfig &config);
   ~CacheUnit ();
 
@@ -292,9 +698,27 @@ class CacheUnit: public MemoryUnit {
     return _cr_policy;
   }
 
-  u64 get_set_no(u64 addr);
+  inline u64 get_set_no(u64 addr) {
+    return _decoder.get_set_no(addr);
+  }
 
   void pid_census(vector<u32> &table);
+  bool try_fast_hit(const MemoryAccessInfo &info);
+
+  // functional (untimed) accesses, served in order as try_access_memory and,
+  // for a miss, on_memory_arrive at once. the metadata of the access
+  // BATCH_PREFETCH_DISTANCE ahead is prefetched. hits[i] (if not NULL) tells
+  // whether accesses[i] hit, returns the hits
+  u64 access_batch(const MemoryAccessInfo *accesses, size_t n, bool *hits = NULL);
+
+  // bytes the simulator holds for the cache
+  size_t get_block_footprint();
+  size_t get_set_footprint();
+  size_t get_mshr_footprint();
+  bool is_thp_requested();
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 /**
@@ -310,8 +734,13 @@ class MainMemory: public MemoryUnit {
   MainMemory(const string &tag, const MemoryConfig &config);
 };
 
-// todo: for shared cache
-class MemoryStats {
+/*
+ * 每个cache的命中/缺失计数，恰好占一个cache line并按cache line对齐，
+ * 并行仿真时不同逻辑进程(线程)更新的计数不会共享cache line。
+ * cache在构造时从MemoryStatsManager取得指针并一直持有，访问路径上不再
+ * 按名字查找，汇总只在输出报告时进行
+ */
+class alignas(64) MemoryStats {
  private:
   u64 _misses[4];
   u64 _hits[4];
@@ -337,25 +766,40 @@ class MemoryStats {
 
   void display(FILE *stream, const string &tag);
   void clear();
+  bool is_empty();
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
-class CensusTaker : public EventHandler {
+static_assert(sizeof(MemoryStats) == 64, "the stats of a unit fill one cache line");
+
+/*
+ * 统计LLC中各进程占用的cache block数量，在tick边界上(tick hook)进行，
+ * 不再占用事件队列
+ */
+class CensusTaker {
  private:
   u64                   _period;
+  u64                   _next;
   FILE*                 _file;
-  bool                  _shutdown;
+  // the first tick a cpu finished, no census after it
+  atomic<u64>           _shutdown_tick;
   vector<CacheUnit *>   _llcs;
 
- protected:
-  void proc(u64 tick, EventDataBase* data, EventType type);
-  bool validate(EventType type);
+  void on_tick(u64 tick);
+  void take_census(u64 tick);
 
  public:
-  CensusTaker() : EventHandler("CensusTaker"){};
+  CensusTaker() : _period(0), _next(0), _file(NULL), _shutdown_tick(~0ULL) {};
   ~CensusTaker() {};
   void init(u64 period, FILE *file);
-  void shutdown();
+  void shutdown(u64 tick);
   void register_llc(CacheUnit *c);
+  bool is_registered(CacheUnit *c);
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 class MemoryStatsManager {
@@ -366,29 +810,70 @@ class MemoryStatsManager {
   MemoryStatsManager() {};
   ~MemoryStatsManager();
 
+  // the handler is created on first use and lives as long as the manager
   MemoryStats* get_stats_handler(const string &tag);
   void display_all(FILE *stream);
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 class CpuConnector: public MemoryUnit {
  private:
-  vector<u64>             _traces;
+  // accesses of a mock trace, with their PCs
+  vector<MemoryAccessInfo> _traces;
   u32                     _idx;
-  unordered_set<u64>      _pending_refs;
+  // addresses the waiting instruction still needs, a few per instruction
+  vector<u64>             _waiting_refs;
   CPUEventData            *_waiting_event_data;
   SequentialCPU           *_cpu_ptr;
 
+  // L1 hit fast path, see issue_memory_access
+  bool                    _fast_path;
+  // MemoryOnAccess events to this connector not processed yet
+  u32                     _queued;
+  // lines served by the fast path and the tick they would have arrived
+  vector<pair<u64, s64> > _fast_refs;
+  // the latest arrival of the fast accesses of the waiting instruction
+  s64                     _fast_ready;
+  u64                     _fast_hits;
+
+  bool try_fast_access(const MemoryAccessInfo &info, s64 tick);
+
  protected:
   bool try_access_memory(const MemoryAccessInfo &info);
   void on_memory_arrive(const MemoryAccessInfo &info);
+  void proc(u64 tick, EventDataBase* data, EventType type);
+
+  void handle_MemoryOnAccess(u64 tick, EventDataBase* data);
+  void handle_MemoryOnArrive(u64 tick, EventDataBase* data);
+  static u32 dispatch_kind();
 
  public:
   CpuConnector(const string &tag, u8 id);
   ~CpuConnector();
-  void set_tracer(const vector<u64> &traces);
+  void set_tracer(const vector<MemoryAccessInfo> &traces);
   void issue_memory_access();
   void issue_memory_access(const MemoryAccessInfo &info, CPUEventData *);
+  // all memory accesses of the instruction are issued, schedules the
+  // execution if they were all served by the fast path
+  void end_issue(CPUEventData *event_data);
   void start();
+
+  inline SequentialCPU* get_cpu() {
+    return _cpu_ptr;
+  }
+
+  inline void set_fast_path(bool enable) {
+    _fast_path = enable;
+  }
+
+  inline u64 get_fast_hits() {
+    return _fast_hits;
+  }
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 //  void proc(u64 tick, EventDataBase* data, EventType type);
 };
 
@@ -405,7 +890,7 @@ class OoOCpuConnector: public MemoryUnit {
  public:
   OoOCpuConnector(const string &tag, u8 id);
   virtual ~OoOCpuConnector();
-  void set_tracer(const vector<u64> &traces);
+  void set_tracer(const vector<MemoryAccessInfo> &traces);
   void issue_memory_access(const MemoryAccessInfo &info, CPUEventData *);
   void start();
 //  void proc(u64 tick, EventDataBase* data, EventType type);
@@ -416,15 +901,60 @@ class PipeLineBuilder {
  private:
   map<string, BaseNodeCfg*>   _nodes_cfg;
   map<string, MemoryUnit*>   _nodes;
+  bool                       _fast_path;
+  bool                       _batching;
+  bool                       _kernels;
+  u32                        _kernel_caches;
+  // the priorities of the units and cpus are given per cpu, see
+  // order_cpu_events
+  bool                       _prioritized;
+  bool                       _cpu_ordered;
+  // units and cpus in a fixed order, events refer to them by index in the
+  // checkpoint
+  vector<EventHandler*>      _handlers;
 
   MemoryUnit* create_node(BaseNodeCfg *cfg, u8 level);
+  const vector<EventHandler*>& get_handlers();
+  bool order_cpu_events(const vector<CpuConnector*> &cpus,
+                        const map<MemoryUnit*, set<u32> > &owners);
 
  public:
-  PipeLineBuilder() {};
+  PipeLineBuilder() : _fast_path(true), _batching(true), _kernels(true),
+                      _kernel_caches(0), _prioritized(false), _cpu_ordered(false) {};
   void load(const map<string, BaseNodeCfg*> &nodes_map);
   ~PipeLineBuilder();
 
   vector<CpuConnector* > get_connectors();
+  // MemoryOnArrive events saved by sending data only to the requesters
+  u64 get_saved_events();
+  // L1 hits served without events
+  u64 get_fast_hits();
+  // allow the L1 hit fast path for the connectors created afterwards
+  void set_fast_path(bool enable) { _fast_path = enable; }
+  // non-memory instructions consumed in batches
+  u64 get_batched();
+  // allow the cpus created afterwards to batch non-memory instructions
+  void set_batching(bool enable) { _batching = enable; }
+  // caches created with a compile-time specialized kernel
+  u32 get_kernel_caches() { return _kernel_caches; }
+  // allow kernels for the caches created afterwards
+  void set_kernels(bool enable) { _kernels = enable; }
+  // occupancy, merged misses and stalls of the mshr table of each cache
+  void display_mshr(FILE *stream);
+  // memory the simulator holds for each cache
+  void display_footprint(FILE *stream);
+  // the policies of the caches
+  void display_policies(FILE *stream);
+  // split the created units into logical processes for the parallel
+  // simulation, false if the pipeline can not be simulated in parallel
+  bool partition(LPLayout &layout);
+
+  // state of the units and cpus, the pipeline is built from the same
+  // configuration before restore
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+  void save_event(CheckpointWriter &w, Event *e);
+  Event* load_event(CheckpointReader &r);
 };
 
 /**************************************************************************/
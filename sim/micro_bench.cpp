@@ -0,0 +1,570 @@
+#include "event_engine.h"
+#include "memory_hierarchy.h"
+#include "cache_kernel.h"
+
+#include <chrono>
+
+using namespace std::chrono;
+
+static u64 xorshift(u64 &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// latency distribution close to the simulator: most events are
+// scheduled within a few cycles, some after L2/main memory latency
+static u32 random_delay(u64 &state) {
+  u32 r = xorshift(state) % 10;
+  if (r < 4) return r % 2;
+  else if (r < 7) return 10;
+  else if (r < 9) return 100;
+  else return 1000;
+}
+
+/*
+ * hold model: every executed event schedules a new one, keeping
+ * a constant number of events in flight
+ */
+template <typename Engine>
+class HoldHandler: public EventHandler {
+ private:
+  Engine*   _engine;
+  u64       _state;
+  u64       _budget;
+
+ protected:
+  bool validate(EventType type) {
+    (void)type;
+    return true;
+  }
+
+  void proc(u64 tick, EventDataBase* data, EventType type) {
+    (void)type;
+    handle_hold(tick, data);
+  }
+
+  void handle_hold(u64 tick, EventDataBase* data) {
+    (void)tick, (void)data;
+    if (_budget == 0) {
+      return;
+    }
+    _budget--;
+    schedule();
+  }
+
+  static u32 dispatch_kind() {
+    static const u32 kind = []() {
+      u32 k = EventDispatcher::new_kind();
+      EventDispatcher::bind<HoldHandler, &HoldHandler::handle_hold>(k, MemoryOnAccess);
+      EventDispatcher::bind<HoldHandler, &HoldHandler::handle_hold>(k, MemoryOnArrive);
+      return k;
+    }();
+    return kind;
+  }
+
+ public:
+  HoldHandler(Engine *engine, u64 budget, bool static_dispatch) :
+      EventHandler("hold"), _engine(engine), _state(88172645463325252ULL),
+      _budget(budget) {
+    if (static_dispatch) {
+      set_kind(dispatch_kind());
+    }
+  };
+
+  void schedule() {
+    EventType type = (xorshift(_state) & 1) ? MemoryOnAccess : MemoryOnArrive;
+    Event *e = new Event(type, this, NULL);
+    _engine->register_after_now(e, random_delay(_state), xorshift(_state) % 4);
+  }
+};
+
+template <typename Engine>
+static double bench_engine(u32 population, u64 events, bool static_dispatch) {
+  Engine engine;
+  HoldHandler<Engine> handler(&engine, events, static_dispatch);
+  for (u32 i = 0; i < population; i++) {
+    handler.schedule();
+  }
+
+  auto start = steady_clock::now();
+  u64 executed = 0;
+  while (engine.loop()) {
+    executed++;
+  }
+  double sec = duration<double>(steady_clock::now() - start).count();
+  return executed / sec;
+}
+
+static void bench_event_engine(u32 population, u64 events) {
+  double map_rate = bench_engine<MultimapEventEngine>(population, events, false);
+  double wheel_rate = bench_engine<EventEngine>(population, events, false);
+  printf("event engine, %u events in flight, %llu events\n", population, events);
+  printf("\tmultimap:\t%.2f Mevents/s\n", map_rate / 1e6);
+  printf("\ttiming wheel:\t%.2f Mevents/s\n", wheel_rate / 1e6);
+  printf("\tspeedup:\t%.2fx\n", wheel_rate / map_rate);
+}
+
+/*
+ * a handler with two event types, dispatched either through the virtual
+ * proc_event/validate/proc chain or through the EventDispatcher table
+ */
+class CountingHandler: public EventHandler {
+ private:
+  u64     _count;
+
+ protected:
+  bool validate(EventType type) {
+    return (type == MemoryOnAccess) || (type == MemoryOnArrive);
+  }
+
+  void proc(u64 tick, EventDataBase* data, EventType type) {
+    switch (type) {
+      case MemoryOnAccess:
+        handle_MemoryOnAccess(tick, data);
+        break;
+      case MemoryOnArrive:
+        handle_MemoryOnArrive(tick, data);
+        break;
+      default:
+        assert(0);
+    }
+  }
+
+  void handle_MemoryOnAccess(u64 tick, EventDataBase* data) {
+    (void)data;
+    _count += tick;
+  }
+
+  void handle_MemoryOnArrive(u64 tick, EventDataBase* data) {
+    (void)data;
+    _count ^= tick;
+  }
+
+  static u32 dispatch_kind() {
+    static const u32 kind = []() {
+      u32 k = EventDispatcher::new_kind();
+      EventDispatcher::bind<CountingHandler, &CountingHandler::handle_MemoryOnAccess>(k, MemoryOnAccess);
+      EventDispatcher::bind<CountingHandler, &CountingHandler::handle_MemoryOnArrive>(k, MemoryOnArrive);
+      return k;
+    }();
+    return kind;
+  }
+
+ public:
+  CountingHandler(bool static_dispatch) : EventHandler("counting"), _count(0) {
+    if (static_dispatch) {
+      set_kind(dispatch_kind());
+    }
+  }
+
+  inline u64 get_count() {
+    return _count;
+  }
+};
+
+static double bench_dispatch_only(u64 events, bool static_dispatch) {
+  CountingHandler handler(static_dispatch);
+  Event *e[2] = {new Event(MemoryOnAccess, &handler, NULL),
+                 new Event(MemoryOnArrive, &handler, NULL)};
+
+  auto start = steady_clock::now();
+  for (u64 i = 0; i < events; i++) {
+    e[i & 1]->execute(i);
+  }
+  double sec = duration<double>(steady_clock::now() - start).count();
+  // keep the result alive
+  if (handler.get_count() == 1) printf(" ");
+  delete e[0];
+  delete e[1];
+  return events / sec;
+}
+
+static void bench_dispatch(u32 population, u64 events) {
+  double virtual_rate = bench_dispatch_only(events * 10, false);
+  double static_rate = bench_dispatch_only(events * 10, true);
+  printf("event dispatch only, %llu events\n", events * 10);
+  printf("\tvirtual:\t%.2f Mevents/s\n", virtual_rate / 1e6);
+  printf("\tstatic:\t\t%.2f Mevents/s\n", static_rate / 1e6);
+  printf("\tspeedup:\t%.2fx\n", static_rate / virtual_rate);
+
+  virtual_rate = bench_engine<EventEngine>(population, events, false);
+  static_rate = bench_engine<EventEngine>(population, events, true);
+  printf("event dispatch through the engine, %u events in flight, %llu events\n",
+         population, events);
+  printf("\tvirtual:\t%.2f Mevents/s\n", virtual_rate / 1e6);
+  printf("\tstatic:\t\t%.2f Mevents/s\n", static_rate / 1e6);
+  printf("\tspeedup:\t%.2fx\n", static_rate / virtual_rate);
+}
+
+/*
+ * the heap block every fill allocated before the block array, kept here to
+ * compare against
+ */
+class HeapBlock {
+ public:
+  u64             _addr;
+  u32             _blk_size;
+  u64             _tag;
+  u8              _pid;
+
+  HeapBlock(u64 addr, u32 blk_size, u64 tag, u8 pid):
+      _addr(addr), _blk_size(blk_size), _tag(tag), _pid(pid) {};
+  virtual ~HeapBlock() {};
+};
+
+/*
+ * tag lookup of a large cache: the heap blocks walked through pointers (the
+ * layout before the tag array) against the tag array, scalar and SIMD
+ */
+static const u32 LOOKUP_WAYS = 16;
+static const u64 LOOKUP_SETS = 16384;
+
+template <typename Fn>
+static double bench_lookup(u64 lookups, Fn lookup) {
+  u64 state = 88172645463325252ULL;
+  s64 found = 0;
+  auto start = steady_clock::now();
+  for (u64 i = 0; i < lookups; i++) {
+    u64 r = xorshift(state);
+    found += lookup(r % LOOKUP_SETS, (r >> 32) % (LOOKUP_WAYS * 2));
+  }
+  double sec = duration<double>(steady_clock::now() - start).count();
+  // keep the result alive
+  if (found == 1) printf(" ");
+  return lookups / sec;
+}
+
+static void bench_tag_lookup(u64 lookups) {
+  vector<vector<HeapBlock *> > blocks(LOOKUP_SETS);
+  BlockArray tags(LOOKUP_SETS, LOOKUP_WAYS);
+  u32 stride = tags.get_stride();
+  for (u64 s = 0; s < LOOKUP_SETS; s++) {
+    for (u32 w = 0; w < LOOKUP_WAYS; w++) {
+      // half of the lookups miss, a few ways are empty
+      if (w % 7 == 6) {
+        blocks[s].push_back(NULL);
+        continue;
+      }
+      blocks[s].push_back(new HeapBlock(w, 64, w, 0));
+      tags.get_tags(s)[w] = w;
+    }
+  }
+
+  double pointer_rate = bench_lookup(lookups, [&](u64 s, u64 tag) -> s32 {
+    auto &set = blocks[s];
+    for (u32 i = 0; i < LOOKUP_WAYS; i++) {
+      if (set[i] != NULL && set[i]->_tag == tag) {
+        return i;
+      }
+    }
+    return -1;
+  });
+  double scalar_rate = bench_lookup(lookups, [&](u64 s, u64 tag) {
+    return BlockArray::find_scalar(tags.get_tags(s), stride, tag);
+  });
+  double simd_rate = bench_lookup(lookups, [&](u64 s, u64 tag) {
+    return BlockArray::find(tags.get_tags(s), stride, tag);
+  });
+
+  printf("tag lookup, %llu sets x %u ways, %llu lookups\n", LOOKUP_SETS, LOOKUP_WAYS, lookups);
+  printf("\tblock pointers:\t%.2f Mlookups/s\n", pointer_rate / 1e6);
+  printf("\ttag array:\t%.2f Mlookups/s\n", scalar_rate / 1e6);
+  printf("\ttag array simd:\t%.2f Mlookups/s\n", simd_rate / 1e6);
+  printf("\tspeedup:\t%.2fx\n", simd_rate / pointer_rate);
+
+  for (auto &set: blocks) {
+    for (auto blk: set) {
+      delete blk;
+    }
+  }
+}
+
+/*
+ * LRU fills into full sets: a heap block allocated per fill and freed per
+ * eviction against the blocks stored by value in the block array
+ */
+static void bench_fill(u64 fills) {
+  vector<vector<HeapBlock *> > heap_sets(LOOKUP_SETS, vector<HeapBlock *>(LOOKUP_WAYS, NULL));
+  u64 state = 88172645463325252ULL;
+  auto start = steady_clock::now();
+  for (u64 i = 0; i < fills; i++) {
+    u64 r = xorshift(state);
+    auto &set = heap_sets[r % LOOKUP_SETS];
+    HeapBlock *cand = new HeapBlock(r, 64, r >> 20, 0);
+    for (u32 w = 0; w < LOOKUP_WAYS; w++) {
+      swap(cand, set[w]);
+    }
+    delete cand;
+  }
+  double heap_rate = fills / duration<double>(steady_clock::now() - start).count();
+
+  MemoryConfig cfg(0, 0, 0, 0, 0, LRU_POLICY);
+  CRPolicyInterface *lru = PolicyFactoryObj::get_instance()->get_policy(cfg);
+  BlockArray blocks(LOOKUP_SETS, LOOKUP_WAYS);
+  vector<CacheSet *> sets;
+  for (u64 s = 0; s < LOOKUP_SETS; s++) {
+    sets.push_back(new CacheSet(LOOKUP_WAYS, 64, LOOKUP_SETS, lru, &blocks, s));
+  }
+  state = 88172645463325252ULL;
+  start = steady_clock::now();
+  for (u64 i = 0; i < fills; i++) {
+    u64 r = xorshift(state);
+    sets[r % LOOKUP_SETS]->on_memory_arrive(MemoryAccessInfo(r, 0, 0));
+  }
+  double array_rate = fills / duration<double>(steady_clock::now() - start).count();
+
+  // pointer, heap block with the allocator header, tag array entry
+  u64 heap_bytes = sizeof(HeapBlock *) + sizeof(HeapBlock) + 16 + sizeof(u64);
+  u64 array_bytes = (blocks.get_stride() * (sizeof(u64) + sizeof(u8) + sizeof(u32)) + LOOKUP_WAYS - 1) / LOOKUP_WAYS;
+  printf("LRU fill, %llu sets x %u ways, %llu fills\n", LOOKUP_SETS, LOOKUP_WAYS, fills);
+  printf("\theap blocks:\t%.2f Mfills/s, %llu bytes per block\n", heap_rate / 1e6, heap_bytes);
+  printf("\tblock array:\t%.2f Mfills/s, %llu bytes per block\n", array_rate / 1e6, array_bytes);
+  printf("\tspeedup:\t%.2fx\n", array_rate / heap_rate);
+
+  for (auto &set: heap_sets) {
+    for (auto blk: set) {
+      delete blk;
+    }
+  }
+  for (auto set: sets) {
+    delete set;
+  }
+}
+
+/*
+ * set number and tag of an address: the shifts found by len_of_binary on
+ * every access (as before the decoder), the decoder built at run time and
+ * one resolved at compile time
+ */
+static const u64 DECODE_BLOCK = 64;
+static const u64 DECODE_SETS = 4096;
+
+template <typename Fn>
+static double bench_decode_with(u64 decodes, Fn decode) {
+  u64 state = 88172645463325252ULL;
+  u64 sum = 0;
+  auto start = steady_clock::now();
+  for (u64 i = 0; i < decodes; i++) {
+    sum += decode(xorshift(state));
+  }
+  double sec = duration<double>(steady_clock::now() - start).count();
+  // keep the result alive
+  if (sum == 1) printf(" ");
+  return decodes / sec;
+}
+
+static void bench_decode(u64 decodes) {
+  double loop_rate = bench_decode_with(decodes, [](u64 addr) {
+    u32 s = len_of_binary(DECODE_SETS);
+    u32 b = len_of_binary(DECODE_BLOCK);
+    u64 set_no = addr << (MACHINE_WORD_SIZE - s - b) >> (MACHINE_WORD_SIZE - s);
+    return set_no + (addr >> (s + b));
+  });
+  AddressDecoder decoder(DECODE_BLOCK, DECODE_SETS);
+  double decoder_rate = bench_decode_with(decodes, [&](u64 addr) {
+    return decoder.get_set_no(addr) + decoder.get_tag(addr);
+  });
+  static constexpr AddressDecoder fixed(DECODE_BLOCK, DECODE_SETS);
+  double fixed_rate = bench_decode_with(decodes, [](u64 addr) {
+    return fixed.get_set_no(addr) + fixed.get_tag(addr);
+  });
+
+  printf("address decode, %llu sets x %llu bytes, %llu decodes\n", DECODE_SETS, DECODE_BLOCK, decodes);
+  printf("\tlen_of_binary:\t%.2f Mdecodes/s\n", loop_rate / 1e6);
+  printf("\tdecoder:\t%.2f Mdecodes/s\n", decoder_rate / 1e6);
+  printf("\tconstexpr:\t%.2f Mdecodes/s\n", fixed_rate / 1e6);
+  printf("\tspeedup:\t%.2fx\n", decoder_rate / loop_rate);
+}
+
+/*
+ * lookup and update of a 16 way cache, misses fill the block: the generic
+ * CacheUnit against the compile-time specialized kernel of each policy. the
+ * cache stays in the host cache, the loop measures the lookup and the policy
+ * update rather than the host memory latency
+ */
+static const u32 KERNEL_SETS = 256;
+
+template <class T>
+class ExposedCache : public T {
+ public:
+  ExposedCache(const string &tag, const MemoryConfig &config) : T(tag, config) {};
+  using T::try_access_memory;
+  using T::on_memory_arrive;
+};
+
+template <class T>
+static double bench_cache_with(u64 accesses, T &cache, u64 &hits) {
+  u64 state = 88172645463325252ULL;
+  // the working set is twice the cache
+  u64 blocks = KERNEL_SETS * 16 * 2;
+  auto start = steady_clock::now();
+  for (u64 i = 0; i < accesses; i++) {
+    MemoryAccessInfo info((xorshift(state) % blocks) * 64, 0, 0);
+    if (cache.try_access_memory(info)) {
+      hits++;
+    }
+    else {
+      cache.on_memory_arrive(info);
+    }
+  }
+  return accesses / duration<double>(steady_clock::now() - start).count();
+}
+
+template <CR_POLICY POLICY>
+static void bench_kernel_of(const char *name, u64 accesses) {
+  MemoryConfig cfg(1, 10, 16, 64, KERNEL_SETS, POLICY);
+  ExposedCache<CacheUnit> generic("bench-generic", cfg);
+  ExposedCache<CacheKernel<16, 64, POLICY> > kernel("bench-kernel", cfg);
+  u64 generic_hits = 0, kernel_hits = 0;
+  double generic_rate = bench_cache_with(accesses, generic, generic_hits);
+  double kernel_rate = bench_cache_with(accesses, kernel, kernel_hits);
+  assert(generic_hits == kernel_hits);
+  printf("\t%s:\t%.1f%% hits, generic %.2f, kernel %.2f Maccesses/s, %.2fx\n", name,
+         100.0 * kernel_hits / accesses, generic_rate / 1e6, kernel_rate / 1e6,
+         kernel_rate / generic_rate);
+}
+
+static void bench_cache_kernel(u64 accesses) {
+  printf("cache access, %u sets x 16 ways, %llu accesses\n", KERNEL_SETS, accesses);
+  bench_kernel_of<LRU_POLICY>("LRU", accesses);
+  bench_kernel_of<LIP_POLICY>("LIP", accesses);
+  bench_kernel_of<BIP_POLICY>("BIP", accesses);
+  bench_kernel_of<DIP_POLICY>("DIP", accesses);
+  bench_kernel_of<SRRIP_POLICY>("SRRIP", accesses);
+  bench_kernel_of<BRRIP_POLICY>("BRRIP", accesses);
+  bench_kernel_of<DRRIP_POLICY>("DRRIP", accesses);
+}
+
+/*
+ * building a 64 MB, 1M set cache: a heap CacheSet per set (as before the
+ * set region) against the cache with all sets in one region
+ */
+static const u64 BUILD_SETS = 1 << 20;
+
+static void bench_build_cache() {
+  MemoryConfig cfg(1, 10, 16, 64, BUILD_SETS, LRU_POLICY);
+  CRPolicyInterface *lru = PolicyFactoryObj::get_instance()->get_policy(cfg);
+  auto start = steady_clock::now();
+  BlockArray *blocks = new BlockArray(BUILD_SETS, 16);
+  vector<CacheSet *> sets;
+  for (u64 s = 0; s < BUILD_SETS; s++) {
+    sets.push_back(new CacheSet(16, 64, BUILD_SETS, lru, blocks, s));
+  }
+  double heap_ms = duration<double, milli>(steady_clock::now() - start).count();
+  for (auto set: sets) {
+    delete set;
+  }
+  delete blocks;
+
+  start = steady_clock::now();
+  CacheUnit *cache = new CacheUnit("bench-build", cfg);
+  double region_ms = duration<double, milli>(steady_clock::now() - start).count();
+
+  printf("cache build, %llu sets x 16 ways\n", BUILD_SETS);
+  printf("\theap sets:\t%.1f ms\n", heap_ms);
+  printf("\tset region:\t%.1f ms, blocks %.1f MB, sets %.1f MB%s\n", region_ms,
+         cache->get_block_footprint() / 1048576.0, cache->get_set_footprint() / 1048576.0,
+         cache->is_thp_requested() ? ", THP requested" : "");
+  printf("\tspeedup:\t%.2fx\n", heap_ms / region_ms);
+  delete cache;
+}
+
+/*
+ * functional accesses of a 256K set, 16 way cache (64 MB of metadata) with a
+ * random working set twice the cache: one at a time against access_batch
+ * prefetching the sets of the upcoming accesses
+ */
+static const u64 BATCH_SETS = 1 << 18;
+
+template <class T>
+static void bench_batch_with(const char *name, const vector<MemoryAccessInfo> &accesses) {
+  MemoryConfig cfg(1, 10, 16, 64, BATCH_SETS, LRU_POLICY);
+  ExposedCache<T> one("bench-one", cfg), batched("bench-batched", cfg);
+  u64 one_hits = 0;
+  auto start = steady_clock::now();
+  for (auto &info: accesses) {
+    if (one.try_access_memory(info)) {
+      one_hits++;
+    }
+    else {
+      one.on_memory_arrive(info);
+    }
+  }
+  double one_ms = duration<double, milli>(steady_clock::now() - start).count();
+  start = steady_clock::now();
+  u64 batched_hits = batched.access_batch(accesses.data(), accesses.size());
+  double batched_ms = duration<double, milli>(steady_clock::now() - start).count();
+  assert(one_hits == batched_hits);
+
+  printf("\t%s one by one:\t%.2f Maccesses/s\n", name, accesses.size() / one_ms / 1e3);
+  printf("\t%s batched:\t%.2f Maccesses/s\n", name, accesses.size() / batched_ms / 1e3);
+  printf("\t%s speedup:\t%.2fx\n", name, one_ms / batched_ms);
+}
+
+static void bench_access_batch(u64 accesses) {
+  u64 state = 88172645463325252ULL;
+  u64 blocks = BATCH_SETS * 16 * 2;
+  vector<MemoryAccessInfo> batch;
+  for (u64 i = 0; i < accesses; i++) {
+    batch.push_back(MemoryAccessInfo((xorshift(state) % blocks) * 64, 0, 0));
+  }
+  printf("batched access, %llu sets x 16 ways LRU, %llu accesses\n", BATCH_SETS, accesses);
+  bench_batch_with<CacheUnit>("generic", batch);
+  bench_batch_with<CacheKernel<16, 64, LRU_POLICY> >("kernel", batch);
+}
+
+/*
+ * a 64 way cache, the LRU stack update touches every way on each hit and
+ * fill, RRIP sets one counter on a hit and scans the counters on a fill
+ */
+static const u32 RRIP_WAYS = 64;
+static const u64 RRIP_SETS = 256;
+
+static double bench_policy(CR_POLICY policy, const vector<MemoryAccessInfo> &accesses, u64 &hits) {
+  MemoryConfig cfg(1, 10, RRIP_WAYS, 64, RRIP_SETS, policy);
+  CacheUnit cache("bench-policy", cfg);
+  auto start = steady_clock::now();
+  hits = cache.access_batch(accesses.data(), accesses.size());
+  return accesses.size() / duration<double>(steady_clock::now() - start).count();
+}
+
+static void bench_rrip(u64 accesses) {
+  u64 state = 88172645463325252ULL;
+  // a hot half of the cache re-referenced among accesses streaming through
+  u64 hot = RRIP_SETS * RRIP_WAYS / 2;
+  vector<MemoryAccessInfo> batch;
+  for (u64 i = 0; i < accesses; i++) {
+    u64 block = (i % 2) ? xorshift(state) % hot : hot + i;
+    batch.push_back(MemoryAccessInfo(block * 64, 0, 0));
+  }
+  u64 lru_hits = 0, srrip_hits = 0;
+  double lru_rate = bench_policy(LRU_POLICY, batch, lru_hits);
+  double srrip_rate = bench_policy(SRRIP_POLICY, batch, srrip_hits);
+
+  printf("replacement policy, %llu sets x %u ways, %llu accesses, half scanning\n",
+         RRIP_SETS, RRIP_WAYS, accesses);
+  printf("\tLRU:\t\t%.2f Maccesses/s, %.1f%% hits\n", lru_rate / 1e6, 100.0 * lru_hits / accesses);
+  printf("\tSRRIP:\t\t%.2f Maccesses/s, %.1f%% hits\n", srrip_rate / 1e6,
+         100.0 * srrip_hits / accesses);
+  printf("\tspeedup:\t%.2fx\n", srrip_rate / lru_rate);
+}
+
+int main(int argc, char *argv[]) {
+  u32 population = 20000;
+  u64 events = 5000000;
+  if (argc > 1) population = atoi(argv[1]);
+  if (argc > 2) events = atoll(argv[2]);
+
+  bench_event_engine(population, events);
+  bench_dispatch(population, events);
+  bench_tag_lookup(events * 4);
+  bench_fill(events);
+  bench_decode(events * 4);
+  bench_cache_kernel(events);
+  bench_build_cache();
+  bench_access_batch(events);
+  bench_rrip(events);
+  return 0;
+}
@@ -0,0 +1,186 @@
+#include "next_use.h"
+#include "trace_loader.h"
+#include <unordered_map>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// references per chunk of the backward pass
+#define NEXT_USE_CHUNK (1 << 16)
+// the directory of the next-use files instead of the one of the trace
+#define NEXT_USE_DIR_ENV "LIGHTSIM_NEXT_USE_DIR"
+
+struct NextUseHeader {
+  char    magic[16];
+  u32     block_bits;
+  u32     reserved;
+  u64     refs;
+};
+
+static const char NEXT_USE_MAGIC[16] = "lightsim nu 1";
+
+const u32 NextUseFile::NEVER;
+
+string NextUseFile::path_of(const string &trace, u32 trace_id, u32 block_bits) {
+  char suffix[64];
+  sprintf(suffix, ".next-use.%u.%u", trace_id, 1U << block_bits);
+  const char *dir = getenv(NEXT_USE_DIR_ENV);
+  if (dir == NULL || *dir == 0) {
+    return trace + suffix;
+  }
+  // named after the whole path, the traces of the same name in other
+  // directories keep their own files
+  char *full = realpath(trace.c_str(), NULL);
+  string name = full != NULL ? full : trace;
+  free(full);
+  replace(name.begin(), name.end(), '/', '%');
+  return string(dir) + "/" + name + suffix;
+}
+
+bool NextUseFile::is_current(const string &path, const string &trace, u32 block_bits) {
+  struct stat side, source;
+  if (stat(path.c_str(), &side) != 0 || stat(trace.c_str(), &source) != 0) {
+    return false;
+  }
+  if (side.st_mtime < source.st_mtime) {
+    return false;
+  }
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL) {
+    return false;
+  }
+  NextUseHeader header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+            memcmp(header.magic, NEXT_USE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.block_bits == block_bits &&
+            (u64)side.st_size == sizeof(header) + header.refs * sizeof(u32);
+  fclose(f);
+  return ok;
+}
+
+static void write_at(FILE *f, u64 offset, const void *p, size_t size, const string &path) {
+  if (fseeko(f, offset, SEEK_SET) != 0 || fwrite(p, size, 1, f) != 1) {
+    SIMLOG(SIM_ERROR, "failed to write the next-use file %s\n", path.c_str());
+    exit(1);
+  }
+}
+
+/*
+ * 正向: 块号依次写入临时文件。反向: 从最后一段开始读回，段内从后向前，
+ * last记录每个块已见到的最早编号，即当前引用的下一次引用，结果写到
+ * 文件中对应的位置。先写到同目录的临时文件再rename，并行运行的仿真
+ * 不会读到写了一半的文件
+ */
+void NextUseFile::build(const string &trace, u32 trace_id, u32 block_bits, const string &path) {
+  FILE *blocks = tmpfile();
+  if (blocks == NULL) {
+    SIMLOG(SIM_ERROR, "can not create the temporary file of the next-use pre-pass\n");
+    exit(1);
+  }
+  vector<u64> chunk;
+  chunk.reserve(NEXT_USE_CHUNK);
+  u64 refs = 0;
+  auto flush = [&]() {
+    if (!chunk.empty() && fwrite(chunk.data(), sizeof(u64), chunk.size(), blocks) != chunk.size()) {
+      SIMLOG(SIM_ERROR, "failed to write the temporary file of the next-use pre-pass\n");
+      exit(1);
+    }
+    refs += chunk.size();
+    chunk.clear();
+  };
+  TraceLoader loader(trace);
+  TraceFormat t;
+  while (loader.next_instruction(t)) {
+    MultiTraceLoader::relocate(trace_id, t);
+    for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+      if (t.source_memory[i] != 0) {
+        chunk.push_back(t.source_memory[i] >> block_bits);
+      }
+    }
+    for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+      if (t.destination_memory[i] != 0) {
+        chunk.push_back(t.destination_memory[i] >> block_bits);
+      }
+    }
+    if (chunk.size() >= NEXT_USE_CHUNK) {
+      flush();
+    }
+  }
+  flush();
+  if (refs >= NEVER) {
+    SIMLOG(SIM_ERROR, "%s has %llu memory references, the next-use file holds less than %u\n",
+           trace.c_str(), refs, NEVER);
+    exit(1);
+  }
+
+  string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  FILE *out = fd == -1 ? NULL : fdopen(fd, "wb");
+  if (out == NULL) {
+    SIMLOG(SIM_ERROR, "can not create the next-use file %s\n", path.c_str());
+    exit(1);
+  }
+  fchmod(fd, 0644);
+
+  unordered_map<u64, u32> last;
+  vector<u32> next;
+  for (u64 end = refs; end > 0;) {
+    u64 begin = end > NEXT_USE_CHUNK ? end - NEXT_USE_CHUNK : 0;
+    chunk.resize(end - begin);
+    next.resize(end - begin);
+    if (fseeko(blocks, begin * sizeof(u64), SEEK_SET) != 0 ||
+        fread(chunk.data(), sizeof(u64), chunk.size(), blocks) != chunk.size()) {
+      SIMLOG(SIM_ERROR, "failed to read the temporary file of the next-use pre-pass\n");
+      exit(1);
+    }
+    for (u64 i = chunk.size(); i-- > 0;) {
+      auto seen = last.insert(make_pair(chunk[i], (u32)(begin + i)));
+      next[i] = seen.second ? NEVER : seen.first->second;
+      seen.first->second = begin + i;
+    }
+    write_at(out, sizeof(NextUseHeader) + begin * sizeof(u32), next.data(),
+             next.size() * sizeof(u32), tmp);
+    end = begin;
+  }
+  fclose(blocks);
+
+  NextUseHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NEXT_USE_MAGIC, sizeof(header.magic));
+  header.block_bits = block_bits;
+  header.refs = refs;
+  write_at(out, 0, &header, sizeof(header), tmp);
+  if (fclose(out) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+    SIMLOG(SIM_ERROR, "failed to write the next-use file %s\n", path.c_str());
+    exit(1);
+  }
+}
+
+NextUseFile::NextUseFile(const string &trace, u32 trace_id, u32 block_bits) {
+  string path = path_of(trace, trace_id, block_bits);
+  if (!is_current(path, trace, block_bits)) {
+    SIMLOG(SIM_INFO, "building the next-use file %s\n", path.c_str());
+    build(trace, trace_id, block_bits, path);
+  }
+  _fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (_fd == -1 || fstat(_fd, &st) != 0) {
+    SIMLOG(SIM_ERROR, "can not open the next-use file %s\n", path.c_str());
+    exit(1);
+  }
+  _size = st.st_size;
+  _base = mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
+  if (_base == MAP_FAILED) {
+    SIMLOG(SIM_ERROR, "can not map the next-use file %s\n", path.c_str());
+    exit(1);
+  }
+  _refs = ((const NextUseHeader *)_base)->refs;
+  _next = (const u32 *)((const char *)_base + sizeof(NextUseHeader));
+}
+
+NextUseFile::~NextUseFile() {
+  munmap(_base, _size);
+  close(_fd);
+}
@@ -0,0 +1,58 @@
+#ifndef NEXT_USE_H
+#define NEXT_USE_H
+
+#include "inc_all.h"
+
+using namespace std;
+
+/*
+ * 下次使用文件(next-use side file): trace的每个访存引用(编号见
+ * count_references)在同一块上的下一次引用的编号，供知道未来的策略(OPT)
+ * 在一次前向仿真中使用。
+ * 预处理一次正向读trace(TraceLoader，地址按MultiTraceLoader::relocate
+ * 重定位)，把块号写入临时文件，再从后向前分段读回，用哈希表记录每个块
+ * 最近一次出现的编号，内存只与trace的不同块数有关。
+ * 文件头之后是定长的u32记录，放在trace旁边，或者放在环境变量
+ * LIGHTSIM_NEXT_USE_DIR给出的目录中(trace所在目录只读时，见path_of)，
+ * trace更新后或缺失时重新生成；仿真时只读mmap，按编号随机访问，常驻内存
+ * 由OS按页管理
+ */
+class NextUseFile {
+ private:
+  int                 _fd;
+  void *              _base;
+  size_t              _size;
+  const u32 *         _next;
+  u64                 _refs;
+
+  NextUseFile(const NextUseFile &);
+  NextUseFile & operator= (const NextUseFile &);
+
+  // the file exists, is not older than the trace and has the block size
+  static bool is_current(const string &path, const string &trace, u32 block_bits);
+
+ public:
+  // no later reference to the block
+  static const u32 NEVER = 0xFFFFFFFF;
+
+  // the side file of the trace for blocks of 2^block_bits bytes, the
+  // pre-pass builds it first when needed
+  NextUseFile(const string &trace, u32 trace_id, u32 block_bits);
+  ~NextUseFile();
+
+  // the addresses are relocated as the trace_id-th trace. next to the trace,
+  // or in $LIGHTSIM_NEXT_USE_DIR named after the absolute path of the trace
+  static string path_of(const string &trace, u32 trace_id, u32 block_bits);
+  static void build(const string &trace, u32 trace_id, u32 block_bits, const string &path);
+
+  inline u64 get_refs() {
+    return _refs;
+  }
+
+  // the next reference to the block of the reference, NEVER if none
+  inline u32 next(u64 ref) {
+    return ref < _refs ? _next[ref] : NEVER;
+  }
+};
+
+#endif
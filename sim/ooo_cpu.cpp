@@ -1,7 +1,7 @@
 #include "ooo_cpu.h"
 
 // CPUEventData::CPUEventData(const TraceFormat & t): opcode(t.opcode),
-CPUEventData::CPUEventData(const TraceFormat & t): PC(t.pc) {
+CPUEventData::CPUEventData(const TraceFormat & t): PC(t.pc), first_ref(NO_REFERENCE) {
   //dummy opcode
   opcode = 0;
   for (u8 i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
@@ -18,6 +18,34 @@ CPUEventData::CPUEventData(const TraceFormat & t): PC(t.pc) {
   memcpy(source_memory, t.source_memory, sizeof(source_memory));
 }
 
+void CPUEventData::save(CheckpointWriter &w) {
+  w.write(opcode);
+  w.write(PC);
+  w.write(destination_registers);
+  w.write(source_registers);
+  w.write(dreg_rename);
+  w.write(sreg_rename);
+  w.write(sreg_ready);
+  w.write(destination_memory);
+  w.write(source_memory);
+  w.write(memory_ready);
+  w.write(first_ref);
+}
+
+void CPUEventData::restore(CheckpointReader &r) {
+  opcode = r.read<u32>();
+  PC = r.read<u64>();
+  r.read_bytes(destination_registers, sizeof(destination_registers));
+  r.read_bytes(source_registers, sizeof(source_registers));
+  r.read_bytes(dreg_rename, sizeof(dreg_rename));
+  r.read_bytes(sreg_rename, sizeof(sreg_rename));
+  r.read_bytes(sreg_ready, sizeof(sreg_ready));
+  r.read_bytes(destination_memory, sizeof(destination_memory));
+  r.read_bytes(source_memory, sizeof(source_memory));
+  memory_ready = r.read<bool>();
+  first_ref = r.read<u64>();
+}
+
 u32 CPU::get_op_latency(const u32 opcode = 0) const {
   //todo add more detialed latency
   (void)opcode;
@@ -27,7 +55,20 @@ u32 CPU::get_op_latency(const u32 opcode = 0) const {
 
 SequentialCPU::SequentialCPU(const string &tag, u8 id,
                              CpuConnector *memory_connector)
-    : CPU(tag), _id(id), _memory_connector(memory_connector) {
+    : CPU(tag), _id(id), _priority(0), _memory_connector(memory_connector),
+      _batching(false), _read_ahead(false), _read_ahead_ret(0), _batched(0), _refs(0) {
+  set_kind(dispatch_kind());
+}
+
+u32 SequentialCPU::dispatch_kind() {
+  static const u32 kind = []() {
+    u32 k = EventDispatcher::new_kind();
+    EventDispatcher::bind<SequentialCPU, &SequentialCPU::handle_WriteBack>(k, WriteBack);
+    EventDispatcher::bind<SequentialCPU, &SequentialCPU::handle_InstExecution>(k, InstExecution);
+    EventDispatcher::bind<SequentialCPU, &SequentialCPU::handle_InstFetch>(k, InstFetch);
+    return k;
+  }();
+  return kind;
 }
 
 
@@ -45,6 +86,15 @@ bool CPU::has_source_memory(CPUEventData * event_data) const {
   return false;
 }
 
+bool CPU::has_memory(const TraceFormat &trace) const {
+  for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+    if (trace.destination_memory[i] != 0) return true;
+  }
+  for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+    if (trace.source_memory[i] != 0) return true;
+  }
+  return false;
+}
 
 bool SequentialCPU::validate(EventType type) {
   return ((type == WriteBack) ||
@@ -53,57 +103,140 @@ bool SequentialCPU::validate(EventType type) {
 }
 
 void SequentialCPU::proc(u64 tick, EventDataBase* data, EventType type) {
+  switch (type) {
+    case WriteBack :
+      handle_WriteBack(tick, data);
+      break;
+    case InstExecution :
+      handle_InstExecution(tick, data);
+      break;
+    case InstFetch :
+      handle_InstFetch(tick, data);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+void SequentialCPU::save(CheckpointWriter &w) {
+  w.write(_current_trace);
+  w.write(_read_ahead);
+  w.write<u64>(_read_ahead_ret);
+  w.write(_batched);
+  w.write(_refs);
+}
+
+void SequentialCPU::restore(CheckpointReader &r) {
+  _current_trace = r.read<TraceFormat>();
+  _read_ahead = r.read<bool>();
+  _read_ahead_ret = r.read<u64>();
+  _batched = r.read<u64>();
+  _refs = r.read<u64>();
+  // the end of the trace read ahead may be the bound of the saving run,
+  // read again under the bound of this run
+  if (_read_ahead && !_read_ahead_ret) {
+    auto trace_loader = MultiTraceLoaderObj::get_instance();
+    _read_ahead_ret = trace_loader->next_instruction(_id, _current_trace);
+  }
+}
+
+void SequentialCPU::handle_WriteBack(u64 tick, EventDataBase* data) {
+  (void)tick;
+  auto *event_data = (CPUEventData *) data;
+  // the destinations follow the sources of the instruction
+  u64 ref = event_data->first_ref;
+  for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+    ref += event_data->source_memory[i] != 0;
+  }
+  for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+    if (event_data->destination_memory[i] != 0) {
+      MemoryAccessInfo writeback_info(event_data->destination_memory[i],
+                                      event_data->PC, _id, ref++);
+      _memory_connector->issue_memory_access(writeback_info, nullptr);
+    }
+  }
+}
+
+void SequentialCPU::handle_InstExecution(u64 tick, EventDataBase* data) {
   (void)tick;
   auto *event_data = (CPUEventData *) data;
   EventEngine *event_queue = EventEngineObj::get_instance();
-  switch (type) {
-    case WriteBack : {
-      for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
-        if (event_data->destination_memory[i] != 0) {
-          MemoryAccessInfo writeback_info(event_data->destination_memory[i],
-                                          event_data->PC, _id);
-          _memory_connector->issue_memory_access(writeback_info, nullptr);
-        }
-      }
-    } break;
-    case InstExecution : {
-      assert(event_data->memory_ready);
-      if (has_destination_memory(event_data)) {
-        auto new_event_ddta = new CPUEventData(*event_data);
-        Event *e = new Event(WriteBack, this, new_event_ddta);
-        event_queue->register_after_now(e, get_op_latency(event_data->opcode),
-                                        _priority);
-      }
+  assert(event_data->memory_ready);
+  if (has_destination_memory(event_data)) {
+    auto new_event_ddta = new CPUEventData(*event_data);
+    Event *e = new Event(WriteBack, this, new_event_ddta);
+    event_queue->register_after_now(e, get_op_latency(event_data->opcode),
+                                    _priority);
+  }
+  Event *e = new Event(InstFetch, this, nullptr);
+  event_queue->register_after_now(e, get_op_latency(event_data->opcode),
+                                  _priority);
+}
+
+/*
+ * 不访问内存的指令(没有source/destination memory)只经过 InstFetch ->(1)
+ * InstExecution ->(op latency) InstFetch，不与其他单元交互。
+ * 连续的这类指令在一次InstFetch中读完，时间前进它们的延迟之和，
+ * 之后的指令(访存指令或trace结束)暂存在 _current_trace 中，
+ * 在它原本被fetch的tick再处理，省去中间的 CPUEventData 与事件。
+ * 省去的事件只改变本CPU事件的注册时机，不同CPU的事件由各自的优先级定序
+ * (见PipeLineBuilder::order_cpu_events)，因此对connector和L1私有的CPU打开。
+ */
+u64 SequentialCPU::read_instruction(size_t &ret) {
+  auto trace_loader = MultiTraceLoaderObj::get_instance();
+  u64 latency = 0;
+  while (true) {
+    ret = trace_loader->next_instruction(_id, _current_trace);
+    if (!_batching || !ret || has_memory(_current_trace)) {
+      return latency;
+    }
+    latency += 1 + get_op_latency(0);
+    _batched++;
+  }
+}
+
+void SequentialCPU::handle_InstFetch(u64 tick, EventDataBase* data) {
+  (void)data;
+  EventEngine *event_queue = EventEngineObj::get_instance();
+  size_t ret;
+  if (_read_ahead) {
+    _read_ahead = false;
+    ret = _read_ahead_ret;
+  }
+  else {
+    u64 latency = read_instruction(ret);
+    if (latency > 0) {
+      _read_ahead = true;
+      _read_ahead_ret = ret;
       Event *e = new Event(InstFetch, this, nullptr);
-      event_queue->register_after_now(e, get_op_latency(event_data->opcode),
-                                      _priority);
-    } break;
-    case InstFetch : {
-      auto trace_loader = MultiTraceLoaderObj::get_instance();
-      if(trace_loader->next_instruction(_id, _current_trace)) {
-        CPUEventData *cpu_event_data = new CPUEventData(_current_trace);
-        if (! has_source_memory(cpu_event_data)) {
-          cpu_event_data->memory_ready = true;
-          Event *e = new Event(InstExecution, this, cpu_event_data);
-          event_queue->register_after_now(e, 1, _priority);
-        } else {
-          for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
-            if (cpu_event_data->source_memory[i] != 0) {
-              MemoryAccessInfo read_info(cpu_event_data->source_memory[i],
-                                         cpu_event_data->PC, _id);
-              _memory_connector->issue_memory_access(read_info, cpu_event_data);
-            }
-          }
+      event_queue->register_after_now(e, latency, _priority);
+      return;
+    }
+  }
+  if(ret) {
+    CPUEventData *cpu_event_data = new CPUEventData(_current_trace);
+    cpu_event_data->first_ref = _refs;
+    _refs += count_references(_current_trace);
+    if (! has_source_memory(cpu_event_data)) {
+      cpu_event_data->memory_ready = true;
+      Event *e = new Event(InstExecution, this, cpu_event_data);
+      event_queue->register_after_now(e, 1, _priority);
+    } else {
+      u64 ref = cpu_event_data->first_ref;
+      for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+        if (cpu_event_data->source_memory[i] != 0) {
+          MemoryAccessInfo read_info(cpu_event_data->source_memory[i],
+                                     cpu_event_data->PC, _id, ref++);
+          _memory_connector->issue_memory_access(read_info, cpu_event_data);
         }
-      } else {
-        auto census_taker = CensusTakerObj::get_instance();
-        census_taker->shutdown();
-        SIMLOG(SIM_INFO, "CPU %d finished processing the trace file\n", _id);
-        return;
       }
-    } break;
-    default:
-      assert(0);
+      _memory_connector->end_issue(cpu_event_data);
+    }
+  } else {
+    auto census_taker = CensusTakerObj::get_instance();
+    census_taker->shutdown(tick);
+    SIMLOG(SIM_INFO, "CPU %d finished processing the trace file\n", _id);
+    return;
   }
 }
 
@@ -21,9 +21,16 @@ struct CPUEventData : public EventDataBase {
   u64  destination_memory[NUM_INSTR_DESTINATIONS];
   u64  source_memory[NUM_INSTR_SOURCES];
   bool memory_ready;
+  // the reference of the first memory address, see count_references
+  u64  first_ref;
 
   CPUEventData(const TraceFormat & t);
   CPUEventData(const CPUEventData & event_data) = default;
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
+
+  POOL_ALLOCATED(CPUEventData)
 };
 
 class CPU : public EventHandler {
@@ -31,6 +38,7 @@ class CPU : public EventHandler {
   u32 get_op_latency(const u32 opcode) const;
   bool has_destination_memory(CPUEventData *) const;
   bool has_source_memory(CPUEventData *) const;
+  bool has_memory(const TraceFormat &) const;
   bool validate(EventType type) = 0;
   void proc(u64 tick, EventDataBase* data, EventType type) = 0;
  public:
@@ -41,15 +49,41 @@ class CPU : public EventHandler {
 class SequentialCPU : public CPU {
  private:
   const u8 _id;
-  static const u8 _priority = 0;
+  // priority of the events of this cpu, the same as its connector
+  u8 _priority;
   TraceFormat _current_trace;
   CpuConnector *_memory_connector;
+  // consume runs of non-memory instructions in one InstFetch
+  bool _batching;
+  // _current_trace is read but not fetched yet, with the return of the read
+  bool _read_ahead;
+  size_t _read_ahead_ret;
+  // instructions in the batches
+  u64 _batched;
+  // memory references fetched from the trace
+  u64 _refs;
+
+  // read up to the next memory instruction, returns the latency of the
+  // non-memory instructions before it
+  u64 read_instruction(size_t &ret);
  protected:
   bool validate(EventType type);
   void proc(u64 tick, EventDataBase* data, EventType type);
+
+  // statically dispatched event handlers
+  void handle_WriteBack(u64 tick, EventDataBase* data);
+  void handle_InstExecution(u64 tick, EventDataBase* data);
+  void handle_InstFetch(u64 tick, EventDataBase* data);
+  static u32 dispatch_kind();
  public:
   SequentialCPU(const string &tag, u8 id, CpuConnector* _memory_connector);
   virtual ~SequentialCPU() {};
+  void set_batching(bool enable) { _batching = enable; }
+  void set_priority(u8 priority) { _priority = priority; }
+  u64 get_batched() const { return _batched; }
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 /*
@@ -0,0 +1,313 @@
+#include "parallel_engine.h"
+
+#include <algorithm>
+
+// busy wait a little before giving up the cpu, steps are short
+static const u32 SPIN_LIMIT = 64;
+
+ParallelEngine::ParallelEngine(EventEngine *shared, const LPLayout &layout,
+                               const function<void()> &thread_init) :
+    _shared(shared), _has_shared(!layout.shared.empty()),
+    _lookahead(layout.lookahead), _thread_init(thread_init), _step(0), _running(0), _private_end(0),
+    _stop(false), _steps(0), _max_tick(-1) {
+  assert(!_has_shared || _lookahead > 0);
+  _step_ticks = max(1U, (_lookahead + 1) / 2);
+
+  for (auto &handlers: layout.privates) {
+    EventEngine *lp = new EventEngine();
+    lp->_lp = true;
+    lp->_provisional = true;
+    for (auto handler: handlers) {
+      handler->set_engine(lp);
+    }
+    _privates.push_back(lp);
+  }
+  for (auto handler: layout.shared) {
+    handler->set_engine(_shared);
+  }
+  _shared->_lp = true;
+  _shared->_provisional = false;
+  _sent.resize(_privates.size() + 1, 0);
+  _global_index.resize(_privates.size());
+
+  // move the events registered before the simulation (e.g. cpu start) to
+  // their logical processes, the serial order becomes their stamps
+  vector<EventEntry> pending;
+  for (u32 i = 0; i < EventEngine::WHEEL_SIZE; i++) {
+    pending.insert(pending.end(), _shared->_wheel[i].begin(), _shared->_wheel[i].end());
+    _shared->_wheel[i].clear();
+  }
+  pending.insert(pending.end(), _shared->_overflow.begin(), _shared->_overflow.end());
+  _shared->_overflow.clear();
+  memset(_shared->_occupied, 0, sizeof(_shared->_occupied));
+  _shared->_size = 0;
+
+  for (auto &entry: pending) {
+    EventEngine *owner = entry.e->handler->get_engine();
+    if (owner == NULL) {
+      owner = _shared;
+    }
+    entry.seq = LPStamp::initial(entry.seq);
+    owner->insert(entry);
+    owner->_size++;
+  }
+
+  for (u32 i = 0; i < _privates.size(); i++) {
+    _threads.push_back(thread(&ParallelEngine::worker, this, i));
+  }
+}
+
+ParallelEngine::~ParallelEngine() {
+  _stop = true;
+  _step.fetch_add(1, memory_order_release);
+  for (auto &t: _threads) {
+    t.join();
+  }
+  reclaim_pools();
+  for (auto lp: _privates) {
+    delete lp;
+  }
+}
+
+void ParallelEngine::worker(u32 id) {
+  if (_thread_init) {
+    _thread_init();
+  }
+  EventEngineObj::bind_local(_privates[id]);
+  u64 seen = 0;
+  while (true) {
+    u32 spins = 0;
+    while (_step.load(memory_order_acquire) == seen) {
+      if (++spins > SPIN_LIMIT) {
+        this_thread::yield();
+      }
+    }
+    seen = _step.load(memory_order_acquire);
+    if (_stop) {
+      break;
+    }
+    _privates[id]->run_until(_private_end);
+    _running.fetch_sub(1, memory_order_release);
+  }
+  EventEngineObj::bind_local(NULL);
+}
+
+void ParallelEngine::wait_workers() {
+  u32 spins = 0;
+  while (_running.load(memory_order_acquire) != 0) {
+    if (++spins > SPIN_LIMIT) {
+      this_thread::yield();
+    }
+  }
+}
+
+// replace the provisional index of the parent by the merged one, the parent
+// is in the first limit records of the log
+u64 ParallelEngine::resolve(u32 id, s64 pv, u64 seq, size_t limit) {
+  if (!LPStamp::is_provisional(seq)) {
+    return seq;
+  }
+
+  auto &log = _privates[id]->_exec_log;
+  s64 parent_pv = pv - LPStamp::distance(seq);
+  auto iter = lower_bound(log.begin(), log.begin() + limit, parent_pv,
+                          [](const EventEngine::ExecRecord &r, s64 v) {
+                            return r.pv < v;
+                          });
+  size_t pos = (iter - log.begin()) + LPStamp::index(seq);
+  assert(pos < limit && log[pos].pv == parent_pv);
+  return LPStamp::resolve(seq, _global_index[id][pos]);
+}
+
+// k-way merge of the execution logs of the private logical processes in
+// (PV, stamp) order, i.e. the serial order, gives each event its index among
+// the events of the same PV
+void ParallelEngine::merge_private_logs() {
+  u32 n = _privates.size();
+  vector<size_t> head(n, 0);
+  vector<u64> key(n, 0);
+  for (u32 i = 0; i < n; i++) {
+    auto &log = _privates[i]->_exec_log;
+    _global_index[i].resize(log.size());
+    if (!log.empty()) {
+      key[i] = resolve(i, log[0].pv, log[0].seq, 0);
+    }
+  }
+
+  s64 cur_pv = LLONG_MIN;
+  u32 index = 0;
+  while (true) {
+    s32 best = -1;
+    s64 best_pv = 0;
+    for (u32 i = 0; i < n; i++) {
+      auto &log = _privates[i]->_exec_log;
+      if (head[i] == log.size()) {
+        continue;
+      }
+      s64 pv = log[head[i]].pv;
+      if (best == -1 || pv < best_pv || (pv == best_pv && key[i] < key[best])) {
+        best = i;
+        best_pv = pv;
+      }
+    }
+    if (best == -1) {
+      break;
+    }
+
+    if (best_pv != cur_pv) {
+      cur_pv = best_pv;
+      index = 0;
+    }
+    else {
+      index++;
+    }
+    auto &log = _privates[best]->_exec_log;
+    size_t j = head[best]++;
+    _global_index[best][j] = index;
+    if (j + 1 < log.size()) {
+      key[best] = resolve(best, log[j + 1].pv, log[j + 1].seq, j + 1);
+    }
+  }
+}
+
+void ParallelEngine::deliver(EventEngine *lp, u32 id) {
+  for (auto &msg: lp->_outbox) {
+    EventEngine *dst = msg.first;
+    EventEntry entry = msg.second;
+    if (lp->_provisional) {
+      entry.seq = resolve(id, entry.pv, entry.seq, lp->_exec_log.size());
+    }
+    dst->insert(entry);
+    dst->_size++;
+  }
+  _sent[id] += lp->_outbox.size();
+  lp->_outbox.clear();
+}
+
+// the execution log is cleared at the barrier, the events still in the queue
+// need their stamps resolved as well. Within one logical process the merged
+// indexes keep the local order, so the heaps stay valid
+void ParallelEngine::resolve_pending(u32 id) {
+  EventEngine *lp = _privates[id];
+  size_t limit = lp->_exec_log.size();
+  for (u32 i = 0; i < EventEngine::WHEEL_SIZE; i++) {
+    for (auto &entry: lp->_wheel[i]) {
+      entry.seq = resolve(id, entry.pv, entry.seq, limit);
+    }
+  }
+  for (auto &entry: lp->_overflow) {
+    entry.seq = resolve(id, entry.pv, entry.seq, limit);
+  }
+}
+
+void ParallelEngine::reclaim_pools() {
+  vector<EventEngine*> all(_privates);
+  all.push_back(_shared);
+  for (auto lp: all) {
+    for (auto pool: lp->_pools) {
+      if (pool) {
+        pool->reclaim_remote();
+      }
+    }
+  }
+}
+
+void ParallelEngine::run() {
+  EventEngine *caller = EventEngineObj::get_instance();
+  EventEngineObj::bind_local(_shared);
+  u32 n = _privates.size();
+  while (true) {
+    s64 next_private = LLONG_MAX;
+    for (auto lp: _privates) {
+      next_private = min(next_private, lp->peek_tick());
+    }
+    s64 next_shared = _shared->peek_tick();
+    if (next_private == LLONG_MAX && next_shared == LLONG_MAX) {
+      break;
+    }
+
+    // events sent to the private part in this step arrive after private_end,
+    // events sent to the shared part arrive after shared_end
+    s64 private_end = LLONG_MAX;
+    if (_has_shared) {
+      s64 bound = next_shared;
+      if (next_private != LLONG_MAX) {
+        bound = min(bound, next_private + 1);
+        private_end = next_private + _step_ticks;
+      }
+      private_end = min(private_end, bound + _lookahead);
+    }
+    // the private part may also run events the shared part sends to it in
+    // this step, not earlier than next_shared + lookahead
+    s64 shared_end = next_private;
+    if (next_shared != LLONG_MAX) {
+      shared_end = min(shared_end, next_shared + _lookahead);
+    }
+    if (shared_end != LLONG_MAX) {
+      shared_end++;
+    }
+
+    _private_end = private_end;
+    _running.store(n, memory_order_relaxed);
+    _step.fetch_add(1, memory_order_release);
+    _shared->run_until(shared_end);
+    wait_workers();
+
+    deliver(_shared, n);
+    merge_private_logs();
+    for (u32 i = 0; i < n; i++) {
+      deliver(_privates[i], i);
+      resolve_pending(i);
+      _privates[i]->_exec_log.clear();
+      _global_index[i].clear();
+      _max_tick = max(_max_tick, _privates[i]->get_tick());
+    }
+    _max_tick = max(_max_tick, _shared->get_tick());
+
+    // hooks (census) run in the shared part, let them see the ticks in
+    // which only the private part had events
+    _shared->fire_tick_hooks(min(shared_end - 1, _max_tick));
+    reclaim_pools();
+    _steps++;
+  }
+  EventEngineObj::bind_local(caller);
+}
+
+void ParallelEngine::display(FILE *stream) {
+  vector<EventEngine*> all(_privates);
+  all.push_back(_shared);
+
+  fprintf(stream, "event pools:\n");
+  for (u32 id = 0; ; id++) {
+    PoolBase *total = NULL;
+    bool more = false;
+    for (auto lp: all) {
+      if (id >= lp->_pools.size()) {
+        continue;
+      }
+      more = true;
+      PoolBase *pool = lp->_pools[id];
+      if (pool == NULL) {
+        continue;
+      }
+      if (total == NULL) {
+        total = new PoolBase(pool->get_name());
+      }
+      total->accumulate(pool);
+    }
+    if (!more) {
+      break;
+    }
+    if (total) {
+      total->display(stream);
+      delete total;
+    }
+  }
+
+  fprintf(stream, "parallel simulation: %u logical processes, lookahead %u, %llu steps\n",
+          (u32)all.size(), _lookahead, _steps);
+  for (u32 i = 0; i < all.size(); i++) {
+    fprintf(stream, "\tlp %u%s: %llu events, %llu sent\n", i,
+            all[i] == _shared ? " (shared)" : "", all[i]->_executed, _sent[i]);
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef PARALLEL_ENGINE_H
+#define PARALLEL_ENGINE_H
+
+#include "event_engine.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+/*
+ * 保守式并行离散事件仿真(conservative PDES)
+ * 流水线被划分为若干逻辑进程(logical process)，每个逻辑进程有自己的事件队列:
+ * 每个CPU与其私有的cache为一个逻辑进程(private)，被多个CPU共享的部分为一个
+ * 逻辑进程(shared)。私有部分只会以1个cycle的延迟访问共享部分，共享部分
+ * 只会以其latency(lookahead)的延迟把数据返回给私有部分，因此:
+ * 1. 私有逻辑进程可以处理到 min(共享部分下一个事件, 私有部分下一个事件 + 1) + lookahead
+ * 2. 共享逻辑进程可以处理到 min(私有部分下一个事件, 共享部分下一个事件 + lookahead) + 1
+ * 两者在同一步(step)中并行，私有部分每步最多前进lookahead的一半，使两边的
+ * 工作量接近。步与步之间是同步点(barrier)，在同步点交换跨逻辑进程的事件。
+ *
+ * 结果与串行引擎完全一致: 同一cycle中PV相同的事件按注册顺序处理，注册顺序由
+ * 事件戳(LPStamp)给出。私有与共享部分的事件PV互不相同(由划分保证)，共享部分
+ * 只有一个逻辑进程，其事件戳直接是全局的；多个私有逻辑进程的PV可能相同，
+ * 同步点合并它们的执行记录，得到发往共享部分的事件的全局事件戳
+ */
+struct LPLayout {
+  // handlers of each cpu and its private caches
+  vector<vector<EventHandler *> >   privates;
+  // handlers shared by several cpus, may be empty
+  vector<EventHandler *>            shared;
+  // minimal latency from the shared handlers back to the private ones
+  u32                               lookahead;
+};
+
+class ParallelEngine {
+ private:
+  // the shared logical process runs on the calling thread
+  EventEngine*              _shared;
+  vector<EventEngine*>      _privates;
+  bool                      _has_shared;
+  u32                       _lookahead;
+  // the furthest a private logical process runs ahead in one step
+  u32                       _step_ticks;
+
+  // called first on every worker thread, e.g. to bind the components
+  function<void()>          _thread_init;
+  vector<thread>            _threads;
+  atomic<u64>               _step;
+  atomic<u32>               _running;
+  s64                       _private_end;
+  bool                      _stop;
+
+  // for the report
+  u64                       _steps;
+  vector<u64>               _sent;
+  s64                       _max_tick;
+
+  // merged index of each record in the execution logs of the private parts
+  vector<vector<u32> >      _global_index;
+
+  void worker(u32 id);
+  void wait_workers();
+  u64 resolve(u32 id, s64 pv, u64 seq, size_t limit);
+  void merge_private_logs();
+  void deliver(EventEngine *lp, u32 id);
+  void resolve_pending(u32 id);
+  void reclaim_pools();
+
+ public:
+  ParallelEngine(EventEngine *shared, const LPLayout &layout,
+                 const function<void()> &thread_init = nullptr);
+  ~ParallelEngine();
+  ParallelEngine(const ParallelEngine &) = delete;
+  ParallelEngine & operator= (const ParallelEngine &) = delete;
+
+  // run until all queues are empty
+  void run();
+  void display(FILE *stream);
+};
+
+#endif
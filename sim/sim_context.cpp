@@ -0,0 +1,175 @@
+#include "sim_context.h"
+
+static const char *CHECKPOINT_VERSION = "lightsim checkpoint 8";
+
+SimulationContext::SimulationContext() {
+  _engine = new EventEngine();
+  _policy_factory = new PolicyFactory();
+  _stats_manager = new MemoryStatsManager();
+  _census_taker = new CensusTaker();
+  _trace_loader = new MultiTraceLoader();
+  _cfg_loader = new SimCfgLoader();
+  _trace_cfg_loader = new TracesCfgLoader();
+  _builder = new PipeLineBuilder();
+}
+
+// the units free their events and data into the pools of this context
+SimulationContext::~SimulationContext() {
+  bind();
+  delete _builder;
+  delete _trace_cfg_loader;
+  delete _cfg_loader;
+  delete _trace_loader;
+  delete _census_taker;
+  delete _stats_manager;
+  delete _policy_factory;
+  delete _engine;
+  unbind();
+}
+
+void SimulationContext::bind() {
+  EventEngineObj::bind_local(_engine);
+  PolicyFactoryObj::bind_local(_policy_factory);
+  MemoryStatsManagerObj::bind_local(_stats_manager);
+  CensusTakerObj::bind_local(_census_taker);
+  MultiTraceLoaderObj::bind_local(_trace_loader);
+  CfgLoaderObj::bind_local(_cfg_loader);
+  TraceCfgLoaderObj::bind_local(_trace_cfg_loader);
+  PipeLineBuilderObj::bind_local(_builder);
+}
+
+void SimulationContext::unbind() {
+  EventEngineObj::bind_local(NULL);
+  PolicyFactoryObj::bind_local(NULL);
+  MemoryStatsManagerObj::bind_local(NULL);
+  CensusTakerObj::bind_local(NULL);
+  MultiTraceLoaderObj::bind_local(NULL);
+  CfgLoaderObj::bind_local(NULL);
+  TraceCfgLoaderObj::bind_local(NULL);
+  PipeLineBuilderObj::bind_local(NULL);
+}
+
+void SimulationContext::save_checkpoint(const string &path) {
+  CheckpointWriter w(path);
+  w.begin_section(CHECKPOINT_VERSION);
+  _trace_loader->save(w);
+  _builder->save(w);
+  _stats_manager->save(w);
+  _census_taker->save(w);
+  _engine->save(w, [this](CheckpointWriter &w, Event *e) {
+    _builder->save_event(w, e);
+  });
+  SIMLOG(SIM_INFO, "checkpoint %s saved at tick %lld\n", path.c_str(), _engine->get_tick());
+}
+
+// the cpus read their traces ahead, so the traces are restored first
+void SimulationContext::restore_checkpoint(const string &path) {
+  CheckpointReader r(path);
+  r.check_section(CHECKPOINT_VERSION);
+  _trace_loader->restore(r);
+  _builder->restore(r);
+  _stats_manager->restore(r);
+  _census_taker->restore(r);
+  _engine->restore(r, [this](CheckpointReader &r) {
+    return _builder->load_event(r);
+  });
+  SIMLOG(SIM_INFO, "checkpoint %s restored at tick %lld\n", path.c_str(), _engine->get_tick());
+}
+
+void SimulationContext::run(const SimulationOptions &options, FILE *stream) {
+  bind();
+  _census_taker->init(options.freq, stream);
+
+  // 0. set instructions
+  assert(options.inst >= -1);
+  assert(options.inst < 1000000000);
+  _trace_loader->set_read_bound(options.inst);
+
+  // 1. load trace file
+  _trace_cfg_loader->parse(options.trace_cfg);
+  auto traces = _trace_cfg_loader->get_traces();
+  for (auto &trace: traces) {
+    _trace_loader->adding_trace(trace);
+  }
+  if (traces.size() != options.processes) {
+    SIMLOG(SIM_ERROR, "process number should equals to trace files\n");
+    exit(1);
+  }
+
+  // 2. load architecture
+  _cfg_loader->parse(options.cfg);
+  if (!options.policy.empty()) {
+    for (auto &entry: _cfg_loader->get_nodes()) {
+      if (entry.second->type == CacheNode &&
+          entry.first.find(options.policy_cache) != string::npos) {
+        ((CacheNodeCfg *)entry.second)->cr_policy = options.policy;
+      }
+    }
+  }
+  _builder->set_kernels(options.kernels);
+  _builder->load(_cfg_loader->get_nodes());
+  _builder->set_fast_path(options.fast_path);
+  _builder->set_batching(options.batching);
+
+  auto connectors = _builder->get_connectors();
+  if (connectors.size() < options.processes) {
+    SIMLOG(SIM_WARNING, "available cores is fewer than processes, \
+           only %d processes will be simulated\n", (int)connectors.size());
+  }
+
+  if (!options.restore.empty()) {
+    restore_checkpoint(options.restore);
+  }
+  else {
+    for (unsigned int i = 0; i < options.processes; i++) {
+      connectors[i]->start();
+    }
+  }
+
+  bool save = !options.checkpoint.empty();
+  if (save && options.checkpoint_at < 0) {
+    SIMLOG(SIM_ERROR, "the instruction to save the checkpoint at is not given\n");
+    exit(1);
+  }
+  if (save && options.parallel) {
+    SIMLOG(SIM_WARNING, "checkpoint is only saved by the serial simulation\n");
+  }
+
+  LPLayout layout;
+  if (options.parallel && !save && _builder->partition(layout)) {
+    // the worker threads use the components of this context as well
+    ParallelEngine pdes(_engine, layout, [this]() { bind(); });
+    pdes.run();
+    _stats_manager->display_all(stream);
+    pdes.display(stream);
+  }
+  else {
+    if (options.parallel) {
+      SIMLOG(SIM_WARNING, "fall back to the serial simulation\n");
+    }
+    while (true) {
+      auto ret = _engine->drain_tick();
+      if (ret == 0)
+        break;
+      if (save && _trace_loader->get_max_position() >= options.checkpoint_at) {
+        save_checkpoint(options.checkpoint);
+        save = false;
+      }
+    }
+    // print stats
+    _stats_manager->display_all(stream);
+    _engine->display_pools(stream);
+  }
+  fprintf(stream, "targeted memory arrive: %llu events saved\n",
+          _builder->get_saved_events());
+  fprintf(stream, "L1 fast path: %llu hits without events\n",
+          _builder->get_fast_hits());
+  fprintf(stream, "non-memory batching: %llu instructions without events\n",
+          _builder->get_batched());
+  fprintf(stream, "cache kernels: %u caches specialized\n",
+          _builder->get_kernel_caches());
+  _builder->display_mshr(stream);
+  _builder->display_footprint(stream);
+  _builder->display_policies(stream);
+  unbind();
+}
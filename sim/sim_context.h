@@ -0,0 +1,74 @@
+#ifndef SIM_CONTEXT_H
+#define SIM_CONTEXT_H
+
+#include "memory_hierarchy.h"
+#include "trace_loader.h"
+#include "cfg_loader.h"
+
+using namespace std;
+
+struct SimulationOptions {
+  string            cfg;
+  string            trace_cfg;
+  u32               processes;
+  s32               freq;
+  s64               inst;
+  bool              parallel;
+  // replace the policy of the caches whose name contains policy_cache,
+  // empty policy keeps the configuration
+  string            policy;
+  string            policy_cache;
+  bool              fast_path;
+  bool              batching;
+  // compile-time specialized kernels for the common cache geometries
+  bool              kernels;
+  // save the state to checkpoint once a cpu has read checkpoint_at
+  // instructions, start from the state in restore
+  string            checkpoint;
+  s64               checkpoint_at;
+  string            restore;
+
+  SimulationOptions() : processes(0), freq(500000), inst(-1), parallel(false),
+                        fast_path(true), batching(true), kernels(true), checkpoint_at(-1) {};
+};
+
+/*
+ * 一次仿真所需的全部组件(事件引擎、统计、替换策略、流水线、census、trace与配置)
+ * 各组件仍通过 XXXObj::get_instance() 访问，bind() 使调用线程的 get_instance()
+ * 返回本context中的对象(Singleton的线程局部绑定)，未绑定的线程仍使用全局对象。
+ * 因此一个进程中可以在不同线程上同时运行多个互不影响的仿真，如策略对比(sweep)
+ */
+class SimulationContext {
+ private:
+  EventEngine*          _engine;
+  PolicyFactory*        _policy_factory;
+  MemoryStatsManager*   _stats_manager;
+  CensusTaker*          _census_taker;
+  MultiTraceLoader*     _trace_loader;
+  SimCfgLoader*         _cfg_loader;
+  TracesCfgLoader*      _trace_cfg_loader;
+  PipeLineBuilder*      _builder;
+
+  // only between two ticks of the serial simulation
+  void save_checkpoint(const string &path);
+  // after the pipeline is built from the same configuration
+  void restore_checkpoint(const string &path);
+
+ public:
+  SimulationContext();
+  ~SimulationContext();
+  SimulationContext(const SimulationContext &) = delete;
+  SimulationContext & operator= (const SimulationContext &) = delete;
+
+  // the components used by the calling thread are the ones of this context
+  void bind();
+  // back to the process-wide components
+  static void unbind();
+
+  // run a whole simulation on the calling thread, the report goes to stream
+  void run(const SimulationOptions &options, FILE *stream);
+  // the tick of the last event
+  u64 get_tick() { return _engine->get_tick(); }
+};
+
+#endif
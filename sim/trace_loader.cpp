@@ -4,6 +4,8 @@
 
 #include "trace_loader.h"
 
+#include <algorithm>
+
 // TraceFormat::TraceFormat() : pc(0), opcode(0), thread_id(0),
 TraceFormat::TraceFormat() : pc(0), 
                              is_branch(0), branch_taken(0) {
@@ -17,6 +19,17 @@ TraceFormat::TraceFormat() : pc(0),
   }
 }
 
+u32 count_references(const TraceFormat &trace) {
+  u32 count = 0;
+  for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+    count += trace.source_memory[i] != 0;
+  }
+  for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+    count += trace.destination_memory[i] != 0;
+  }
+  return count;
+}
+
 TraceLoader::TraceLoader(const string &filename) {
   char gzip_command[512];
   sprintf(gzip_command, "gunzip -c %s", filename.c_str());
@@ -35,12 +48,24 @@ void TraceLoader::set_read_bound(s64 bound) {
 }
 
 size_t TraceLoader::next_instruction(TraceFormat &trace) {
-  if (_bound == -1 || _count++ < _bound) {
-    return fread(&trace, sizeof(TraceFormat), 1, _trace_file);
-  }
-  else {
+  if (_bound != -1 && _count >= _bound) {
     return 0;
   }
+  size_t ret = fread(&trace, sizeof(TraceFormat), 1, _trace_file);
+  _count += ret;
+  return ret;
+}
+
+void TraceLoader::seek(s64 position) {
+  assert(_count == 0);
+  TraceFormat trace;
+  while (_count < position) {
+    if (fread(&trace, sizeof(TraceFormat), 1, _trace_file) != 1) {
+      SIMLOG(SIM_ERROR, "trace is shorter than the checkpoint position %lld\n", position);
+      exit(1);
+    }
+    _count++;
+  }
 }
 
 MultiTraceLoader::~MultiTraceLoader() {
@@ -53,6 +78,7 @@ void MultiTraceLoader::adding_trace(const string &filename) {
   auto trace_loader = new TraceLoader(filename);
   trace_loader->set_read_bound(_bound);
   _trace_loaders.push_back(trace_loader);
+  _trace_files.push_back(filename);
 }
 
 size_t MultiTraceLoader::get_trace_num() const {
@@ -68,12 +94,17 @@ s32 MultiTraceLoader::assign_trace() {
 
 size_t MultiTraceLoader::next_instruction(u32 trace_id, TraceFormat &trace) {
   assert(trace_id < this->get_trace_num());
+  size_t ret = _trace_loaders[trace_id]->next_instruction(trace);
+  relocate(trace_id, trace);
+  return ret;
+}
+
+void MultiTraceLoader::relocate(u32 trace_id, TraceFormat &trace) {
   //64 bit VM range
   //0x000'00000000 through 0x7FF'FFFFFFFF
   // this is a magic number for resolving VM address conflict
   const u64 shift =  0xFFFFFFFFF;
   const u64 range =  0x7FFFFFFFFFF;
-  size_t ret = _trace_loaders[trace_id]->next_instruction(trace);
   for (u32 i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
     if (trace.destination_memory[i]== 0) continue;
     trace.destination_memory[i] += shift * trace_id;
@@ -84,9 +115,33 @@ size_t MultiTraceLoader::next_instruction(u32 trace_id, TraceFormat &trace) {
     trace.source_memory[i] += shift * trace_id;
     trace.source_memory[i] = trace.source_memory[i] % range;
   }
-  return ret;
 }
 
 void MultiTraceLoader::set_read_bound(s64 b) {
   _bound = b;
 }
+
+s64 MultiTraceLoader::get_max_position() {
+  s64 position = 0;
+  for (auto trace_loader: _trace_loaders) {
+    position = max(position, trace_loader->get_position());
+  }
+  return position;
+}
+
+void MultiTraceLoader::save(CheckpointWriter &w) {
+  w.begin_section("traces");
+  w.write<u64>(_trace_loaders.size());
+  for (auto trace_loader: _trace_loaders) {
+    w.write(trace_loader->get_position());
+  }
+}
+
+// the bound still counts from the beginning of the traces
+void MultiTraceLoader::restore(CheckpointReader &r) {
+  r.check_section("traces");
+  r.check(r.read<u64>() == _trace_loaders.size(), "number of traces");
+  for (auto trace_loader: _trace_loaders) {
+    trace_loader->seek(r.read<s64>());
+  }
+}
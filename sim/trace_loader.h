@@ -3,6 +3,7 @@
 
 #include "inc_all.h"
 #include "util.h"
+#include "checkpoint.h"
 #define NUM_INSTR_DESTINATIONS 2
 #define NUM_INSTR_SOURCES 4
 #define LONGEST_OP_CODE_STRING 16
@@ -37,11 +38,16 @@ struct __attribute__ ((packed)) TraceFormat {
   TraceFormat();
 };
 
+// the memory references of an instruction are its non-zero source addresses
+// and then its non-zero destination addresses, in the order of the arrays
+u32 count_references(const TraceFormat &trace);
+
 
 class TraceLoader {
  private:
   FILE *      _trace_file;
   s64         _bound = -1;
+  // instructions read
   s64         _count = 0;
   TraceLoader() {}
  public:
@@ -49,12 +55,20 @@ class TraceLoader {
   ~TraceLoader();
   void set_read_bound(s64 bound);
   size_t next_instruction(TraceFormat &trace);
+
+  inline s64 get_position() {
+    return _count;
+  }
+
+  // the trace is a pipe, skip to the position by reading
+  void seek(s64 position);
 };
 
 
 class MultiTraceLoader {
  private:
   vector<TraceLoader *>   _trace_loaders;
+  vector<string>          _trace_files;
   size_t                  _cur_assigned;
   s64                     _bound = -1;
  public:
@@ -64,7 +78,17 @@ class MultiTraceLoader {
   size_t get_trace_num() const;
   s32 assign_trace();
   size_t next_instruction(u32 trace_id, TraceFormat &trace);
+  // the traces of different ids do not share addresses
+  static void relocate(u32 trace_id, TraceFormat &trace);
+  inline const string& get_trace_file(u32 trace_id) {
+    return _trace_files[trace_id];
+  }
   void set_read_bound(s64);
+  // the most instructions read from one trace
+  s64 get_max_position();
+
+  void save(CheckpointWriter &w);
+  void restore(CheckpointReader &r);
 };
 
 
@@ -1,4 +1,8 @@
 #include "memory_hierarchy.h"
+#include "sim_context.h"
+#include "cache_kernel.h"
+#include "hashed_cache.h"
+#include "cr_policy.h"
 #include "trace_loader.h"
 #include "cfg_loader.h"
 
@@ -7,6 +11,8 @@
 #include <time.h>
 #include <cmath>
 #include <cstring>
+#include <thread>
+#include <unistd.h>
 
 void test_valid_addr() {
   assert(check_addr_valid(1));
@@ -74,6 +80,672 @@ void test_event_engine() {
   }
 }
 
+// the timing wheel engine must process events in exactly the same order as
+// the multimap engine: (tick, type, priority, FIFO)
+template <typename Engine, typename Step>
+static vector<pair<u64, u32> > run_order_workload(Engine *engine, Step step) {
+  struct OrderData: public EventDataBase {
+    u32 id;
+    OrderData(u32 id_) : id(id_) {};
+  };
+
+  class OrderHandler: public EventHandler {
+   private:
+    Engine*                   _engine;
+    u32                       _next_id;
+    u32                       _budget;
+    vector<pair<u64, u32> >   _order;
+
+   protected:
+    bool validate(EventType t) {
+      (void)t;
+      return true;
+    }
+
+    void proc(u64 tick, EventDataBase* data, EventType type) {
+      (void)type;
+      _order.push_back({tick, ((OrderData *)data)->id});
+      // fan out to near and far future, including the current tick
+      u32 fanout = _budget > 0 ? (rand() % 3) : 0;
+      for (u32 i = 0; i < fanout && _budget > 0; i++, _budget--) {
+        static const u32 delays[] = {0, 1, 10, 100, 255, 256, 1000, 500000};
+        schedule(delays[rand() % 8]);
+      }
+    }
+
+   public:
+    OrderHandler(Engine *engine) : EventHandler("order"), _engine(engine),
+        _next_id(0), _budget(20000) {};
+
+    void schedule(u32 delay) {
+      EventType type = (EventType)(1 + rand() % (TypeCount - 1));
+      Event *e = new Event(type, this, new OrderData(_next_id++));
+      _engine->register_after_now(e, delay, rand() % 4);
+    }
+
+    vector<pair<u64, u32> > &get_order() {
+      return _order;
+    }
+  };
+
+  OrderHandler handler(engine);
+  for (u32 i = 0; i < 64; i++) {
+    handler.schedule(rand() % 2000);
+  }
+  while (step());
+  return handler.get_order();
+}
+
+void test_event_engine_order() {
+  u32 seed = time(NULL);
+  srand(seed);
+  MultimapEventEngine map_engine;
+  auto expected = run_order_workload(&map_engine, [&]() {
+    return map_engine.loop();
+  });
+
+  srand(seed);
+  EventEngine wheel_engine;
+  auto actual = run_order_workload(&wheel_engine, [&]() {
+    return wheel_engine.loop();
+  });
+
+  assert(expected.size() > 1000);
+  assert(expected == actual);
+
+  // draining a tick at a time keeps the same order, and the hook is
+  // called once at the beginning of each tick
+  srand(seed);
+  EventEngine drain_engine;
+  vector<u64> hooked_ticks;
+  drain_engine.add_tick_hook([&](u64 tick) {
+    hooked_ticks.push_back(tick);
+  });
+  u32 drains = 0;
+  auto drained = run_order_workload(&drain_engine, [&]() {
+    drains++;
+    return drain_engine.drain_tick();
+  });
+  assert(expected == drained);
+
+  vector<u64> ticks;
+  for (auto &entry: expected) {
+    if (ticks.empty() || ticks.back() != entry.first) {
+      ticks.push_back(entry.first);
+    }
+  }
+  assert(hooked_ticks == ticks);
+  assert(drains == ticks.size() + 1);
+}
+
+// after warming up, the pools should serve all events without malloc
+void test_event_pool() {
+  class PoolHandler: public EventHandler {
+   private:
+    EventEngine*  _engine;
+    u32           _budget;
+
+   protected:
+    bool validate(EventType t) {
+      (void)t;
+      return true;
+    }
+
+    void proc(u64 tick, EventDataBase* data, EventType type) {
+      (void)tick, (void)data, (void)type;
+      if (_budget == 0)
+        return;
+      _budget--;
+      MemoryEventData *d = new MemoryEventData(tick, 0, 0);
+      Event *e = new Event(MemoryOnAccess, this, d);
+      _engine->register_after_now(e, rand() % 1000, 0);
+    }
+
+   public:
+    PoolHandler(EventEngine *engine, u32 budget) : EventHandler("pool"),
+        _engine(engine), _budget(budget) {};
+  };
+
+  // pools are owned by the global engine, the events run on a private one
+  EventEngine *global_engine = EventEngineObj::get_instance();
+  auto event_pool = global_engine->get_pool<Event>("Event");
+  auto data_pool = global_engine->get_pool<MemoryEventData>("MemoryEventData");
+
+  for (u32 round = 0; round < 2; round++) {
+    u64 event_slabs = event_pool->get_slab_allocs();
+    u64 data_slabs = data_pool->get_slab_allocs();
+    u64 allocs = event_pool->get_allocs();
+    u64 event_in_use = event_pool->get_in_use();
+    u64 data_in_use = data_pool->get_in_use();
+
+    EventEngine evnet_queue;
+    PoolHandler handler(&evnet_queue, 100000);
+    for (u32 i = 0; i < 1000; i++) {
+      Event *e = new Event(MemoryOnAccess, &handler, new MemoryEventData(i, 0, 0));
+      evnet_queue.register_after_now(e, i, 0);
+    }
+    while (evnet_queue.loop());
+
+    assert(event_pool->get_allocs() - allocs == 101000);
+    assert(event_pool->get_in_use() == event_in_use);
+    assert(data_pool->get_in_use() == data_in_use);
+    // the second round runs entirely on recycled objects
+    if (round > 0) {
+      assert(event_pool->get_slab_allocs() == event_slabs);
+      assert(data_pool->get_slab_allocs() == data_slabs);
+    }
+  }
+}
+
+void test_event_dispatch() {
+  // MemoryOnAccess is bound statically, MemoryOnArrive falls back to proc
+  class DispatchHandler: public EventHandler {
+   protected:
+    bool validate(EventType t) {
+      return t == MemoryOnAccess || t == MemoryOnArrive;
+    }
+
+    void proc(u64 tick, EventDataBase* data, EventType type) {
+      (void)tick, (void)data;
+      assert(type == MemoryOnArrive);
+      virtual_calls++;
+    }
+
+   public:
+    u32 static_calls;
+    u32 virtual_calls;
+
+    DispatchHandler() : EventHandler("dispatch"), static_calls(0),
+        virtual_calls(0) {
+      set_kind(dispatch_kind());
+    };
+
+    void handle_access(u64 tick, EventDataBase* data) {
+      (void)tick, (void)data;
+      static_calls++;
+    }
+
+    static u32 dispatch_kind() {
+      static u32 kind = [] {
+        u32 k = EventDispatcher::new_kind();
+        EventDispatcher::bind<DispatchHandler,
+                              &DispatchHandler::handle_access>(k, MemoryOnAccess);
+        return k;
+      }();
+      return kind;
+    }
+  };
+
+  DispatchHandler handler;
+  assert(handler.get_kind() > 0);
+  for (u32 i = 0; i < 10; i++) {
+    Event e(i % 2 ? MemoryOnArrive : MemoryOnAccess, &handler, NULL);
+    e.execute(i);
+  }
+  assert(handler.static_calls == 5);
+  assert(handler.virtual_calls == 5);
+}
+
+// the parallel engine must process every handler's events in the same order
+// as the serial engine, including events of the same PV sent by different
+// logical processes
+static vector<vector<pair<u64, u32> > > run_pdes_workload(u64 seed, bool parallel) {
+  struct PdesData: public EventDataBase {
+    u32 id;
+    PdesData(u32 id_) : id(id_) {};
+  };
+
+  class PdesHandler: public EventHandler {
+   private:
+    u32                       _index;
+    u64                       _state;
+    u32                       _budget;
+    u32                       _next_id;
+    bool                      _shared;
+
+    u32 random() {
+      _state ^= _state << 13;
+      _state ^= _state >> 7;
+      _state ^= _state << 17;
+      return _state;
+    }
+
+   protected:
+    bool validate(EventType t) {
+      return t == MemoryOnAccess;
+    }
+
+    void proc(u64 tick, EventDataBase* data, EventType type) {
+      (void)type;
+      order.push_back({tick, ((PdesData *)data)->id});
+      u32 fanout = 1 + random() % 2;
+      for (u32 i = 0; i < fanout && _budget > 0; i++, _budget--) {
+        u32 r = random();
+        if (!_shared) {
+          if (r % 4 == 0)
+            send(peers[0], 1, 2);
+          else
+            send(this, r % 8, 1);
+        }
+        else {
+          if (r % 3 == 0)
+            send(this, r % 5, 2);
+          else
+            send(peers[1 + r % (peers.size() - 1)], 20 + r % 50, 1);
+        }
+      }
+    }
+
+   public:
+    // peers[0] is the shared handler
+    vector<PdesHandler*>      peers;
+    vector<pair<u64, u32> >   order;
+
+    PdesHandler(u32 index, u64 seed, bool shared) : EventHandler("pdes"),
+        _index(index), _state(seed * 2654435761ULL + index + 1),
+        _budget(shared ? 6000 : 3000), _next_id(0), _shared(shared) {};
+
+    void send(PdesHandler *target, u32 delay, u32 priority) {
+      Event *e = new Event(MemoryOnAccess, target,
+                           new PdesData((_index << 20) | _next_id++));
+      EventEngineObj::get_instance()->register_after_now(e, delay, priority);
+    }
+  };
+
+  EventEngine engine;
+  EventEngineObj::bind_local(&engine);
+  vector<PdesHandler*> handlers;
+  for (u32 i = 0; i < 4; i++) {
+    handlers.push_back(new PdesHandler(i, seed, i == 0));
+  }
+  for (auto h: handlers) {
+    h->peers = handlers;
+  }
+  for (u32 i = 1; i < 4; i++) {
+    for (u32 j = 0; j < 4; j++) {
+      handlers[i]->send(handlers[i], j * 3, 1);
+    }
+  }
+
+  if (parallel) {
+    LPLayout layout;
+    layout.privates = {{handlers[1]}, {handlers[2]}, {handlers[3]}};
+    layout.shared = {handlers[0]};
+    layout.lookahead = 20;
+    ParallelEngine pdes(&engine, layout);
+    pdes.run();
+  }
+  else {
+    while (engine.drain_tick());
+  }
+  EventEngineObj::bind_local(NULL);
+
+  vector<vector<pair<u64, u32> > > orders;
+  for (auto h: handlers) {
+    orders.push_back(h->order);
+    delete h;
+  }
+  return orders;
+}
+
+void test_parallel_engine() {
+  u64 seed = time(NULL);
+  auto expected = run_pdes_workload(seed, false);
+  auto actual = run_pdes_workload(seed, true);
+  assert(expected[0].size() > 1000);
+  assert(expected == actual);
+}
+
+// the data only goes back to the previous units that asked for it
+void test_targeted_arrive() {
+  EventEngine evnet_queue;
+  EventEngineObj::bind_local(&evnet_queue);
+
+  MemoryConfig main_memory_cfg(3, 100);
+  MemoryConfig L1_cfg(1, 2, 4, 64, 16, LRU_POLICY);
+  MemoryConfig L2_cfg(2, 10, 4, 64, 64, LRU_POLICY);
+  CacheUnit* L1_cache_0 = new CacheUnit("routing L1 0", L1_cfg);
+  CacheUnit* L1_cache_1 = new CacheUnit("routing L1 1", L1_cfg);
+  CacheUnit* L2_cache = new CacheUnit("routing L2", L2_cfg);
+  MainMemory* memory = new MainMemory("routing memory", main_memory_cfg);
+  CpuConnector* cpu0 = new CpuConnector("routing CPU0", 0);
+  CpuConnector* cpu1 = new CpuConnector("routing CPU1", 1);
+  cpu0->set_next(L1_cache_0);
+  L1_cache_0->add_prev(cpu0);
+  cpu1->set_next(L1_cache_1);
+  L1_cache_1->add_prev(cpu1);
+  L1_cache_0->set_next(L2_cache);
+  L1_cache_1->set_next(L2_cache);
+  L2_cache->add_prev(L1_cache_0);
+  L2_cache->add_prev(L1_cache_1);
+  L2_cache->set_next(memory);
+  memory->add_prev(L2_cache);
+
+  // L2 misses, then hits for the other cpu
+  cpu0->issue_memory_access(MemoryAccessInfo(0x1000, 0, 0), nullptr);
+  while (evnet_queue.loop());
+  cpu1->issue_memory_access(MemoryAccessInfo(0x1000, 0, 1), nullptr);
+  while (evnet_queue.loop());
+  assert(L2_cache->get_saved_events() == 2);
+  assert(memory->get_saved_events() == 0);
+
+  // both cpus miss on the same line at once, the L2 miss is coalesced
+  cpu0->issue_memory_access(MemoryAccessInfo(0x2000, 0, 0), nullptr);
+  cpu1->issue_memory_access(MemoryAccessInfo(0x2000, 0, 1), nullptr);
+  while (evnet_queue.loop());
+  assert(L2_cache->get_saved_events() == 2);
+
+  delete cpu0;
+  delete cpu1;
+  delete L1_cache_0;
+  delete L1_cache_1;
+  delete L2_cache;
+  delete memory;
+  EventEngineObj::bind_local(NULL);
+}
+
+// the addresses and PCs a cache is accessed and filled with
+class PCRecordingCache : public CacheUnit {
+ public:
+  vector<pair<u64, u64> > accesses;
+  vector<pair<u64, u64> > fills;
+
+  PCRecordingCache(const string &tag, const MemoryConfig &config) : CacheUnit(tag, config) {};
+
+ protected:
+  bool try_access_memory(const MemoryAccessInfo &info) {
+    accesses.push_back(make_pair(info.addr, info.PC));
+    return CacheUnit::try_access_memory(info);
+  }
+
+  void on_memory_arrive(const MemoryAccessInfo &info) {
+    fills.push_back(make_pair(info.addr, info.PC));
+    CacheUnit::on_memory_arrive(info);
+  }
+};
+
+// every level sees the PC of the instruction, a fill the PC of the primary
+// miss, on the event path and the L1 hit fast path
+void test_pc_propagation() {
+  EventEngine evnet_queue;
+  EventEngineObj::bind_local(&evnet_queue);
+
+  MemoryConfig main_memory_cfg(3, 100);
+  MemoryConfig L1_cfg(1, 2, 4, 64, 16, LRU_POLICY);
+  MemoryConfig L2_cfg(2, 10, 4, 128, 64, LRU_POLICY);
+  PCRecordingCache* L1_cache = new PCRecordingCache("pc L1", L1_cfg);
+  PCRecordingCache* L2_cache = new PCRecordingCache("pc L2", L2_cfg);
+  MainMemory* memory = new MainMemory("pc memory", main_memory_cfg);
+  CpuConnector* cpu = new CpuConnector("pc CPU", 0);
+  cpu->set_next(L1_cache);
+  L1_cache->add_prev(cpu);
+  L1_cache->set_next(L2_cache);
+  L2_cache->add_prev(L1_cache);
+  L2_cache->set_next(memory);
+  memory->add_prev(L2_cache);
+
+  // the second access merges into the L1 miss of the first, the third into
+  // the L2 miss (the L2 block holds two L1 blocks)
+  vector<MemoryAccessInfo> trace;
+  trace.push_back(MemoryAccessInfo(0x1000, 0x401000, 0));
+  trace.push_back(MemoryAccessInfo(0x1008, 0x401004, 0));
+  trace.push_back(MemoryAccessInfo(0x1040, 0x401008, 0));
+  cpu->set_tracer(trace);
+  for (u32 i = 0; i < trace.size(); i++) {
+    cpu->issue_memory_access();
+  }
+  while (evnet_queue.loop());
+
+  typedef vector<pair<u64, u64> > Records;
+  assert((L1_cache->accesses == Records{{0x1000, 0x401000}, {0x1040, 0x401008}}));
+  assert((L1_cache->fills == Records{{0x1000, 0x401000}, {0x1040, 0x401008}}));
+  assert((L2_cache->accesses == Records{{0x1000, 0x401000}}));
+  assert((L2_cache->fills == Records{{0x1000, 0x401000}}));
+
+  // hits on both paths
+  cpu->issue_memory_access(MemoryAccessInfo(0x1010, 0x40100c, 0), nullptr);
+  while (evnet_queue.loop());
+  cpu->set_fast_path(true);
+  cpu->issue_memory_access(MemoryAccessInfo(0x1050, 0x401010, 0), nullptr);
+  while (evnet_queue.loop());
+  assert(L1_cache->accesses.size() == 4);
+  assert((L1_cache->accesses[2] == make_pair(0x1010ULL, 0x40100cULL)));
+  assert((L1_cache->accesses[3] == make_pair(0x1050ULL, 0x401010ULL)));
+
+  delete cpu;
+  delete L1_cache;
+  delete L2_cache;
+  delete memory;
+  EventEngineObj::bind_local(NULL);
+}
+
+// the open-addressed table agrees with a map under inserts and removals
+void test_mshr_table() {
+  MSHRTable mshr(8);
+  mshr.set_line_bits(6);
+  map<u64, u64> ref;
+  srand(3);
+  for (u32 i = 0; i < 10000; i++) {
+    u64 line = mshr.line_of((u64)(rand() % 32) << 6);
+    MSHREntry *entry = mshr.find(line);
+    assert((entry != NULL) == (ref.count(line) == 1));
+    if (entry) {
+      assert(entry->waiters == ref[line] && entry->addr == line << 6);
+      mshr.release(entry);
+      ref.erase(line);
+    }
+    else if (!mshr.full()) {
+      mshr.allocate(line, MemoryEventData(line << 6, 0, 0), i);
+      ref[line] = i;
+    }
+    assert(mshr.size() == ref.size());
+  }
+  assert(mshr.get_peak() == 8);
+}
+
+// secondary misses merge, a full table stalls the unit, and a larger block
+// from the next level completes every entry it covers
+void test_mshr() {
+  EventEngine evnet_queue;
+  EventEngineObj::bind_local(&evnet_queue);
+
+  for (u32 mshrs: {1, 16}) {
+    MemoryConfig main_memory_cfg(3, 100);
+    MemoryConfig L1_cfg(1, 2, 4, 64, 16, LRU_POLICY, mshrs);
+    MemoryConfig L2_cfg(2, 10, 4, 128, 64, LRU_POLICY);
+    CacheUnit* L1_cache = new CacheUnit("mshr L1", L1_cfg);
+    CacheUnit* L2_cache = new CacheUnit("mshr L2", L2_cfg);
+    MainMemory* memory = new MainMemory("mshr memory", main_memory_cfg);
+    CpuConnector* cpu = new CpuConnector("mshr CPU", 0);
+    cpu->set_next(L1_cache);
+    L1_cache->add_prev(cpu);
+    L1_cache->set_next(L2_cache);
+    L2_cache->add_prev(L1_cache);
+    L2_cache->set_next(memory);
+    memory->add_prev(L2_cache);
+    MSHRTable &L1_mshr = L1_cache->get_mshr();
+    MSHRTable &L2_mshr = L2_cache->get_mshr();
+
+    if (mshrs == 1) {
+      // 0x1008 merges into the miss of 0x1000, 0x1040 waits for the only
+      // entry and then hits in the L2 block brought by 0x1000
+      cpu->issue_memory_access(MemoryAccessInfo(0x1000, 0, 0), nullptr);
+      cpu->issue_memory_access(MemoryAccessInfo(0x1008, 0, 0), nullptr);
+      cpu->issue_memory_access(MemoryAccessInfo(0x1040, 0, 0), nullptr);
+      while (evnet_queue.loop());
+      assert(L1_mshr.get_misses() == 2 && L1_mshr.get_merged() == 1);
+      assert(L1_mshr.get_stalls() == 1 && L1_mshr.get_peak() == 1);
+      assert(L2_mshr.get_misses() == 1 && L2_mshr.get_merged() == 0);
+    }
+    else {
+      // two L1 misses in one L2 block, the L2 sends the block once
+      cpu->issue_memory_access(MemoryAccessInfo(0x2000, 0, 0), nullptr);
+      cpu->issue_memory_access(MemoryAccessInfo(0x2040, 0, 0), nullptr);
+      while (evnet_queue.loop());
+      assert(L1_mshr.get_misses() == 2 && L1_mshr.get_stalls() == 0);
+      assert(L2_mshr.get_misses() == 1 && L2_mshr.get_merged() == 1);
+    }
+    assert(L1_mshr.empty() && L2_mshr.empty() && cpu->get_mshr().empty());
+
+    delete cpu;
+    delete L1_cache;
+    delete L2_cache;
+    delete memory;
+  }
+  EventEngineObj::bind_local(NULL);
+}
+
+// a 128 MB cache, more sets than the old limit of 65536, in two regions
+void test_large_cache() {
+  EventEngine evnet_queue;
+  EventEngineObj::bind_local(&evnet_queue);
+
+  u64 sets = 1 << 17;
+  MemoryConfig main_memory_cfg(2, 100);
+  MemoryConfig llc_cfg(1, 10, 16, 64, sets, LRU_POLICY);
+  CacheUnit* llc = new CacheUnit("large LLC", llc_cfg);
+  MainMemory* memory = new MainMemory("large memory", main_memory_cfg);
+  CpuConnector* cpu = new CpuConnector("large CPU", 0);
+  cpu->set_next(llc);
+  llc->add_prev(cpu);
+  llc->set_next(memory);
+  memory->add_prev(llc);
+
+  assert(llc->get_sets() == sets);
+  assert(llc->get_block_footprint() >= BlockArray::region_size(sets, 16));
+  assert(llc->get_set_footprint() >= sets * sizeof(CacheSet));
+  assert(llc->get_block_footprint() % MemoryRegion::HUGE_PAGE_SIZE == 0);
+  // huge page aligned, the whole rounded up size is usable
+  MemoryRegion region(3 * MemoryRegion::HUGE_PAGE_SIZE + 100);
+  assert((uintptr_t)region.get_base() % MemoryRegion::HUGE_PAGE_SIZE == 0);
+  assert(region.get_size() == 4 * MemoryRegion::HUGE_PAGE_SIZE);
+  ((char *)region.get_base())[region.get_size() - 1] = 1;
+
+  // the last set, then a hit in it
+  u64 addr = (sets - 1) * 64 + (5ULL << 23);
+  assert(llc->get_set_no(addr) == sets - 1);
+  for (u32 i = 0; i < 2; i++) {
+    cpu->issue_memory_access(MemoryAccessInfo(addr, 0, 0), nullptr);
+    while (evnet_queue.loop());
+  }
+  assert(llc->get_mshr().get_misses() == 1);
+  vector<u32> census(4, 0);
+  llc->pid_census(census);
+  assert(census[0] == 1);
+
+  delete cpu;
+  delete llc;
+  delete memory;
+  EventEngineObj::bind_local(NULL);
+}
+
+// simulations in their own contexts do not interfere with each other
+void test_simulation_context() {
+  SimulationOptions options;
+  options.cfg = "../cfg/cfg.json";
+  options.trace_cfg = "../cfg/traces.json";
+  options.processes = 1;
+  options.freq = 10000;
+  options.inst = 20000;
+
+  FILE *reports[2] = {tmpfile(), tmpfile()};
+  vector<thread> threads;
+  for (u32 i = 0; i < 2; i++) {
+    FILE *report = reports[i];
+    threads.push_back(thread([&options, report]() {
+      SimulationContext context;
+      context.run(options, report);
+    }));
+  }
+
+  string contents[2];
+  for (u32 i = 0; i < 2; i++) {
+    threads[i].join();
+    rewind(reports[i]);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), reports[i])) > 0) {
+      contents[i].append(buf, n);
+    }
+    fclose(reports[i]);
+  }
+  assert(contents[0].find("cache hits") != string::npos);
+  assert(contents[0] == contents[1]);
+}
+
+// the vectorized lookup agrees with the scalar one, padding never matches
+void test_tag_array() {
+  u32 ways_list[] = {1, 2, 3, 4, 5, 8, 16, 17};
+  for (u32 ways: ways_list) {
+    BlockArray tags(8, ways);
+    u32 stride = tags.get_stride();
+    assert(stride % BlockArray::TAG_LANES == 0 && stride >= ways);
+    for (u64 s = 0; s < 8; s++) {
+      u64 *set = tags.get_tags(s);
+      assert(((uintptr_t)set & 31) == 0);
+      for (u32 w = 0; w < ways; w++) {
+        set[w] = (rand() % 3) ? (s << 32) + w : BlockArray::INVALID_TAG;
+      }
+    }
+    for (u64 s = 0; s < 8; s++) {
+      u64 *set = tags.get_tags(s);
+      for (u64 tag = (s << 32); tag < (s << 32) + stride + 2; tag++) {
+        s32 pos = BlockArray::find(set, stride, tag);
+        assert(pos == BlockArray::find_scalar(set, stride, tag));
+        assert(pos == -1 || ((u32)pos < ways && set[pos] == tag));
+        if (tag - (s << 32) < ways && set[tag - (s << 32)] == tag) {
+          assert(pos == (s32)(tag - (s << 32)));
+        }
+      }
+      // the padding ways are empty but never found
+      s32 empty = -1;
+      for (u32 w = 0; w < ways && empty == -1; w++) {
+        empty = set[w] == BlockArray::INVALID_TAG ? w : -1;
+      }
+      assert(BlockArray::find_invalid(set, ways, stride) == empty);
+    }
+  }
+}
+
+// a cache counts into the aligned handler of its tag, resolved when it is built
+void test_stats_handler() {
+  auto stats_manager = MemoryStatsManagerObj::get_instance();
+  MemoryStats *stats = stats_manager->get_stats_handler("stats-test-cache");
+  assert(((uintptr_t)stats & 63) == 0);
+  assert(stats->is_empty());
+
+  MemoryConfig cfg(1, 10, 4, 64, 16, LRU_POLICY);
+  CacheUnit *cache = new CacheUnit("stats-test-cache", cfg);
+  assert(stats_manager->get_stats_handler("stats-test-cache") == stats);
+  assert(stats_manager->get_stats_handler("stats-test-other") != stats);
+  stats->increment_hit(1);
+  delete cache;
+  assert(!stats->is_empty());
+  stats->clear();
+}
+
+// the decoder agrees with slicing the address bit by bit
+void test_address_decoder() {
+  constexpr AddressDecoder fixed(64, 1024);
+  static_assert(fixed.get_tag_shift() == 16, "decoded at compile time");
+  static_assert(fixed.get_set_no(0x12345678) == ((0x12345678 >> 6) & 1023), "set number");
+
+  u64 geometries[][2] = {{1, 1}, {64, 1}, {64, 2}, {128, 32}, {256, 4096}, {4096, 1 << 20}};
+  for (auto &g: geometries) {
+    AddressDecoder decoder(g[0], g[1]);
+    u32 b = len_of_binary(g[0]);
+    u32 s = len_of_binary(g[1]);
+    assert(decoder.get_offset_bits() == b && decoder.get_tag_shift() == s + b);
+    for (u32 i = 0; i < 1000; i++) {
+      u64 addr = ((u64)rand() << 33) ^ ((u64)rand() << 11) ^ rand();
+      u64 set_no = s == 0 ? 0 : addr << (64 - s - b) >> (64 - s);
+      assert(decoder.get_set_no(addr) == set_no);
+      assert(decoder.get_tag(addr) == addr >> (s + b));
+      assert(decoder.get_block_addr(decoder.get_tag(addr), set_no) == (addr >> b << b));
+    }
+  }
+}
+
 void test_lru_set() {
   u32 ways = 8;
   u32 blk_size = 128;
@@ -102,34 +774,65 @@ void test_lru_set() {
     u64 shift = idx << 40;
     addrs.push_back(addr + shift);
     MemoryAccessInfo info(addr + shift, 0, 0);
-    line->on_memory_arrive(info);
+    // the first block is already in the set
+    if (!line->try_access_memory(info)) {
+      line->on_memory_arrive(info);
+    }
   }
 
-  auto blocks = line->get_all_blocks();
-  for (auto block : blocks) {
-    (void)block;
-    assert(block != NULL);
+  for (u32 idx = 0; idx < ways; idx++) {
+    assert(line->is_valid(idx));
   }
 
+  // blocks in the order of the LRU stack
+  auto lru_order = [&]() {
+    vector<u64> order(ways);
+    for (u32 idx = 0; idx < ways; idx++) {
+      order[line->get_state(idx)] = line->get_addr(idx);
+    }
+    return order;
+  };
+  // the last block inserted is at MRU
+  assert(lru_order()[0] == addrs[ways - 1]);
+
   for (u32 cnt = 0; cnt < 20; cnt++) {
     u64 addr = addrs[(rand() % ways)];
     MemoryAccessInfo info(addr, 0, 0);
-    auto old_blocks = line->get_all_blocks();
+    vector<u64> old_ways;
+    for (u32 idx = 0; idx < ways; idx++) {
+      old_ways.push_back(line->get_addr(idx));
+    }
+    auto old_blocks = lru_order();
     ret = line->try_access_memory(info);
     assert(ret == true);
 
+    // blocks stay in their ways
+    for (u32 idx = 0; idx < ways; idx++) {
+      assert(line->get_addr(idx) == old_ways[idx]);
+    }
+
     // check LRU
-    auto new_blocks = line->get_all_blocks();
+    auto new_blocks = lru_order();
+    assert(new_blocks[0] == addr);
     for (u32 idx = 0; idx < ways ; idx++) {
-      if (old_blocks[idx]->get_addr() == addr) {
+      if (old_blocks[idx] == addr) {
         for (idx = idx + 1; idx < ways; idx++) {
-          assert(new_blocks[idx]->get_addr() == old_blocks[idx]->get_addr());
+          assert(new_blocks[idx] == old_blocks[idx]);
         }
         break;
       }
-      assert(new_blocks[idx + 1]->get_addr() == old_blocks[idx]->get_addr());
+      assert(new_blocks[idx + 1] == old_blocks[idx]);
     }
   }
+
+  // a fill evicts the block at the LRU position
+  u64 lru_addr = lru_order()[ways - 1];
+  MemoryAccessInfo new_info(addr + ((u64)ways << 40), 0, 0);
+  line->on_memory_arrive(new_info);
+  assert(lru_order()[0] == new_info.addr);
+  assert(!line->contains(lru_addr));
+
+  delete line;
 }
 
 void test_random_set() {
@@ -148,21 +851,18 @@ void test_random_set() {
     line->on_memory_arrive(info);
   }
 
-  auto old_blocks = line->get_all_blocks();
-  for (auto block : old_blocks) {
-    (void)block;
-    assert(block != NULL);
+  for (u32 idx = 0; idx < ways; idx++) {
+    assert(line->is_valid(idx));
   }
 
   // random access
   for (u32 cnt = 0; cnt < 800 * ways; cnt++) {
     MemoryAccessInfo info(rand(), 0, 0);
-    line->on_memory_arrive(info);
+    if (!line->try_access_memory(info)) {
+      line->on_memory_arrive(info);
+    }
   }
-  //auto new_blocks = line->get_all_blocks();
-  //for (u32 idx = 0; idx < ways; idx++) {
-    //assert(old_blocks[idx]->get_addr() != new_blocks[idx]->get_addr());
-  //}
+  delete line;
 }
 
 bool prefix(const char * str, const char * prefix) {
@@ -247,10 +947,10 @@ void test_trace_cfg_loader() {
 
 // cpu -> memory
 void test_connector() {
-  vector<u64> mock_trace;
+  vector<MemoryAccessInfo> mock_trace;
   u64 addr = 0;
   for (int i = 0; i < 8; i++) {
-    mock_trace.push_back(addr);
+    mock_trace.push_back(MemoryAccessInfo(addr, 0x400000 + i * 4, 0));
     addr += 32;
   }
 
@@ -279,11 +979,11 @@ void test_connector() {
 // cpu0 -> L1 -> l2 -> memory
 // cpu1 -> L1 ---| 
 void test_pipeline() {
-  vector<u64> mock_trace_0, mock_trace_1;
+  vector<MemoryAccessInfo> mock_trace_0, mock_trace_1;
   u64 addr = 0, process_shift = 1 << 16;
   for (int i = 0; i < 16; i++) {
-    mock_trace_0.push_back(addr);
-    mock_trace_1.push_back(addr + process_shift);
+    mock_trace_0.push_back(MemoryAccessInfo(addr, 0x400000 + i * 4, 0));
+    mock_trace_1.push_back(MemoryAccessInfo(addr + process_shift, 0x400000 + i * 4, 0));
     addr += 32;
   }
 
@@ -344,11 +1044,11 @@ void test_pipeline_builder_mock_trace() {
   loader->parse("../cfg/cfg.json");
   builder->load(loader->get_nodes());
 
-  vector<u64> mock_trace_0, mock_trace_1;
+  vector<MemoryAccessInfo> mock_trace_0, mock_trace_1;
   u64 addr = 0, process_shift = 1 << 16;
   for (int i = 0; i < 16; i++) {
-    mock_trace_0.push_back(addr);
-    mock_trace_1.push_back(addr + process_shift);
+    mock_trace_0.push_back(MemoryAccessInfo(addr, 0x400000 + i * 4, 0));
+    mock_trace_1.push_back(MemoryAccessInfo(addr + process_shift, 0x400000 + i * 4, 0));
     addr += 32;
   }
 
@@ -410,6 +1110,837 @@ void test_pipeline_builder_actual_trace() {
   stats_manager->display_all(stdout);
 }
 
+// the L1 hit fast path and the instruction batching give the same stats and
+// ticks as the event path
+static void check_fast_hit_path(const string &trace_cfg, u32 processes) {
+  SimulationOptions options;
+  options.cfg = "../cfg/cfg.json";
+  options.trace_cfg = trace_cfg;
+  options.processes = processes;
+  options.freq = 10000;
+  options.inst = 20000;
+
+  string stats[2];
+  u64 ticks[2];
+  for (u32 i = 0; i < 2; i++) {
+    options.fast_path = (i == 1);
+    options.batching = (i == 1);
+    FILE *report = tmpfile();
+    SimulationContext context;
+    context.run(options, report);
+    ticks[i] = context.get_tick();
+
+    rewind(report);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), report)) > 0) {
+      stats[i].append(buf, n);
+    }
+    fclose(report);
+    assert((stats[i].find("L1 fast path: 0 ") == string::npos) == options.fast_path);
+    assert((stats[i].find("non-memory batching: 0 ") == string::npos) == options.batching);
+    stats[i] = stats[i].substr(0, stats[i].find("event pools:"));
+  }
+  assert(stats[0].find("cache hits") != string::npos);
+  assert(stats[0] == stats[1]);
+  assert(ticks[0] == ticks[1]);
+}
+
+void test_fast_hit_path() {
+  check_fast_hit_path("../cfg/traces.json", 1);
+
+  // the two cores of cfg.json share the L2, their L1s are private
+  const char *traces = "unit_test_traces2.json";
+  ofstream(traces) << R"({"traces": ["../traces/ls_trace.trace.gz",
+                                     "../traces/ls_trace.trace.gz"]})";
+  check_fast_hit_path(traces, 2);
+  remove(traces);
+}
+
+// the units of each cpu get their own event priorities, the shared ones the
+// priorities after them, the levels stay the major order
+void test_cpu_priorities() {
+  SimulationContext context;
+  context.bind();
+  auto trace_loader = MultiTraceLoaderObj::get_instance();
+  trace_loader->adding_trace("../traces/ls_trace.trace.gz");
+  trace_loader->adding_trace("../traces/ls_trace.trace.gz");
+  auto cfg_loader = CfgLoaderObj::get_instance();
+  cfg_loader->parse("../cfg/cfg.json");
+  auto builder = PipeLineBuilderObj::get_instance();
+  builder->load(cfg_loader->get_nodes());
+
+  // asking for the connectors again keeps the priorities
+  vector<u8> rounds[2];
+  for (u32 round = 0; round < 2; round++) {
+    auto connectors = builder->get_connectors();
+    assert(connectors.size() == 2);
+    MemoryUnit *l2 = connectors[0]->get_next()->get_next();
+    assert(l2 == connectors[1]->get_next()->get_next());
+    MemoryUnit *memory = l2->get_next();
+
+    set<u8> priorities;
+    for (auto conn: connectors) {
+      MemoryUnit *l1 = conn->get_next();
+      assert(conn->get_priority() < l1->get_priority());
+      assert(l1->get_priority() < l2->get_priority());
+      priorities.insert(conn->get_priority());
+      priorities.insert(l1->get_priority());
+    }
+    assert(priorities.size() == 4);
+    assert(l2->get_priority() < memory->get_priority());
+    rounds[round].assign(priorities.begin(), priorities.end());
+    rounds[round].push_back(l2->get_priority());
+    rounds[round].push_back(memory->get_priority());
+  }
+  assert(rounds[0] == rounds[1]);
+  SimulationContext::unbind();
+}
+
+// the specialized kernels decide and count as the generic caches
+void test_cache_kernel() {
+  assert(has_cache_kernel(MemoryConfig(0, 0, 16, 64, 1024, LRU_POLICY)));
+  assert(has_cache_kernel(MemoryConfig(0, 0, 4, 256, 128, LIP_POLICY)));
+  assert(!has_cache_kernel(MemoryConfig(0, 0, 4, 512, 256, LRU_POLICY)));
+  assert(!has_cache_kernel(MemoryConfig(0, 0, 12, 64, 1024, LRU_POLICY)));
+  assert(has_cache_kernel(MemoryConfig(0, 0, 16, 64, 1024, DIP_POLICY)));
+  assert(has_cache_kernel(MemoryConfig(0, 0, 8, 128, 1024, DRRIP_POLICY)));
+  assert(!has_cache_kernel(MemoryConfig(0, 0, 16, 64, 1024, SHIP_POLICY)));
+
+  SimulationOptions options;
+  options.cfg = "../cfg/cfg.json";
+  options.trace_cfg = "../cfg/traces.json";
+  options.processes = 1;
+  options.freq = 10000;
+  options.inst = 20000;
+
+  const char *policies[] = {"LRU", "LIP", "BIP", "DIP", "SRRIP", "BRRIP", "DRRIP"};
+  for (auto policy: policies) {
+    options.policy = policy;
+    string stats[2];
+    u64 ticks[2];
+    for (u32 i = 0; i < 2; i++) {
+      options.kernels = (i == 1);
+      FILE *report = tmpfile();
+      SimulationContext context;
+      context.run(options, report);
+      ticks[i] = context.get_tick();
+
+      rewind(report);
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), report)) > 0) {
+        stats[i].append(buf, n);
+      }
+      fclose(report);
+      // the L1 caches of cfg.json have kernels, the L2 has not
+      assert((stats[i].find("cache kernels: 0 ") == string::npos) == options.kernels);
+      stats[i] = stats[i].substr(0, stats[i].find("event pools:"));
+    }
+    assert(stats[0].find("cache hits") != string::npos);
+    assert(stats[0] == stats[1]);
+    assert(ticks[0] == ticks[1]);
+  }
+}
+
+template <class T>
+class ExposedCache : public T {
+ public:
+  ExposedCache(const string &tag, const MemoryConfig &config) : T(tag, config) {};
+  using T::try_access_memory;
+  using T::on_memory_arrive;
+  using T::_cache_sets;
+};
+
+// the hits of a random stream, misses fill the block at once
+template <class T>
+static vector<bool> run_stream(T &cache, u64 blocks, u32 accesses, u32 seed) {
+  vector<bool> hits;
+  srand(seed);
+  for (u32 i = 0; i < accesses; i++) {
+    MemoryAccessInfo info((rand() % blocks) * 64, 0, 0);
+    hits.push_back(cache.try_access_memory(info));
+    if (!hits.back()) {
+      cache.on_memory_arrive(info);
+    }
+  }
+  return hits;
+}
+
+// the hashed organization decides as the set organization, before and after
+// a checkpoint, also fully associative
+void test_hashed_cache() {
+  struct Geometry {
+    u32 ways;
+    u64 sets;
+    CR_POLICY policy;
+  } geometries[] = {
+    {16, 64, LRU_POLICY}, {16, 64, LIP_POLICY}, {16, 64, BIP_POLICY},
+    {16, 64, DIP_POLICY}, {1024, 1, LRU_POLICY}, {3, 8, LRU_POLICY},
+  };
+  for (auto &g: geometries) {
+    MemoryConfig set_cfg(1, 10, g.ways, 64, g.sets, g.policy);
+    MemoryConfig hashed_cfg(1, 10, g.ways, 64, g.sets, g.policy, DEFAULT_MSHR_ENTRIES,
+                            HASHED_ORGANIZATION);
+    u64 blocks = g.ways * g.sets * 2;
+    ExposedCache<CacheUnit> set_cache("set organized", set_cfg);
+    ExposedCache<HashedCacheUnit> hashed_cache("hashed", hashed_cfg);
+    assert(run_stream(set_cache, blocks, 20000, 1) == run_stream(hashed_cache, blocks, 20000, 1));
+
+    {
+      CheckpointWriter w("unit_test_hashed.ckpt");
+      hashed_cache.save(w);
+    }
+    ExposedCache<HashedCacheUnit> restored("hashed restored", hashed_cfg);
+    {
+      CheckpointReader r("unit_test_hashed.ckpt");
+      restored.restore(r);
+    }
+    vector<bool> hits = run_stream(set_cache, blocks, 20000, 2);
+    assert(hits == run_stream(hashed_cache, blocks, 20000, 2));
+    assert(hits == run_stream(restored, blocks, 20000, 2));
+  }
+  remove("unit_test_hashed.ckpt");
+}
+
+// one access at a time, misses fill the block at once
+template <class T>
+static vector<bool> run_accesses(T &cache, const vector<MemoryAccessInfo> &accesses) {
+  vector<bool> hits;
+  for (auto &info: accesses) {
+    hits.push_back(cache.try_access_memory(info));
+    if (!hits.back()) {
+      cache.on_memory_arrive(info);
+    }
+  }
+  return hits;
+}
+
+// a batch gives the hits of the accesses one by one and leaves the cache in
+// the same state, for the generic unit, the kernels and the hashed
+// organization
+template <class T>
+static void check_access_batch(const MemoryConfig &cfg) {
+  u64 blocks = cfg.ways * cfg.sets * 2;
+  vector<MemoryAccessInfo> accesses;
+  srand(3);
+  for (u32 i = 0; i < 20000; i++) {
+    accesses.push_back(MemoryAccessInfo((rand() % blocks) * 64, 0, i % 2));
+  }
+  ExposedCache<T> one("one by one", cfg);
+  ExposedCache<T> batched("batched", cfg);
+  vector<bool> expected = run_accesses(one, accesses);
+  bool *hits = new bool[accesses.size()];
+  u64 hit_count = batched.access_batch(accesses.data(), accesses.size(), hits);
+  assert(hit_count == (u64)count(expected.begin(), expected.end(), true));
+  for (size_t i = 0; i < accesses.size(); i++) {
+    assert(hits[i] == expected[i]);
+  }
+  delete [] hits;
+
+  // the same blocks and replacement state afterwards
+  expected = run_accesses(one, accesses);
+  assert(run_accesses(batched, accesses) == expected);
+  assert(batched.access_batch(NULL, 0) == 0);
+}
+
+// the kernel of the policy decides as the generic unit
+template <u32 WAYS, u32 BLK, CR_POLICY POLICY>
+static void check_kernel() {
+  MemoryConfig cfg(1, 10, WAYS, BLK, 64, POLICY);
+  ExposedCache<CacheUnit> generic("generic", cfg);
+  ExposedCache<CacheKernel<WAYS, BLK, POLICY> > kernel("kernel", cfg);
+  for (u32 seed: {1, 2}) {
+    vector<bool> hits = run_stream(generic, WAYS * 64 * 2, 20000, seed);
+    assert(hits == run_stream(kernel, WAYS * 64 * 2, 20000, seed));
+  }
+  for (u64 s = 0; s < 64; s++) {
+    for (u32 idx = 0; idx < WAYS; idx++) {
+      assert(generic._cache_sets[s].get_tag(idx) == kernel._cache_sets[s].get_tag(idx));
+      assert(generic._cache_sets[s].get_state(idx) == kernel._cache_sets[s].get_state(idx));
+    }
+  }
+}
+
+void test_access_batch() {
+  check_kernel<4, 64, LRU_POLICY>();
+  check_kernel<8, 128, LIP_POLICY>();
+  check_kernel<16, 64, BIP_POLICY>();
+  check_kernel<16, 64, DIP_POLICY>();
+  check_kernel<4, 256, SRRIP_POLICY>();
+  check_kernel<8, 64, BRRIP_POLICY>();
+  check_kernel<32, 64, DRRIP_POLICY>();
+
+  check_access_batch<CacheUnit>(MemoryConfig(1, 10, 16, 64, 64, LRU_POLICY));
+  check_access_batch<CacheUnit>(MemoryConfig(1, 10, 16, 64, 64, DIP_POLICY));
+  check_access_batch<CacheUnit>(MemoryConfig(1, 10, 16, 64, 64, BIP_POLICY));
+  check_access_batch<CacheUnit>(MemoryConfig(1, 10, 3, 64, 8, RANDOM_POLICY));
+  check_access_batch<CacheKernel<8, 64, LIP_POLICY> >(MemoryConfig(1, 10, 8, 64, 128, LIP_POLICY));
+  check_access_batch<CacheKernel<16, 64, DIP_POLICY> >(MemoryConfig(1, 10, 16, 64, 64, DIP_POLICY));
+  check_access_batch<CacheKernel<8, 128, DRRIP_POLICY> >(MemoryConfig(1, 10, 8, 128, 64,
+                                                                      DRRIP_POLICY));
+  check_access_batch<HashedCacheUnit>(MemoryConfig(1, 10, 512, 64, 1, LRU_POLICY,
+                                                   DEFAULT_MSHR_ENTRIES, HASHED_ORGANIZATION));
+}
+
+// the reference RRIP victim: age the set one step at a time until a way is
+// distant
+static u32 reference_rrip_victim(CacheSet *line, vector<u32> &rrpv) {
+  for (u32 idx = 0; idx < line->get_ways(); idx++) {
+    if (!line->is_valid(idx)) {
+      return idx;
+    }
+  }
+  while (true) {
+    for (u32 idx = 0; idx < rrpv.size(); idx++) {
+      if (rrpv[idx] == 3) {
+        return idx;
+      }
+    }
+    for (auto &value: rrpv) {
+      value++;
+    }
+  }
+}
+
+void test_rrip_set() {
+  auto factory = PolicyFactoryObj::get_instance();
+  CRPolicyInterface* srrip = factory->get_policy(MemoryConfig(0, 0, 0, 0, 0, SRRIP_POLICY));
+
+  // 5 ways leave padding ways in the state column
+  for (u32 ways: {5U, 8U, 16U}) {
+    CacheSet *line = new CacheSet(ways, 64, 1, srrip);
+    vector<u32> rrpv(ways, 3);
+    for (u32 cnt = 0; cnt < 5000; cnt++) {
+      MemoryAccessInfo info((rand() % (ways * 2)) * 64, 0, 0);
+      s32 pos = line->find_pos_by_tag(line->calulate_tag(info.addr));
+      if (line->try_access_memory(info)) {
+        rrpv[pos] = 0;
+      }
+      else {
+        u32 victim = reference_rrip_victim(line, rrpv);
+        line->on_memory_arrive(info);
+        assert(line->find_pos_by_tag(line->calulate_tag(info.addr)) == (s32)victim);
+        rrpv[victim] = 2;
+      }
+      for (u32 idx = 0; idx < ways; idx++) {
+        assert(line->get_state(idx) == rrpv[idx]);
+      }
+    }
+    delete line;
+  }
+
+  // blocks re-referenced survive a scan, under LRU the scan pushes them out
+  for (CR_POLICY policy: {SRRIP_POLICY, LRU_POLICY}) {
+    CacheSet *line = new CacheSet(4, 64, 1, factory->get_policy(MemoryConfig(0, 0, 0, 0, 0, policy)));
+    for (u64 hot = 0; hot < 3; hot++) {
+      MemoryAccessInfo info(hot * 64, 0, 0);
+      line->on_memory_arrive(info);
+      line->try_access_memory(info);
+    }
+    // the hot blocks are touched between pairs of scanned blocks
+    for (u64 scan = 100; scan < 120; scan += 2) {
+      for (u64 hot = 0; hot < 3; hot++) {
+        line->try_access_memory(MemoryAccessInfo(hot * 64, 0, 0));
+      }
+      line->on_memory_arrive(MemoryAccessInfo(scan * 64, 0, 0));
+      line->on_memory_arrive(MemoryAccessInfo((scan + 1) * 64, 0, 0));
+    }
+    bool kept = line->contains(0) && line->contains(64) && line->contains(128);
+    assert(kept == (policy == SRRIP_POLICY));
+    delete line;
+  }
+
+  // BRRIP mostly inserts distant blocks
+  CRPolicyInterface* brrip = factory->get_policy(MemoryConfig(0, 0, 0, 0, 0, BRRIP_POLICY));
+  CacheSet *line = new CacheSet(16, 64, 1, brrip);
+  u32 distant = 0;
+  for (u64 cnt = 0; cnt < 3200; cnt++) {
+    MemoryAccessInfo info(cnt * 64, 0, 0);
+    line->on_memory_arrive(info);
+    u32 state = line->get_state(line->find_pos_by_tag(line->calulate_tag(info.addr)));
+    assert(state == 2 || state == 3);
+    distant += state == 3;
+  }
+  assert(distant > 3000 && distant < 3200);
+  delete line;
+
+  // misses of the base leaders turn the followers to the bimodal policy
+  SetDueling dueling(64);
+  u32 leaders[2] = {0, 0}, base = 0, bimodal = 0, follower = 0;
+  for (u32 set_no = 0; set_no < 64; set_no++) {
+    DUEL_SET_TYPE type = dueling.get_type(set_no);
+    if (type == FOLLOWER) {
+      follower = set_no;
+      continue;
+    }
+    leaders[type]++;
+    (type == BASE_LEADER ? base : bimodal) = set_no;
+  }
+  assert(leaders[BIMODAL_LEADER] == 16 && leaders[BASE_LEADER] == 16);
+  assert(!dueling.use_bimodal(follower) && dueling.use_bimodal(bimodal));
+  for (u32 cnt = 0; cnt < 1024; cnt++) {
+    dueling.on_miss(base);
+  }
+  assert(dueling.use_bimodal(follower) && !dueling.use_bimodal(base));
+  for (u32 cnt = 0; cnt < 1024; cnt++) {
+    dueling.on_miss(bimodal);
+  }
+  assert(!dueling.use_bimodal(follower));
+
+  // blocks restored under a policy of another state start over in it
+  MemoryConfig lru_cfg(1, 10, 8, 64, 16, LRU_POLICY);
+  MemoryConfig drrip_cfg(1, 10, 8, 64, 16, DRRIP_POLICY);
+  ExposedCache<CacheUnit> lru_cache("lru", lru_cfg);
+  ExposedCache<CacheUnit> drrip_cache("drrip", drrip_cfg);
+  vector<MemoryAccessInfo> accesses;
+  for (u32 cnt = 0; cnt < 2000; cnt++) {
+    accesses.push_back(MemoryAccessInfo((rand() % 512) * 64, 0, 0));
+  }
+  lru_cache.access_batch(accesses.data(), accesses.size());
+  drrip_cache.access_batch(accesses.data(), accesses.size());
+  {
+    CheckpointWriter w("unit_test_rrip.ckpt");
+    lru_cache.save(w);
+    drrip_cache.save(w);
+  }
+  ExposedCache<CacheUnit> lru_as_drrip("lru as drrip", drrip_cfg);
+  ExposedCache<CacheUnit> drrip_as_lru("drrip as lru", lru_cfg);
+  {
+    CheckpointReader r("unit_test_rrip.ckpt");
+    lru_as_drrip.restore(r);
+    drrip_as_lru.restore(r);
+  }
+  remove("unit_test_rrip.ckpt");
+  vector<u32> table(4, 0);
+  lru_as_drrip.pid_census(table);
+  assert(table[0] == 8 * 16);
+  for (u64 s = 0; s < 16; s++) {
+    for (u32 idx = 0; idx < 8; idx++) {
+      assert(lru_as_drrip._cache_sets[s].get_state(idx) == 3);
+    }
+  }
+  // a valid LRU stack again
+  drrip_as_lru.access_batch(accesses.data(), accesses.size());
+
+  // DRRIP draws from its own seeded random, the same in every cache and
+  // after a restore
+  ExposedCache<CacheUnit> drrip_again("drrip again", drrip_cfg);
+  drrip_again.access_batch(accesses.data(), accesses.size());
+  {
+    CheckpointWriter w("unit_test_rrip.ckpt");
+    drrip_cache.save(w);
+  }
+  ExposedCache<CacheUnit> drrip_restored("drrip restored", drrip_cfg);
+  {
+    CheckpointReader r("unit_test_rrip.ckpt");
+    drrip_restored.restore(r);
+  }
+  remove("unit_test_rrip.ckpt");
+  vector<bool> expected = run_accesses(drrip_cache, accesses);
+  assert(run_accesses(drrip_again, accesses) == expected);
+  assert(run_accesses(drrip_restored, accesses) == expected);
+}
+
+// signatures stay in the table, the sampled sets learn which PCs insert
+// blocks that are reused, the blocks of the others enter distant
+void test_ship() {
+  MemoryConfig cfg(1, 10, 4, 64, 256, SHIP_POLICY);
+  cfg.predictor_entries = 1024;
+  for (SIGNATURE_HASH hash: {FOLD_SIGNATURE, MULTIPLY_SIGNATURE, LOW_SIGNATURE}) {
+    cfg.signature_hash = hash;
+    CR_SHiP_Policy ship(cfg);
+    for (u64 PC = 0x400000; PC < 0x500000; PC += 0x1234) {
+      assert(ship.signature_of(PC) < 1024);
+    }
+    if (hash != MULTIPLY_SIGNATURE) {
+      assert(ship.signature_of(0x3ff) == 0x3ff);
+    }
+  }
+  assert(cfg.signature_hash == LOW_SIGNATURE);
+
+  // a hot PC reuses a set worth of blocks, a scanning PC streams through
+  const u64 hot_pc = 0x401a30, scan_pc = 0x407c58;
+  vector<MemoryAccessInfo> accesses;
+  u64 scan = 1 << 20;
+  for (u32 round = 0; round < 40; round++) {
+    for (u64 set_no = 0; set_no < 256; set_no++) {
+      for (u64 hot = 0; hot < 4; hot++) {
+        accesses.push_back(MemoryAccessInfo((hot * 256 + set_no) * 64, hot_pc, 0));
+      }
+      accesses.push_back(MemoryAccessInfo((scan++) * 64, scan_pc, 0));
+    }
+  }
+  ExposedCache<CacheUnit> cache("ship", cfg);
+  CR_SHiP_Policy *ship = (CR_SHiP_Policy *)cache.get_policy();
+  assert(ship->signature_of(hot_pc) != ship->signature_of(scan_pc));
+  u64 hits = cache.access_batch(accesses.data(), accesses.size());
+  assert(ship->get_counter(ship->signature_of(scan_pc)) == 0);
+  assert(ship->get_counter(ship->signature_of(hot_pc)) > 1);
+  MemoryAccessInfo next((scan++) * 64, scan_pc, 0);
+  cache.access_batch(&next, 1);
+  u64 set_no = cache.get_set_no(next.addr);
+  CacheSet &line = cache._cache_sets[set_no];
+  assert(line.get_state(line.find_pos_by_tag(line.calulate_tag(next.addr))) == 3);
+
+  // the scanned blocks go first, SRRIP ages the hot blocks to make room
+  MemoryConfig srrip_cfg(1, 10, 4, 64, 256, SRRIP_POLICY);
+  CacheUnit srrip("srrip", srrip_cfg);
+  assert(hits > srrip.access_batch(accesses.data(), accesses.size()));
+
+  // the table and the sampled blocks go with the checkpoint
+  {
+    CheckpointWriter w("unit_test_ship.ckpt");
+    cache.save(w);
+  }
+  ExposedCache<CacheUnit> restored("ship restored", cfg);
+  {
+    CheckpointReader r("unit_test_ship.ckpt");
+    restored.restore(r);
+  }
+  remove("unit_test_ship.ckpt");
+  vector<bool> expected = run_accesses(cache, accesses);
+  assert(run_accesses(restored, accesses) == expected);
+}
+
+// OPTgen decides as OPT on the sampled sets, the PCs of blocks OPT keeps
+// become friendly, the scanning PCs averse
+void test_hawkeye() {
+  // a 2 way set: A B C A B C. OPT keeps A over [0, 3) and B over [1, 4),
+  // then the set is full at time 2 and C misses
+  MemoryConfig tiny(1, 10, 2, 64, 1, HAWKEYE_POLICY);
+  tiny.predictor_entries = 1024;
+  tiny.signature_hash = LOW_SIGNATURE;
+  vector<MemoryAccessInfo> accesses;
+  for (u64 i = 0; i < 6; i++) {
+    accesses.push_back(MemoryAccessInfo(i % 3 * 64, i + 1, 0));
+  }
+  CacheUnit cache("hawkeye tiny", tiny);
+  CR_Hawkeye_Policy *hawkeye = (CR_Hawkeye_Policy *)cache.get_policy();
+  assert(cache.access_batch(accesses.data(), accesses.size()) == 0);
+  // A and B were evicted while predicted friendly, then OPT hit them
+  assert(hawkeye->get_counter(1) == 4);
+  assert(hawkeye->get_counter(2) == 4);
+  // evicted while friendly, then OPT missed it
+  assert(hawkeye->get_counter(3) == 2);
+
+  // the sampling rate is bounded by the sets
+  MemoryConfig cfg(1, 10, 4, 64, 256, HAWKEYE_POLICY);
+  cfg.predictor_entries = 1024;
+  cfg.sampled_sets = 1000;
+  assert(CR_Hawkeye_Policy(cfg).get_sampled_sets() == 256);
+  CacheNodeCfg node(CacheNode, "L2", 10, 64, 4, 256, "Hawkeye", 0, "set", 2048, "fold", 16);
+  MemoryConfig parsed(node, 1);
+  assert(parsed.policy_type == HAWKEYE_POLICY && parsed.sampled_sets == 16);
+  assert(parsed.predictor_entries == 2048);
+
+  // a hot PC reuses a set worth of blocks, a scanning PC streams through
+  const u64 hot_pc = 0x401a30, scan_pc = 0x407c58;
+  accesses.clear();
+  u64 scan = 1 << 20;
+  for (u32 round = 0; round < 40; round++) {
+    for (u64 set_no = 0; set_no < 256; set_no++) {
+      for (u64 hot = 0; hot < 4; hot++) {
+        accesses.push_back(MemoryAccessInfo((hot * 256 + set_no) * 64, hot_pc, 0));
+      }
+      accesses.push_back(MemoryAccessInfo((scan++) * 64, scan_pc, 0));
+    }
+  }
+  CacheUnit lru("lru", MemoryConfig(1, 10, 4, 64, 256, LRU_POLICY));
+  u64 lru_hits = lru.access_batch(accesses.data(), accesses.size());
+  for (u32 sampled: {8, 64}) {
+    cfg.sampled_sets = sampled;
+    CacheUnit trained("hawkeye", cfg);
+    hawkeye = (CR_Hawkeye_Policy *)trained.get_policy();
+    assert(hawkeye->signature_of(hot_pc) != hawkeye->signature_of(scan_pc));
+    assert(trained.access_batch(accesses.data(), accesses.size()) > lru_hits);
+    assert(hawkeye->get_counter(hawkeye->signature_of(scan_pc)) == 0);
+    assert(hawkeye->get_counter(hawkeye->signature_of(hot_pc)) >= 4);
+  }
+
+  // the predictor and OPTgen go with the checkpoint
+  ExposedCache<CacheUnit> saved("hawkeye saved", cfg);
+  saved.access_batch(accesses.data(), accesses.size() / 2);
+  {
+    CheckpointWriter w("unit_test_hawkeye.ckpt");
+    saved.save(w);
+  }
+  ExposedCache<CacheUnit> restored("hawkeye restored", cfg);
+  {
+    CheckpointReader r("unit_test_hawkeye.ckpt");
+    restored.restore(r);
+  }
+  remove("unit_test_hawkeye.ckpt");
+  vector<bool> expected = run_accesses(saved, accesses);
+  assert(run_accesses(restored, accesses) == expected);
+}
+
+// each Pid duels in its own leader sets, a thrashing Pid turns to BIP while
+// the Pid reusing its blocks stays with LRU and keeps them
+void test_tadip() {
+  // a thread per loaded trace
+  MultiTraceLoader local;
+  local.adding_trace("../traces/ls_trace.trace.gz");
+  local.adding_trace("../traces/ls_trace.trace.gz");
+  MultiTraceLoaderObj::bind_local(&local);
+
+  // the leader sets are dealt to the threads, the other threads insert with
+  // LRU in them (TADIP-I) or follow their own PSEL (TADIP-F)
+  for (bool feedback: {false, true}) {
+    SetDueling dueling(64, 2, feedback);
+    u32 leaders[2][2] = {{0, 0}, {0, 0}}, own_base = 0, other_base = 0, follower = 0;
+    for (u32 set_no = 0; set_no < 64; set_no++) {
+      DUEL_SET_TYPE type = dueling.get_type(set_no);
+      if (type == FOLLOWER) {
+        follower = set_no;
+        continue;
+      }
+      u32 owner = dueling.get_owner(set_no);
+      leaders[owner][type]++;
+      if (type == BASE_LEADER) {
+        (owner == 0 ? own_base : other_base) = set_no;
+      }
+    }
+    assert(leaders[0][BIMODAL_LEADER] == 8 && leaders[0][BASE_LEADER] == 8);
+    assert(leaders[1][BIMODAL_LEADER] == 8 && leaders[1][BASE_LEADER] == 8);
+    // the misses of thread 0 in the leaders of thread 1 do not count
+    for (u32 cnt = 0; cnt < 1024; cnt++) {
+      dueling.on_miss(other_base, 0);
+    }
+    assert(dueling.get_PSEL(0) == 0 && dueling.get_PSEL(1) == 0);
+    for (u32 cnt = 0; cnt < 1024; cnt++) {
+      dueling.on_miss(own_base, 0);
+    }
+    assert(dueling.follows_bimodal(0) && !dueling.follows_bimodal(1));
+    assert(dueling.use_bimodal(follower, 0) && !dueling.use_bimodal(own_base, 0));
+    assert(dueling.use_bimodal(other_base, 0) == feedback);
+    assert(!dueling.use_bimodal(follower, 1));
+  }
+
+  // per set Pid 0 reuses 2 blocks, Pid 1 streams 2 of 8 blocks in between
+  vector<MemoryAccessInfo> accesses;
+  for (u32 round = 0; round < 400; round++) {
+    for (u64 set_no = 0; set_no < 64; set_no++) {
+      for (u64 block = 0; block < 2; block++) {
+        accesses.push_back(MemoryAccessInfo((block * 64 + set_no) * 64, 0, 0));
+      }
+      for (u64 i = 0; i < 2; i++) {
+        u64 block = 2 + (round * 2 + i) % 8;
+        accesses.push_back(MemoryAccessInfo((block * 64 + set_no) * 64, 0, 1));
+      }
+    }
+  }
+  CacheNodeCfg node(CacheNode, "L2", 10, 64, 4, 64, "TADIP-F");
+  assert(MemoryConfig(node, 1).policy_type == TADIP_F_POLICY);
+  CacheUnit lru("lru", MemoryConfig(1, 10, 4, 64, 64, LRU_POLICY));
+  u64 lru_hits = lru.access_batch(accesses.data(), accesses.size());
+  for (CR_POLICY policy: {TADIP_I_POLICY, TADIP_F_POLICY}) {
+    MemoryConfig cfg(1, 10, 4, 64, 64, policy);
+    ExposedCache<CacheUnit> cache("tadip", cfg);
+    CR_TADIP_Policy *tadip = (CR_TADIP_Policy *)cache.get_policy();
+    assert(tadip->get_threads() == 2);
+    assert(cache.access_batch(accesses.data(), accesses.size()) > lru_hits);
+    assert(!tadip->follows_bimodal(0) && tadip->follows_bimodal(1));
+    // no PSEL, inserts with LRU
+    assert(!tadip->follows_bimodal(2));
+
+    FILE *report = tmpfile();
+    tadip->display(report, "L2");
+    rewind(report);
+    char line[256] = {0};
+    assert(fgets(line, sizeof(line), report) != NULL);
+    fclose(report);
+    assert(strstr(line, policy == TADIP_F_POLICY ? "TADIP-F L2:" : "TADIP-I L2:") == line);
+    assert(strstr(line, "Pid 0 LRU") != NULL && strstr(line, "Pid 1 BIP") != NULL);
+
+    // the hashed organization decides the same
+    MemoryConfig hashed_cfg(1, 10, 4, 64, 64, policy, DEFAULT_MSHR_ENTRIES, HASHED_ORGANIZATION);
+    ExposedCache<HashedCacheUnit> hashed("tadip hashed", hashed_cfg);
+    ExposedCache<CacheUnit> set_cache("tadip set", cfg);
+    vector<bool> expected = run_accesses(set_cache, accesses);
+    assert(run_accesses(hashed, accesses) == expected);
+
+    // the PSELs, the leader sets and the random of BIP go with the checkpoint
+    {
+      CheckpointWriter w("unit_test_tadip.ckpt");
+      cache.save(w);
+    }
+    ExposedCache<CacheUnit> restored("tadip restored", cfg);
+    {
+      CheckpointReader r("unit_test_tadip.ckpt");
+      restored.restore(r);
+    }
+    remove("unit_test_tadip.ckpt");
+    assert(((CR_TADIP_Policy *)restored.get_policy())->follows_bimodal(1));
+    expected = run_accesses(cache, accesses);
+    assert(run_accesses(restored, accesses) == expected);
+  }
+  MultiTraceLoaderObj::bind_local(NULL);
+}
+
+// the memory references of the trace relocated as the trace_id-th trace,
+// numbered as the cores number them
+static vector<MemoryAccessInfo> read_references(const string &trace, u32 trace_id) {
+  vector<MemoryAccessInfo> refs;
+  TraceLoader loader(trace);
+  TraceFormat t;
+  while (loader.next_instruction(t)) {
+    MultiTraceLoader::relocate(trace_id, t);
+    for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+      if (t.source_memory[i] != 0) {
+        refs.push_back(MemoryAccessInfo(t.source_memory[i], t.pc, trace_id, refs.size()));
+      }
+    }
+    for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+      if (t.destination_memory[i] != 0) {
+        refs.push_back(MemoryAccessInfo(t.destination_memory[i], t.pc, trace_id, refs.size()));
+      }
+    }
+  }
+  return refs;
+}
+
+// the backward pre-pass finds the next uses found by a forward scan
+void test_next_use() {
+  const string trace = "../traces/ls_trace.trace.gz";
+  const u32 block_bits = 6;
+  vector<MemoryAccessInfo> refs = read_references(trace, 1);
+  vector<u32> expected(refs.size(), NextUseFile::NEVER);
+  map<u64, u64> last;
+  for (u64 i = 0; i < refs.size(); i++) {
+    u64 block = refs[i].addr >> block_bits;
+    if (last.count(block)) {
+      expected[last[block]] = i;
+    }
+    last[block] = i;
+  }
+
+  string path = NextUseFile::path_of(trace, 1, block_bits);
+  remove(path.c_str());
+  NextUseFile file(trace, 1, block_bits);
+  assert(file.get_refs() == refs.size());
+  for (u64 i = 0; i < refs.size(); i++) {
+    assert(file.next(i) == expected[i]);
+  }
+  assert(file.next(refs.size()) == NextUseFile::NEVER);
+  remove(path.c_str());
+
+  // a separate directory for the files of read-only trace directories
+  setenv("LIGHTSIM_NEXT_USE_DIR", ".", 1);
+  string cached = NextUseFile::path_of(trace, 1, block_bits);
+  assert(cached.compare(0, 2, "./") == 0 && cached.find("%traces%ls_trace") != string::npos);
+  {
+    NextUseFile in_dir(trace, 1, block_bits);
+    assert(in_dir.get_refs() == refs.size() && in_dir.next(0) == expected[0]);
+  }
+  assert(access(cached.c_str(), R_OK) == 0 && access(path.c_str(), F_OK) != 0);
+  remove(cached.c_str());
+  unsetenv("LIGHTSIM_NEXT_USE_DIR");
+}
+
+// OPT misses less than the other policies on the references of the trace,
+// also as a lower level that only sees the misses of a small upper level
+void test_opt() {
+  auto trace_loader = MultiTraceLoaderObj::get_instance();
+  // loaded by test_pipeline_builder_actual_trace
+  assert(trace_loader->get_trace_num() > 0);
+  const string trace = trace_loader->get_trace_file(0);
+  vector<MemoryAccessInfo> refs = read_references(trace, 0);
+
+  MemoryConfig cfg(1, 10, 4, 64, 64, OPT_POLICY);
+  CacheUnit opt("opt", cfg);
+  u64 hits = opt.access_batch(refs.data(), refs.size());
+  for (CR_POLICY policy: {LRU_POLICY, SRRIP_POLICY, SHIP_POLICY}) {
+    CacheUnit other("other", MemoryConfig(1, 10, 4, 64, 64, policy));
+    assert(hits > other.access_batch(refs.data(), refs.size()));
+  }
+
+  CacheUnit upper("upper", MemoryConfig(1, 10, 2, 64, 8, LRU_POLICY));
+  bool *upper_hits = new bool[refs.size()];
+  upper.access_batch(refs.data(), refs.size(), upper_hits);
+  vector<MemoryAccessInfo> filtered;
+  for (u64 i = 0; i < refs.size(); i++) {
+    if (!upper_hits[i]) {
+      filtered.push_back(refs[i]);
+    }
+  }
+  delete[] upper_hits;
+  assert(filtered.size() < refs.size());
+  CacheUnit lower_opt("lower opt", cfg);
+  CacheUnit lower_lru("lower lru", MemoryConfig(1, 10, 4, 64, 64, LRU_POLICY));
+  assert(lower_opt.access_batch(filtered.data(), filtered.size()) >
+         lower_lru.access_batch(filtered.data(), filtered.size()));
+  remove(NextUseFile::path_of(trace, 0, 6).c_str());
+}
+
+// a simulation restored from a checkpoint ends as the one that saved it
+static void check_checkpoint(const string &cfg, const string &policy) {
+  const char *path = "unit_test.ckpt";
+  SimulationOptions options;
+  options.cfg = cfg;
+  options.trace_cfg = "../cfg/traces.json";
+  options.processes = 1;
+  options.freq = 10000;
+  options.inst = 20000;
+  options.policy = policy;
+  options.policy_cache = "L2";
+
+  string stats[2];
+  u64 ticks[2];
+  for (u32 i = 0; i < 2; i++) {
+    if (i == 0) {
+      options.checkpoint = path;
+      options.checkpoint_at = 10000;
+    }
+    else {
+      options.checkpoint = "";
+      options.restore = path;
+    }
+    FILE *report = tmpfile();
+    SimulationContext context;
+    context.run(options, report);
+    ticks[i] = context.get_tick();
+
+    rewind(report);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), report)) > 0) {
+      stats[i].append(buf, n);
+    }
+    fclose(report);
+    stats[i] = stats[i].substr(0, stats[i].find("event pools:"));
+  }
+  remove(path);
+  assert(stats[0].find("cache hits") != string::npos);
+  assert(stats[0] == stats[1]);
+  assert(ticks[0] == ticks[1]);
+}
+
+// also the random of a Random L2 small enough to evict before and after the
+// checkpoint
+void test_checkpoint() {
+  check_checkpoint("../cfg/cfg.json", "");
+
+  const char *small_l2 = "unit_test_small_l2.json";
+  ofstream(small_l2) << R"({
+    "nodes": [
+      {"type": "cpu", "name": "cpu-core0"},
+      {"type": "cache", "name": "L1-cache-0", "latency": 10, "blocksize": 64,
+       "assoc": 2, "sets": 16, "policy": "LRU"},
+      {"type": "cache", "name": "L2-cache-0", "latency": 100, "blocksize": 64,
+       "assoc": 4, "sets": 8, "policy": "LRU"},
+      {"type": "memory", "name": "main-memory", "latency": 1000}
+    ],
+    "networks": [
+      {"name": "connector0", "input": "cpu-core0", "output": "L1-cache-0"},
+      {"name": "connector1", "input": "L1-cache-0", "output": "L2-cache-0"},
+      {"name": "connector2", "input": "L2-cache-0", "output": "main-memory"}
+    ]
+  })";
+  check_checkpoint(small_l2, "Random");
+  remove(small_l2);
+}
+
 int main() {
   test_pipeline_builder_actual_trace();
   //test_connector();
@@ -419,10 +1950,36 @@ int main() {
   test_valid_addr();
   //test_logger();
   test_event_engine();
+  test_event_engine_order();
+  test_event_pool();
+  test_event_dispatch();
+  test_parallel_engine();
+  test_targeted_arrive();
+  test_mshr_table();
+  test_mshr();
+  test_pc_propagation();
+  test_large_cache();
+  test_simulation_context();
+  test_fast_hit_path();
+  test_cpu_priorities();
+  test_cache_kernel();
+  test_hashed_cache();
+  test_access_batch();
+  test_checkpoint();
+  test_tag_array();
+  test_address_decoder();
+  test_stats_handler();
   test_lru_set();
+  test_rrip_set();
+  test_ship();
+  test_next_use();
+  test_opt();
+  test_hawkeye();
+  test_tadip();
   // test_random_set();
    //test_trace_loader();
-  // cfg is singleton, can only load once
+  // the global cfg loader can only load once, see test_simulation_context
+  // for simulations with their own loaders
   // test_cfg_loader();
 
   // test_pipeline_builder_mock_trace();
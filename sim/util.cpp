@@ -1,7 +1,15 @@
 #include "util.h"
 
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+
 const u64 MACHINE_WORD_SIZE = 64;
-const u64 MAX_SETS_SIZE = 65536;
+const u64 MAX_SETS_SIZE = 1ULL << 26;
+const u32 DEFAULT_MSHR_ENTRIES = 16;
+const u32 DEFAULT_PREDICTOR_ENTRIES = 16384;
+const u32 DEFAULT_SAMPLED_SETS = 64;
 const u64 MAX_BLOCK_SIZE = 65536;
 
 static bool VERBOSE = false;
@@ -14,4 +22,55 @@ bool is_verbose() {
   return VERBOSE;
 }
 
+u32 LinearProbing::bits_for(u32 entries) {
+  u32 bits = 1;
+  while ((1ULL << bits) < 2ULL * entries) {
+    bits++;
+  }
+  return bits;
+}
+
+MemoryRegion::MemoryRegion(size_t size) : _base(NULL), _size(size), _mapped(false),
+    _thp_requested(false) {
+  if (size >= HUGE_PAGE_SIZE) {
+    _size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    // one huge page more, then trim the head and the tail to the alignment
+    size_t mapped = _size + HUGE_PAGE_SIZE;
+    char *p = (char *)mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      SIMLOG(SIM_ERROR, "can not map %zu bytes\n", mapped);
+      exit(1);
+    }
+    char *aligned = (char *)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned > p) {
+      munmap(p, aligned - p);
+    }
+    if (p + mapped > aligned + _size) {
+      munmap(aligned + _size, p + mapped - (aligned + _size));
+    }
+    _base = aligned;
+    _mapped = true;
+#ifdef MADV_HUGEPAGE
+    _thp_requested = madvise(_base, _size, MADV_HUGEPAGE) == 0;
+#endif
+    return;
+  }
+
+  if (posix_memalign(&_base, 64, size > 0 ? size : 64) != 0) {
+    SIMLOG(SIM_ERROR, "can not allocate %zu bytes\n", size);
+    exit(1);
+  }
+  memset(_base, 0, size);
+}
+
+MemoryRegion::~MemoryRegion() {
+  if (_mapped) {
+    munmap(_base, _size);
+  }
+  else {
+    free(_base);
+  }
+}
+
 extern bool VERBOSE;
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>     /* atexit */
 #include <cassert>
+#include <cstddef>
 
 typedef signed long long s64;
 typedef unsigned long long u64;
@@ -26,6 +27,10 @@ typedef unsigned short u8;
 template <typename T> class Singleton {
 public:
  static T* &get_instance() {
+   if (_local) {
+     return _local;
+   }
+
    if (_instance == 0) {
      _instance = new T;
      atexit(del);
@@ -34,6 +39,12 @@ public:
    return _instance;
  }
 
+ // the calling thread uses its own instance (e.g. one event engine per
+ // thread in the parallel simulation), NULL restores the global one
+ static void bind_local(T *instance) {
+   _local = instance;
+ }
+
 private:
  static void del() {
    delete _instance;
@@ -45,13 +56,25 @@ private:
  ~Singleton();
 
  static T* _instance;
+ static thread_local T* _local;
 };
 
 template <typename T>
 T* Singleton <T>::_instance = NULL;
 
+template <typename T>
+thread_local T* Singleton <T>::_local = NULL;
+
 extern const u64 MACHINE_WORD_SIZE;
 extern const u64 MAX_SETS_SIZE;
+// outstanding misses of a unit without the mshrs configuration
+extern const u32 DEFAULT_MSHR_ENTRIES;
+// predictor counters of a SHiP or Hawkeye cache without the
+// predictor_entries configuration
+extern const u32 DEFAULT_PREDICTOR_ENTRIES;
+// sets training the predictor of a SHiP or Hawkeye cache without the
+// sampled_sets configuration
+extern const u32 DEFAULT_SAMPLED_SETS;
 extern const u64 MAX_BLOCK_SIZE;
 
 inline bool check_addr_valid(u64 addr) {
@@ -78,4 +101,100 @@ inline u32 len_of_binary(u64 num) {
 void set_verbose();
 bool is_verbose();
 
+/*
+ * 开放寻址、线性探测的哈希表(MSHR表与hashed组织的每set索引共用)。
+ * 槽数为2的幂且至少是表项数的两倍，最多半满，探测序列很短；键经乘法哈希
+ * 取高bits位得到起始槽；删除时把探测序列经过空洞的后续槽前移(backward
+ * shift)，不需要墓碑，插入、删除都不分配内存。
+ * 表不保存槽，只在调用者给出的2^bits个槽上操作，槽的类型与键由Ops给出:
+ * is_free(slot)、key_of(slot)(非空槽的键)、clear(slot)
+ */
+class LinearProbing {
+ public:
+  // bits of the slots for at most the entries
+  static u32 bits_for(u32 entries);
+
+  static inline u32 home_of(u64 key, u32 bits) {
+    return (u32)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+  }
+
+  // the slot holding the key, -1 if none
+  template <typename Slot, typename Ops>
+  static s32 find(const Slot *slots, u32 bits, u64 key, const Ops &ops) {
+    u32 mask = (1U << bits) - 1;
+    for (u32 i = home_of(key, bits); !ops.is_free(slots[i]); i = (i + 1) & mask) {
+      if (ops.key_of(slots[i]) == key) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // the free slot for a key not in the table, the table must not be full
+  template <typename Slot, typename Ops>
+  static u32 insert_at(const Slot *slots, u32 bits, u64 key, const Ops &ops) {
+    u32 mask = (1U << bits) - 1;
+    u32 i = home_of(key, bits);
+    while (!ops.is_free(slots[i])) {
+      assert(ops.key_of(slots[i]) != key);
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  // free the slot, the slots after it may move
+  template <typename Slot, typename Ops>
+  static void erase(Slot *slots, u32 bits, u32 hole, const Ops &ops) {
+    u32 mask = (1U << bits) - 1;
+    assert(hole <= mask && !ops.is_free(slots[hole]));
+    // move back the slots whose probe sequence passes the hole
+    for (u32 i = (hole + 1) & mask; !ops.is_free(slots[i]); i = (i + 1) & mask) {
+      u32 home = home_of(ops.key_of(slots[i]), bits);
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        slots[hole] = slots[i];
+        hole = i;
+      }
+    }
+    ops.clear(slots[hole]);
+  }
+};
+
+/*
+ * 一块连续、清零、按64字节对齐的内存，用于cache的块元数据等大数组。
+ * 不小于HUGE_PAGE_SIZE时直接mmap，多映射一个大页后裁去首尾，使区域按
+ * 大页对齐，并建议内核用透明大页(THP)映射，大cache(百万级set)的元数据
+ * 不再占用大量TLB项。建议被接受不代表已分配大页，内核是否真的使用大页
+ * 取决于THP的配置与内存碎片情况
+ */
+class MemoryRegion {
+ private:
+  void *        _base;
+  size_t        _size;
+  bool          _mapped;
+  bool          _thp_requested;
+
+  MemoryRegion(const MemoryRegion &);
+  MemoryRegion & operator= (const MemoryRegion &);
+
+ public:
+  static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+  explicit MemoryRegion(size_t size);
+  ~MemoryRegion();
+
+  inline void* get_base() {
+    return _base;
+  }
+
+  inline size_t get_size() {
+    return _size;
+  }
+
+  // the kernel accepted the advice to back the region with huge pages,
+  // not whether it did
+  inline bool is_thp_requested() {
+    return _thp_requested;
+  }
+};
+
 #endif